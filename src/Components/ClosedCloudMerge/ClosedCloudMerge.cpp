@@ -48,9 +48,18 @@ ClosedCloudMerge::ClosedCloudMerge(const std::string & name) :
     ICP_max_iterations("ICP.Iterations",2000),
     RanSAC_inliers_threshold("RanSac.Inliers_threshold",0.01f),
     RanSAC_max_iterations("RanSac.Iterations",2000),
+    RanSAC_confidence("RanSac.Confidence",0.99),
+    RanSAC_guided("RanSac.Guided",true),
+    RanSAC_threads("RanSac.Threads",1),
+    correspondences_trees("Correspondences.Trees", 4),
+    correspondences_checks("Correspondences.Checks", -1),
+    correspondences_brute_force("Correspondences.BruteForce", 5000),
+    correspondences_ratio("Correspondences.Ratio", 0),
     viewNumber("View.Number", 5),
     maxIterations("Interations.Max", 5),
-    corrTreshold("Correspondenc.Treshold", 10)
+    corrTreshold("Correspondenc.Treshold", 10),
+    shortlist_views("Shortlist.Views", 0),
+    registration_threads("Registration.Threads", 1)
 {
     registerProperty(prop_ICP_alignment);
     registerProperty(prop_ICP_alignment_normal);
@@ -60,15 +69,18 @@ ClosedCloudMerge::ClosedCloudMerge(const std::string & name) :
     registerProperty(ICP_max_iterations);
     registerProperty(RanSAC_inliers_threshold);
     registerProperty(RanSAC_max_iterations);
+    registerProperty(RanSAC_confidence);
+    registerProperty(RanSAC_guided);
+    registerProperty(RanSAC_threads);
+    registerProperty(correspondences_trees);
+    registerProperty(correspondences_checks);
+    registerProperty(correspondences_brute_force);
+    registerProperty(correspondences_ratio);
     registerProperty(maxIterations);
     registerProperty(viewNumber);
     registerProperty(corrTreshold);
-
-	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
-	properties.ICP_max_iterations = ICP_max_iterations;
-	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
-	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
-	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+    registerProperty(shortlist_views);
+    registerProperty(registration_threads);
 }
 
 ClosedCloudMerge::~ClosedCloudMerge() {
@@ -95,6 +107,20 @@ void ClosedCloudMerge::prepareInterface() {
 }
 
 bool ClosedCloudMerge::onInit() {
+	// Properties are loaded after construction.
+	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
+	properties.ICP_max_iterations = ICP_max_iterations;
+	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	properties.RanSAC_threads = RanSAC_threads;
+	properties.correspondences_trees = correspondences_trees;
+	properties.correspondences_checks = correspondences_checks;
+	properties.correspondences_brute_force = correspondences_brute_force;
+	properties.correspondences_ratio = correspondences_ratio;
+
 	// Number of viewpoints.
 	counter = 0;
 	// Mean number of features per view.
@@ -102,9 +128,16 @@ bool ClosedCloudMerge::onInit() {
 
 	global_trans = Eigen::Matrix4f::Identity();
 
-	cloud_merged = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
+	rgb_assembler.clear();
+	cloud_merged = rgb_assembler.getCloud();
 	cloud_sift_merged = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>());
-	cloud_normal_merged = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
+	merged_generation = 0;
+	merged_index.setParams(MergeUtils::searchParams(properties));
+	merged_index.reset(*cloud_sift_merged, merged_generation);
+	view_vocabulary.clear();
+	view_indices.clear();
+	rgbn_assembler.clear();
+	cloud_normal_merged = rgbn_assembler.getCloud();
 	return true;
 }
 
@@ -121,6 +154,24 @@ bool ClosedCloudMerge::onStart() {
 }
 
 
+DescriptorIndex::Ptr ClosedCloudMerge::viewIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_sift) {
+	// Views matched exhaustively need no index.
+	if (MergeUtils::useBruteForce(*cloud_sift, *cloud_sift, properties))
+		return DescriptorIndex::Ptr();
+	return MergeUtils::buildIndex(cloud_sift, properties);
+}
+
+void ClosedCloudMerge::updatePoses(int views) {
+	// Only views moved by LUM are transformed again.
+	for (int i = 1 ; i < views; i++)
+	{
+		rgb_assembler.setPose(i, lum_sift.getTransformation (i));
+		rgbn_assembler.setPose(i, lum_sift.getTransformation (i));
+	}
+	rgb_assembler.assemble(views);
+	rgbn_assembler.assemble(views);
+}
+
 void ClosedCloudMerge::addViewToModel()
 {
     CLOG(LINFO) << "ClosedCloudMerge::addViewToModel";
@@ -165,13 +216,17 @@ void ClosedCloudMerge::addViewToModel()
 		out_mean_viewpoint_features_number.write(cloud_sift->size());
 
 		lum_sift.addPointCloud(cloud_sift);
+		view_vocabulary.addView(cloud_sift);
+		view_indices.push_back(viewIndex(cloud_sift));
 		*rgbn_views[0] = *cloud;
 		*rgb_views[0] = *cloudrgb;
+		rgbn_assembler.addView(rgbn_views[0]);
+		rgb_assembler.addView(rgb_views[0]);
+		rgbn_assembler.assemble();
+		rgb_assembler.assemble();
 
-
-		*cloud_merged = *cloudrgb;
-		*cloud_normal_merged = *cloud;
 		*cloud_sift_merged = *cloud_sift;
+		merged_index.reset(*cloud_sift_merged, ++merged_generation);
 
 		out_cloud_xyzrgb.write(cloud_merged);
 		out_cloud_xyzrgb_normals.write(cloud_normal_merged);
@@ -185,7 +240,7 @@ void ClosedCloudMerge::addViewToModel()
 //	 Find corespondences between feature clouds.
 //	 Initialize parameters.
 	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-	MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, correspondences);
+	MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, merged_generation, merged_index, correspondences, properties);
 
 	CLOG(LINFO) << "  correspondences: " << correspondences->size() ;
     // Compute transformation between clouds and SOMGenerator global transformation of cloud.
@@ -220,80 +275,72 @@ void ClosedCloudMerge::addViewToModel()
 	lum_sift.addPointCloud(cloud_sift);
 	*rgbn_views[counter -1] = *cloud;
 	*rgb_views[counter -1] = *cloudrgb;
-
+	rgbn_assembler.addView(rgbn_views[counter -1]);
+	rgb_assembler.addView(rgb_views[counter -1]);
+
+
+	// Only the previous views most similar to the new one are matched and verified.
+	std::vector<int> candidates;
+	std::vector<float> scores;
+	if (shortlist_views > 0 && counter - 1 > shortlist_views)
+		view_vocabulary.query(cloud_sift, shortlist_views, candidates, scores);
+	if (candidates.empty())
+		for (int i = counter - 2 ; i >= 0; i--)
+			candidates.push_back(i);
+	view_vocabulary.addView(cloud_sift);
+	view_indices.push_back(viewIndex(cloud_sift));
+
+	// Pairs are registered in parallel, correspondences are set in the order of candidates.
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> targets;
+	std::vector<DescriptorIndex::Ptr> target_indices;
+	for (size_t c = 0; c < candidates.size(); ++c) {
+		targets.push_back(lum_sift.getPointCloud(candidates[c]));
+		target_indices.push_back(view_indices[candidates[c]]);
+	}
+	std::vector<pcl::CorrespondencesPtr> pair_inliers;
+	MergeUtils::registerPairs(lum_sift.getPointCloud(counter - 1), view_indices[counter - 1], targets, target_indices, pair_inliers, properties, registration_threads);
 
 	int added = 0;
-	for (int i = counter - 2 ; i >= 0; i--)
+	for (size_t c = 0; c < candidates.size(); ++c)
 	{
-		pcl::CorrespondencesPtr correspondences2(new pcl::Correspondences()) ;
-		MergeUtils::computeCorrespondences(lum_sift.getPointCloud(counter - 1), lum_sift.getPointCloud(i), correspondences2);
-		pcl::CorrespondencesPtr correspondences3(new pcl::Correspondences()) ;
-		MergeUtils::computeTransformationSAC(lum_sift.getPointCloud(counter - 1), lum_sift.getPointCloud(i), correspondences2, *correspondences3, properties) ;
-		//cortab[counter-1][i] = inliers2;
-		CLOG(LINFO) << "  correspondences3: " << correspondences3->size() << " out of " << correspondences2->size();
-		if (correspondences3->size() > corrTreshold) {
-			lum_sift.setCorrespondences(counter-1, i, correspondences3);
+		CLOG(LINFO) << "  correspondences3 with view " << candidates[c] << ": " << pair_inliers[c]->size();
+		if (pair_inliers[c]->size() > corrTreshold) {
+			lum_sift.setCorrespondences(counter-1, candidates[c], pair_inliers[c]);
 			added++;
-
-		//	for(int j = 0; j< correspondences3->size();j++){
-		//		if (correspondences3->at(j).index_query >=lum_sift.getPointCloud(counter - 1)->size() || correspondences3->at(j).index_match >=lum_sift.getPointCloud(i)->size()){
-		//			continue;
-		//		}
-		//		if (lum_sift.getPointCloud(i)->at(correspondences3->at(j).index_match).multiplicity != -1) {
-		//			lum_sift.getPointCloud(counter - 1)->at(correspondences3->at(j).index_query).multiplicity = lum_sift.getPointCloud(i)->at(correspondences3->at(j).index_match).multiplicity + 1;//
-	//				lum_sift.getPointCloud(i)->at(correspondences3->at(j).index_match).multiplicity=-1;
-	//			} else
-	//				lum_sift.getPointCloud(counter - 1)->at(correspondences3->at(j).index_query).multiplicity += 1;
-	//		}
 		}
-	//break;
-	//CLOG(LINFO) << "computet for "<<counter-1 <<" and "<< i << "  correspondences2: " << correspondences2->size() << " out of " << correspondences2->size();
 	}
 	CLOG(LINFO) << "view " << counter << " have correspondences with " << added << " views";
 	if (added == 0 )
 		CLOG(LINFO) << " Non corespondences found" <<endl;
 
 
-	*cloud_merged = *(rgb_views[0]);
-	*cloud_normal_merged = *(rgbn_views[0]);
-
 	if (counter > viewNumber) {
 		lum_sift.setMaxIterations(maxIterations);
 		lum_sift.compute();
+		// LUM moves the views, not their descriptors - the index follows the concatenation of views,
+		// features filtered out of it are only removed from the index.
+		std::vector<bool> removed;
+		removed.reserve(cloud_sift_merged->size() + cloud_sift->size());
+		for (size_t i = 0; i < cloud_sift_merged->size(); i++)
+			removed.push_back(MergeUtils::RemovedFeature()(cloud_sift_merged->points[i]));
+		for (size_t i = 0; i < cloud_sift->size(); i++)
+			removed.push_back(MergeUtils::RemovedFeature()(cloud_sift->points[i]));
+		merged_index.append(*cloud_sift, ++merged_generation);
+		merged_index.remove(removed, ++merged_generation);
+
 		cloud_sift_merged = lum_sift.getConcatenatedCloud ();
 		CLOG(LINFO) << "ended";
 		CLOG(LINFO) << "cloud_merged from LUM ";
-		for (int i = 1 ; i < viewNumber; i++)
-		{
-			pcl::PointCloud<pcl::PointXYZRGB> tmprgb = *(rgb_views[i]);
-			pcl::PointCloud<pcl::PointXYZRGBNormal> tmp = *(rgbn_views[i]);
-			pcl::transformPointCloud(tmp, tmp, lum_sift.getTransformation (i));
-			pcl::transformPointCloud(tmprgb, tmprgb, lum_sift.getTransformation (i));
-			*cloud_merged += tmprgb;
-			*cloud_normal_merged += tmp;
-		}
+		updatePoses(viewNumber);
 
 		// Delete points.
-		pcl::PointCloud<PointXYZSIFT>::iterator pt_iter = cloud_sift_merged->begin();
-		while(pt_iter!=cloud_sift_merged->end()){
-			if(pt_iter->multiplicity==-1){
-				pt_iter = cloud_sift_merged->erase(pt_iter);
-			} else {
-				++pt_iter;
-			}
-		}
+		MergeUtils::removePointsIf(*cloud_sift_merged, MergeUtils::RemovedFeature());
 	} else {
-		for (int i = 1 ; i < counter; i++)
-		{
-			pcl::PointCloud<pcl::PointXYZRGB> tmprgb = *(rgb_views[i]);
-			pcl::PointCloud<pcl::PointXYZRGBNormal> tmp = *(rgbn_views[i]);
-			pcl::transformPointCloud(tmp, tmp, lum_sift.getTransformation (i));
-			pcl::transformPointCloud(tmprgb, tmprgb, lum_sift.getTransformation (i));
-			*cloud_merged += tmprgb;
-			*cloud_normal_merged += tmp;
-		}
+		updatePoses(counter);
 		CLOG(LINFO) << "cloud added ";
 		cloud_sift_merged = lum_sift.getConcatenatedCloud ();
+		// Concatenation keeps the order of views, so only the new one has to be indexed.
+		merged_index.append(*cloud_sift, ++merged_generation);
 	}
 
 		//*cloud_sift_merged += *cloud_sift;
@@ -12,6 +12,8 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <Types/MergeUtils.hpp>
+#include <Types/VocabularyTree.hpp>
+#include <Types/MergedCloudAssembler.hpp>
 #include <Types/PointXYZSIFT.hpp>
 #include <Types/SIFTObjectModel.hpp>
 #include <Types/SIFTObjectModelFactory.hpp>
@@ -106,9 +108,31 @@ protected:
 	/// Total number of features (in all views).
 	int total_viewpoint_features_number;
 
+	/// Views transformed by their LUM poses, their clouds are cloud_merged and cloud_normal_merged.
+	MergedCloudAssembler<pcl::PointXYZRGB> rgb_assembler;
+	MergedCloudAssembler<pcl::PointXYZRGBNormal> rgbn_assembler;
+
+	/// Moves the first views of both merged clouds to their current LUM poses.
+	void updatePoses(int views);
+
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_merged;
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_normal_merged;
 	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_sift_merged;
+
+	/// Descriptor index following cloud_sift_merged, updated with every added view.
+	IncrementalDescriptorIndex merged_index;
+
+	/// Generation of cloud_sift_merged - incremented whenever its features change.
+	unsigned long merged_generation;
+
+	/// Bag of words of the views added to LUM, document ids equal to LUM vertices.
+	VocabularyTree view_vocabulary;
+
+	/// Descriptor index of every view added to LUM, built once and reused by all its pairwise matches.
+	std::vector<DescriptorIndex::Ptr> view_indices;
+
+	/// Builds the descriptor index of a view (null if the view is small enough to be matched exhaustively).
+	DescriptorIndex::Ptr viewIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_sift);
 	Eigen::Matrix4f global_trans;
 
 	std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> rgb_views;
@@ -127,8 +151,28 @@ public:
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
+    /// Number of threads scoring SAC hypotheses (0 - one per core).
+    Base::Property<int> RanSAC_threads;
+
+    /// Descriptor search - number of randomized kd-trees and leaves checked per query (negative - exact search).
+    Base::Property<int> correspondences_trees;
+    Base::Property<int> correspondences_checks;
+
+    /// Clouds with at most this number of features are matched exhaustively (0 - never), with optional ratio test.
+    Base::Property<int> correspondences_brute_force;
+    Base::Property<float> correspondences_ratio;
 
     Base::Property<int> viewNumber, maxIterations, corrTreshold;
+
+    /// Number of most similar previous views verified with every new view (0 - all of them).
+    Base::Property<int> shortlist_views;
+
+    /// Number of threads registering the new view with previous ones (1 - sequential, 0 - one per core).
+    Base::Property<int> registration_threads;
 };
 
 REGISTER_COMPONENT("ClosedCloudMerge", Processors::ClosedCloudMerge::ClosedCloudMerge)
@@ -15,6 +15,8 @@
 #include <pcl/point_cloud.h>
 #include <pcl/kdtree/kdtree_flann.h>
 
+#include <Types/MergeUtils.hpp>
+
 namespace Processors {
 namespace CloudCutter {
 
@@ -66,6 +68,8 @@ void CloudCutter::cut() {
 	pcl::KdTreeFLANN<PointXYZSIFT> kdtree; 
 	kdtree.setInputCloud (cloud); 
 	
+	// Points are removed after all searches - the tree refers to the original indices.
+	std::vector<int> removed;
 	for(int i=0; i<indices->size();i++){
 		pcl::PointXYZ searchPoint = indices->points[i]; 
 		PointXYZSIFT searchPoint_xyzsift;
@@ -78,13 +82,12 @@ void CloudCutter::cut() {
 		if ( kdtree.radiusSearch (searchPoint_xyzsift, radius, pointIdxRadiusSearch, pointRadiusSquaredDistance) > 0 ) 
         { 
                 cout<<"Znaleziono " <<pointIdxRadiusSearch.size() << " punktów"<<endl;
-                for (size_t i = 0; i < pointIdxRadiusSearch.size (); ++i){
-					cloud->erase(cloud->begin() + pointIdxRadiusSearch[i]);//-1??
-				}
+                removed.insert(removed.end(), pointIdxRadiusSearch.begin(), pointIdxRadiusSearch.end());
                 
                 
         } 
 	}
+	MergeUtils::removePoints(*cloud, removed);
 	
 	out_cloud.write(cloud);
 
@@ -19,6 +19,8 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_representation.h>
+#include <Types/SIFTFeatureRepresentation.hpp>
+#include <Types/MergeUtils.hpp>
 
 #include "pcl/impl/instantiate.hpp"
 #include "pcl/search/kdtree.h"
@@ -83,31 +85,6 @@ public:
   }
 };
 
-/*
- * \brief Class used for transformation from SIFT descriptor to array of floats.
- */
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-	/// Templatiated number of SIFT descriptor dimensions.
-	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-
-	public:
-	SIFTFeatureRepresentation ()
-	{
-		// Define the number of dimensions.
-		nr_dimensions_ = 128 ;
-		trivial_ = false ;
-	}
-
-	/// Overrides the copyToFloatArray method to define our feature vector
-	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-	{
-		//This representation is only for determining correspondences (not for use in Kd-tree for example - so use only the SIFT part of the point.
-		for (register int i = 0; i < 128 ; i++)
-			out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-	}
-};
-
 void CloudMerge::computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, pcl::Correspondences* correspondences)
 {
 	CLOG(LTRACE) << "Computing Correspondences" << std::endl;
@@ -126,17 +103,16 @@ Eigen::Matrix4f CloudMerge::computeTransformationSAC(const pcl::PointCloud<Point
 {
 	CLOG(LTRACE) << "Computing SAC" << std::endl ;
 
-	pcl::registration::CorrespondenceRejectorSampleConsensus<PointXYZSIFT> sac ;
-	sac.setInputSource(cloud_src) ;
-	sac.setInputTarget(cloud_trg) ;
-	sac.setInlierThreshold(RanSAC_inliers_threshold) ; //property RanSAC
-	sac.setMaximumIterations(RanSAC_max_iterations) ; //property RanSAC
-	sac.setInputCorrespondences(correspondences) ;
-	sac.getCorrespondences(inliers) ;
+	MergeUtils::Properties properties;
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold; //property RanSAC
+	properties.RanSAC_max_iterations = RanSAC_max_iterations; //property RanSAC
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	Eigen::Matrix4f transformation = MergeUtils::computeTransformationSAC(cloud_src, cloud_trg, correspondences, inliers, properties);
 
 	CLOG(LINFO) << "SAC inliers " << inliers.size();
 
-	return sac.getBestTransformation() ;
+	return transformation;
 }
 
 Eigen::Matrix4f CloudMerge::computeTransformationIPC(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg)
@@ -165,62 +141,18 @@ Eigen::Matrix4f CloudMerge::computeTransformationIPC(const pcl::PointCloud<pcl::
 
 Eigen::Matrix4f CloudMerge::computeTransformationIPCNormals(const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_trg)
 {
-    // Use ICP to get "better" transformation.
-    pcl::IterativeClosestPointWithNormals<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> icp;
-
-    // Set the max correspondence distance to 5cm (e.g., correspondences with higher distances will be ignored)
-    icp.setMaxCorrespondenceDistance (CloudMerge::ICP_max_correspondence_distance); //property
-    // Set the maximum number of iterations (criterion 1)
-    icp.setMaximumIterations (CloudMerge::ICP_max_iterations); // property
-    // Set the transformation epsilon (criterion 2)
-    icp.setTransformationEpsilon (CloudMerge::ICP_transformation_epsilon); //property
-    // Set the euclidean distance difference epsilon (criterion 3)
-    icp.setEuclideanFitnessEpsilon (0.001); // property ?
-
-    icp.setInputSource(cloud_src);
-
-    icp.setInputTarget(cloud_trg);
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr Final (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr points_with_normals_src (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-
-    //icp.align(*Final);
-
-    // Run the same optimization in a loop and visualize the results
-    Eigen::Matrix4f Ti = Eigen::Matrix4f::Identity (), prev, targetToSource;
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr reg_result (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-    reg_result = cloud_src;
-
-    for (int i = 0; i < 30; ++i)
-    {
-
-      // Estimate
-        icp.setInputSource(reg_result);
-
-        icp.align (*Final);
-        if(icp.converged_==false)
-        {
-        	PCL_INFO("Not enough correspondences so nothing happened\n");
-        	return Eigen::Matrix4f::Identity();
-        }
-
-  		//accumulate transformation between each Iteration
-      Ti = icp.getFinalTransformation () * Ti;
-
-  		//if the difference between this transformation and the previous one
-  		//is smaller than the threshold, refine the process by reducing
-  		//the maximal correspondence distance
-      if (fabs ((icp.getLastIncrementalTransformation () - prev).sum ()) < icp.getTransformationEpsilon ())
-        icp.setMaxCorrespondenceDistance (icp.getMaxCorrespondenceDistance () - 0.001);
-
-      prev = icp.getLastIncrementalTransformation ();
-
-      reg_result= Final;
-    }
+    MergeUtils::Properties properties;
+    properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
+    properties.ICP_max_iterations = ICP_max_iterations;
+    properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
 
-    CLOG(LINFO) << "ICP has converged:" << icp.hasConverged() << " score: " << icp.getFitnessScore();
+    // Single point-to-plane run with annealed correspondence distance.
+    MergeUtils::ICPReport report;
+    Eigen::Matrix4f transformation = MergeUtils::computeTransformationICPNormals(cloud_src, cloud_trg, properties, &report);
+    CLOG(LINFO) << "ICP has converged:" << report.converged << " iterations: " << report.iterations << " score: " << report.fitness;
 
     // Get the transformation from target to source.
-    return icp.getFinalTransformation().inverse();
+    return transformation.inverse();
 }
 
 CloudMerge::CloudMerge(const std::string & name) :
@@ -232,7 +164,9 @@ CloudMerge::CloudMerge(const std::string & name) :
     ICP_max_correspondence_distance("ICP.Correspondence_distance",0.1),
     ICP_max_iterations("ICP.Iterations",2000),
     RanSAC_inliers_threshold("RanSac.Inliers_threshold",0.01f),
-    RanSAC_max_iterations("RanSac.Iterations",2000)
+    RanSAC_max_iterations("RanSac.Iterations",2000),
+    RanSAC_confidence("RanSac.Confidence",0.99),
+    RanSAC_guided("RanSac.Guided",true)
 {
     registerProperty(prop_ICP_alignment);
     registerProperty(prop_ICP_alignment_normal);
@@ -242,6 +176,8 @@ CloudMerge::CloudMerge(const std::string & name) :
     registerProperty(ICP_max_iterations);
     registerProperty(RanSAC_inliers_threshold);
     registerProperty(RanSAC_max_iterations);
+    registerProperty(RanSAC_confidence);
+    registerProperty(RanSAC_guided);
 }
 
 
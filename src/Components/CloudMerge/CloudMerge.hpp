@@ -142,6 +142,10 @@ public:
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
 
 };
 
@@ -46,7 +46,14 @@ CorrespondenceMatcher::CorrespondenceMatcher(const std::string & name) :
     ICP_max_correspondence_distance("ICP.Correspondence_distance",0.1),
     ICP_max_iterations("ICP.Iterations",2000),
     RanSAC_inliers_threshold("RanSac.Inliers_threshold",0.01f),
-    RanSAC_max_iterations("RanSac.Iterations",2000)
+    RanSAC_max_iterations("RanSac.Iterations",2000),
+    RanSAC_confidence("RanSac.Confidence",0.99),
+    RanSAC_guided("RanSac.Guided",true),
+    RanSAC_threads("RanSac.Threads",1),
+    correspondences_trees("Correspondences.Trees", 4),
+    correspondences_checks("Correspondences.Checks", -1),
+    correspondences_brute_force("Correspondences.BruteForce", 5000),
+    correspondences_ratio("Correspondences.Ratio", 0)
 {
     registerProperty(prop_ICP_alignment);
     registerProperty(prop_ICP_alignment_normal);
@@ -56,12 +63,13 @@ CorrespondenceMatcher::CorrespondenceMatcher(const std::string & name) :
     registerProperty(ICP_max_iterations);
     registerProperty(RanSAC_inliers_threshold);
     registerProperty(RanSAC_max_iterations);
-
-	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
-	properties.ICP_max_iterations = ICP_max_iterations;
-	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
-	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
-	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+    registerProperty(RanSAC_confidence);
+    registerProperty(RanSAC_guided);
+    registerProperty(RanSAC_threads);
+    registerProperty(correspondences_trees);
+    registerProperty(correspondences_checks);
+    registerProperty(correspondences_brute_force);
+    registerProperty(correspondences_ratio);
 }
 
 CorrespondenceMatcher::~CorrespondenceMatcher() {
@@ -83,6 +91,19 @@ void CorrespondenceMatcher::prepareInterface() {
 }
 
 bool CorrespondenceMatcher::onInit() {
+	// Properties are loaded after construction.
+	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
+	properties.ICP_max_iterations = ICP_max_iterations;
+	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	properties.RanSAC_threads = RanSAC_threads;
+	properties.correspondences_trees = correspondences_trees;
+	properties.correspondences_checks = correspondences_checks;
+	properties.correspondences_brute_force = correspondences_brute_force;
+	properties.correspondences_ratio = correspondences_ratio;
 
 	return true;
 }
@@ -118,7 +139,7 @@ void CorrespondenceMatcher::mach()
 
 
 	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-	MergeUtils::computeCorrespondences(cloud_first, cloud_sec, correspondences);
+	MergeUtils::computeCorrespondences(cloud_first, cloud_sec, correspondences, properties);
 	pcl::CorrespondencesPtr inliers(new pcl::Correspondences()) ;
 	Eigen::Matrix4f current_trans = MergeUtils::computeTransformationSAC(cloud_first, cloud_sec, correspondences, *inliers, properties);
 
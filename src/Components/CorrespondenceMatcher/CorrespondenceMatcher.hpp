@@ -105,6 +105,20 @@ public:
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
+    /// Number of threads scoring SAC hypotheses (0 - one per core).
+    Base::Property<int> RanSAC_threads;
+
+    /// Descriptor search - number of randomized kd-trees and leaves checked per query (negative - exact search).
+    Base::Property<int> correspondences_trees;
+    Base::Property<int> correspondences_checks;
+
+    /// Clouds with at most this number of features are matched exhaustively (0 - never), with optional ratio test.
+    Base::Property<int> correspondences_brute_force;
+    Base::Property<float> correspondences_ratio;
 
 };
 
@@ -12,9 +12,16 @@
 
 #include <boost/bind.hpp>
 
+#include <Types/MergeUtils.hpp>
+
 namespace Processors {
 namespace Downsampling {
 
+/// Selects points merged into another one (-1) or left without multiplicity (0).
+struct NotRepresentative {
+	bool operator()(const PointXYZSIFT & p) const { return p.multiplicity == -1 || p.multiplicity == 0; }
+};
+
 Downsampling::Downsampling(const std::string & name) :
 		Base::Component(name),
 		radius("radius", 0.005)  {
@@ -106,16 +113,7 @@ void Downsampling::downsample_xyzsift() {
 	
 
 	//usuniecie nadmiarowych punktow
-	pt_iter = cloud->begin();
-	 while(pt_iter!=cloud->end()){
-		 if(pt_iter->multiplicity==-1 || pt_iter->multiplicity==0){
-			 pt_iter = cloud->erase(pt_iter);
-		}
-		else{
-			++pt_iter;	
-		}
-		
-	}
+	MergeUtils::removePointsIf(*cloud, NotRepresentative());
 	
 	cout<<"cloud size: "<<cloud->size()<<endl;
 
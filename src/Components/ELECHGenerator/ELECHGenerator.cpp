@@ -79,31 +79,6 @@ public:
   }
 };
 
-/*
- * \brief Class used for transformation from SIFT descriptor to array of floats.
- */
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-	/// Templatiated number of SIFT descriptor dimensions.
-	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-
-	public:
-	SIFTFeatureRepresentation ()
-	{
-		// Define the number of dimensions.
-		nr_dimensions_ = 128 ;
-		trivial_ = false ;
-	}
-
-	/// Overrides the copyToFloatArray method to define our feature vector
-	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-	{
-		//This representation is only for determining correspondences (not for use in Kd-tree for example - so use only the SIFT part of the point.
-		for (register int i = 0; i < 128 ; i++)
-			out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-	}
-};
-
 
 ELECHGenerator::ELECHGenerator(const std::string & name) :
     Base::Component(name),
@@ -115,7 +90,14 @@ ELECHGenerator::ELECHGenerator(const std::string & name) :
     ICP_max_correspondence_distance("ICP.Correspondence_distance",0.1),
     ICP_max_iterations("ICP.Iterations",2000),
     RanSAC_inliers_threshold("RanSac.Inliers_threshold",0.01f),
-    RanSAC_max_iterations("RanSac.Iterations",2000)
+    RanSAC_max_iterations("RanSac.Iterations",2000),
+    RanSAC_confidence("RanSac.Confidence",0.99),
+    RanSAC_guided("RanSac.Guided",true),
+    RanSAC_threads("RanSac.Threads",1),
+    correspondences_trees("Correspondences.Trees", 4),
+    correspondences_checks("Correspondences.Checks", -1),
+    correspondences_brute_force("Correspondences.BruteForce", 5000),
+    correspondences_ratio("Correspondences.Ratio", 0)
 {
 	registerProperty(Elch_loop_dist);
 	registerProperty(Elch_rejection_threshold);
@@ -127,12 +109,13 @@ ELECHGenerator::ELECHGenerator(const std::string & name) :
     registerProperty(ICP_max_iterations);
     registerProperty(RanSAC_inliers_threshold);
     registerProperty(RanSAC_max_iterations);
-
-	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
-	properties.ICP_max_iterations = ICP_max_iterations;
-	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
-	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
-	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+    registerProperty(RanSAC_confidence);
+    registerProperty(RanSAC_guided);
+    registerProperty(RanSAC_threads);
+    registerProperty(correspondences_trees);
+    registerProperty(correspondences_checks);
+    registerProperty(correspondences_brute_force);
+    registerProperty(correspondences_ratio);
 }
 
 ELECHGenerator::~ELECHGenerator() {
@@ -159,6 +142,20 @@ void ELECHGenerator::prepareInterface() {
 }
 
 bool ELECHGenerator::onInit() {
+	// Properties are loaded after construction.
+	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
+	properties.ICP_max_iterations = ICP_max_iterations;
+	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	properties.RanSAC_threads = RanSAC_threads;
+	properties.correspondences_trees = correspondences_trees;
+	properties.correspondences_checks = correspondences_checks;
+	properties.correspondences_brute_force = correspondences_brute_force;
+	properties.correspondences_ratio = correspondences_ratio;
+
 	// Number of viewpoints.
 	counter = 0;
 	// Mean number of features per view.
@@ -166,8 +163,14 @@ bool ELECHGenerator::onInit() {
 
 	global_trans = Eigen::Matrix4f::Identity();
 
-	cloud_merged = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
+	rgb_assembler.clear();
+	cloud_merged = rgb_assembler.getCloud();
+	loop_detector.clear();
+	loop_detector.setDistance(Elch_loop_dist);
 	cloud_sift_merged = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>());
+	merged_generation = 0;
+	merged_index.setParams(MergeUtils::searchParams(properties));
+	merged_index.reset(*cloud_sift_merged, merged_generation);
 	cloud_normal_merged = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
 	
 
@@ -179,6 +182,14 @@ bool ELECHGenerator::onFinish() {
 }
 
 bool ELECHGenerator::onStop() {
+	// A loop still pending at the end of the session is closed as well.
+	int first, last;
+	if (loop_detector.finish(first, last)) {
+		closeLoop(first, last);
+		rgb_assembler.assemble();
+		out_cloud_xyzrgb.write(cloud_merged);
+		out_cloud_xyzsift.write(cloud_sift_merged);
+	}
 	return true;
 }
 
@@ -186,48 +197,6 @@ bool ELECHGenerator::onStart() {
 	return true;
 }
 
-bool loopDetection (int end, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds, double dist, int &first, int &last)
-{
-  static double min_dist = -1;
-  int state = 0;
-
-  for (int i = end-1; i >= 0; i--)
-  {
-    Eigen::Vector4f cstart, cend;
-    pcl::compute3DCentroid (*(clouds[i]), cstart);
-    pcl::compute3DCentroid (*(clouds[end]), cend);
-    Eigen::Vector4f diff = cend - cstart;
-    double norm = diff.norm ();
-
-    std::cout << endl << "distance between " << i << " and " << end << " is " << norm << " state is " << state << endl;
-
-    if (state == 0 && norm > dist)
-    {
-      state = 1;
-      //std::cout << "state 1" << std::endl;
-    }
-    if (state > 0 && norm < dist)
-    {
-      state = 2;
-      std::cout << "loop detected between scan " << i << " and scan " << end  << endl;
-      if (min_dist < 0 || norm < min_dist)
-      {
-        min_dist = norm;
-        first = i;
-        last = end;
-        break;
-      }
-    }
-  }
-  //std::cout << "min_dist: " << min_dist << " state: " << state << " first: " << first << " end: " << end << std::endl;
-   if (min_dist > 0 && (state < 2 || end == int (clouds.size ()) - 1)) //TODO
-   {
-     min_dist = -1;
-     return true;
-   }
-   return false;
- }
-
 void ELECHGenerator::addViewToModel() {
     CLOG(LTRACE) << "LUMGenerator::addViewToModel";
 
@@ -274,11 +243,14 @@ CLOG(LINFO) << "view number: "<<counter;
 		elch_sift.addPointCloud(sift_views[0]);
 		*rgb_views[0] = *cloudrgb;
 		elch_rgb.addPointCloud(rgb_views[0]);
+		rgb_assembler.addView(rgb_views[0]);
+		rgb_assembler.assemble();
+		loop_detector.addView(*rgb_views[0]);
 
 
-		*cloud_merged = *cloudrgb;
 		*cloud_normal_merged = *cloud;
 		*cloud_sift_merged = *cloud_sift;
+		merged_index.reset(*cloud_sift_merged, ++merged_generation);
 
 		out_cloud_xyzrgb.write(cloud_merged);
 		out_cloud_xyzsift.write(cloud_sift_merged);
@@ -287,7 +259,7 @@ CLOG(LINFO) << "view number: "<<counter;
 	//	 Find corespondences between feature clouds.
 	//	 Initialize parameters.
 	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-	MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, correspondences);
+	MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, merged_generation, merged_index, correspondences, properties);
 	CLOG(LINFO) << "Number of reciprocal correspondences: " << correspondences->size() << " out of " << cloud_sift->size() << " features";
 
     // Compute transformation between clouds and SOMGenerator global transformation of cloud.
@@ -318,37 +290,25 @@ CLOG(LINFO) << "view number: "<<counter;
 	elch_sift.addPointCloud(sift_views[counter -1]);
 	*rgb_views[counter -1] = *cloudrgb;
 	elch_rgb.addPointCloud(rgb_views[counter -1]);
+	rgb_assembler.addView(rgb_views[counter -1]);
+	loop_detector.addView(*rgb_views[counter -1]);
 //	*cloud_sift_merged += *cloud_sift;
 
 	int first, last;
-	if (loopDetection(counter-1, rgb_views, Elch_loop_dist, first, last))
+	if (loop_detector.detect(counter-1, first, last))
 	{
-		CLOG(LINFO) << "loop beetween " << first << " and " << last;
-		elch_rgb.setLoopStart(first);
-		elch_rgb.setLoopEnd(last);
-		pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB>::Ptr icp (new pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB>);
-		icp->setMaximumIterations(Elch_ICP_max_iterations);
-		icp->setMaxCorrespondenceDistance(Elch_max_correspondence_distance);
-		icp->setRANSACOutlierRejectionThreshold(Elch_rejection_threshold);
-		elch_rgb.setReg(icp);
-		elch_rgb.compute();
-		
-		elch_sift.setLoopStart(first);
-		elch_sift.setLoopEnd(last);
-		
-		elch_sift.setLoopTransform(elch_rgb.getLoopTransform());
-		elch_sift.compute();
+		closeLoop(first, last);
 	}
-
-	*cloud_merged = *(rgb_views[0]);
-	for (int i = 1 ; i < counter; i++)
+	else
 	{
-		pcl::PointCloud<PointXYZSIFT> tmp_sift = *(sift_views[i]);
-		pcl::PointCloud<pcl::PointXYZRGB> tmp = *(rgb_views[i]);
-		*cloud_sift_merged += tmp_sift;
-		*cloud_merged += tmp;
+		// Only the new view is added to the merged features and their index.
+		*cloud_sift_merged += *(sift_views[counter - 1]);
+		merged_index.append(*(sift_views[counter - 1]), ++merged_generation);
 	}
 
+	// Without a loop closure only the new view is copied.
+	rgb_assembler.assemble();
+
 	CLOG(LINFO) << "model cloud->size(): "<< cloud_merged->size();
 	CLOG(LINFO) << "model cloud_sift->size(): "<< cloud_sift_merged->size();
 
@@ -362,5 +322,32 @@ CLOG(LINFO) << "view number: "<<counter;
 	out_cloud_xyzsift.write(cloud_sift_merged);
 }
 
+void ELECHGenerator::closeLoop(int first, int last) {
+	CLOG(LINFO) << "loop beetween " << first << " and " << last;
+	elch_rgb.setLoopStart(first);
+	elch_rgb.setLoopEnd(last);
+	pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB>::Ptr icp (new pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB>);
+	icp->setMaximumIterations(Elch_ICP_max_iterations);
+	icp->setMaxCorrespondenceDistance(Elch_max_correspondence_distance);
+	icp->setRANSACOutlierRejectionThreshold(Elch_rejection_threshold);
+	elch_rgb.setReg(icp);
+	elch_rgb.compute();
+	
+	elch_sift.setLoopStart(first);
+	elch_sift.setLoopEnd(last);
+	
+	elch_sift.setLoopTransform(elch_rgb.getLoopTransform());
+	elch_sift.compute();
+
+	// ELCH moved the views in place - their centroids are recomputed, merged features are gathered and indexed anew.
+	for (int i = 0 ; i < counter; i++)
+		loop_detector.updateView(i, *(rgb_views[i]));
+	rgb_assembler.invalidateAll();
+	cloud_sift_merged->clear();
+	for (int i = 0 ; i < counter; i++)
+		*cloud_sift_merged += *(sift_views[i]);
+	merged_index.reset(*cloud_sift_merged, ++merged_generation);
+}
+
 } //: namespace ELECHGenerator
 } //: namespace Processors
@@ -19,6 +19,8 @@
 #include <Types/SIFTObjectModel.hpp>
 #include <Types/SIFTObjectModelFactory.hpp>
 #include <Types/MergeUtils.hpp>
+#include <Types/MergedCloudAssembler.hpp>
+#include <Types/LoopDetector.hpp>
 
 
 #include <pcl/registration/correspondence_estimation.h>
@@ -111,6 +113,9 @@ protected:
 	// Handlers
     void addViewToModel();
 
+	/// Closes the loop between the given views with ELCH, moves the views and gathers the merged features anew.
+	void closeLoop(int first, int last);
+
     MergeUtils::Properties properties;
 
 	/// Number of views.
@@ -123,9 +128,19 @@ protected:
 	std::vector<pcl::PointCloud<PointXYZSIFT>::Ptr> sift_views;
 	pcl::registration::ELCH<pcl::PointXYZRGB> elch_rgb;
 	pcl::registration::ELCH<PointXYZSIFT> elch_sift;
+	/// Concatenation of the views, refreshed only when ELCH moved them, its cloud is cloud_merged.
+	MergedCloudAssembler<pcl::PointXYZRGB> rgb_assembler;
+	/// Centroids of the views, searched for loop closures.
+	LoopDetector loop_detector;
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_merged;
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_normal_merged;
 	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_sift_merged;
+
+	/// Descriptor index following cloud_sift_merged, updated with every added view.
+	IncrementalDescriptorIndex merged_index;
+
+	/// Generation of cloud_sift_merged - incremented whenever its features change.
+	unsigned long merged_generation;
 	Eigen::Matrix4f global_trans;
 
     Base::Property<double> ICP_transformation_epsilon;
@@ -135,6 +150,20 @@ protected:
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
+    /// Number of threads scoring SAC hypotheses (0 - one per core).
+    Base::Property<int> RanSAC_threads;
+
+    /// Descriptor search - number of randomized kd-trees and leaves checked per query (negative - exact search).
+    Base::Property<int> correspondences_trees;
+    Base::Property<int> correspondences_checks;
+
+    /// Clouds with at most this number of features are matched exhaustively (0 - never), with optional ratio test.
+    Base::Property<int> correspondences_brute_force;
+    Base::Property<float> correspondences_ratio;
 
     /// Alignment mode: use ICP alignment or not.
 	/// ICP properties
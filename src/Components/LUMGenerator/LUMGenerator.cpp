@@ -23,6 +23,7 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_representation.h>
+#include <Types/SIFTFeatureRepresentation.hpp>
 
 #include "pcl/impl/instantiate.hpp"
 #include "pcl/search/kdtree.h"
@@ -79,48 +80,18 @@ public:
   }
 };
 
-/*
- * \brief Class used for transformation from SIFT descriptor to array of floats.
- */
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-	/// Templatiated number of SIFT descriptor dimensions.
-	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-
-	public:
-	SIFTFeatureRepresentation ()
-	{
-		// Define the number of dimensions.
-		nr_dimensions_ = 128 ;
-		trivial_ = false ;
-	}
-
-	/// Overrides the copyToFloatArray method to define our feature vector
-	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-	{
-		//This representation is only for determining correspondences (not for use in Kd-tree for example - so use only the SIFT part of the point.
-		for (register int i = 0; i < 128 ; i++)
-			out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-	}
-};
-
 
 Eigen::Matrix4f LUMGenerator::computeTransformationSAC(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg,
 		const pcl::CorrespondencesConstPtr& correspondences, pcl::Correspondences& inliers)
 {
 //	CLOG(LTRACE) << "Computing SAC" << std::endl ;
 
-	pcl::registration::CorrespondenceRejectorSampleConsensus<PointXYZSIFT> sac ;
-	sac.setInputSource(cloud_src) ;
-	sac.setInputTarget(cloud_trg) ;
-	sac.setInlierThreshold(0.01f) ; //property RanSAC
-	sac.setMaximumIterations(2000) ; //property RanSAC
-	sac.setInputCorrespondences(correspondences) ;
-	sac.getCorrespondences(inliers) ;
+	// Thresholds set in onInit().
+	Eigen::Matrix4f transformation = MergeUtils::computeTransformationSAC(cloud_src, cloud_trg, correspondences, inliers, properties);
 
 	CLOG(LINFO) << "SAC inliers " << inliers.size();
 
-	return sac.getBestTransformation() ;
+	return transformation;
 }
 
 
@@ -128,11 +99,31 @@ LUMGenerator::LUMGenerator(const std::string & name) :
     Base::Component(name),
     prop_ICP_alignment("ICP.Iterative", false),
 	threshold("threshold", 5),
-	maxIterations("Interations.Max", 5)
+	maxIterations("Interations.Max", 5),
+	correspondences_trees("Correspondences.Trees", 4),
+	correspondences_checks("Correspondences.Checks", -1),
+	correspondences_brute_force("Correspondences.BruteForce", 5000),
+	correspondences_ratio("Correspondences.Ratio", 0),
+	shortlist_views("Shortlist.Views", 0),
+	registration_threads("Registration.Threads", 1),
+	RanSAC_inliers_threshold("RanSac.Inliers_threshold", 0.01f),
+	RanSAC_max_iterations("RanSac.Iterations", 2000),
+	RanSAC_confidence("RanSac.Confidence", 0.99),
+	RanSAC_guided("RanSac.Guided", true)
 {
 	registerProperty(maxIterations);
 	registerProperty(threshold);
     registerProperty(prop_ICP_alignment);
+    registerProperty(correspondences_trees);
+    registerProperty(correspondences_checks);
+    registerProperty(correspondences_brute_force);
+    registerProperty(correspondences_ratio);
+    registerProperty(shortlist_views);
+    registerProperty(registration_threads);
+    registerProperty(RanSAC_inliers_threshold);
+    registerProperty(RanSAC_max_iterations);
+    registerProperty(RanSAC_confidence);
+    registerProperty(RanSAC_guided);
 
 }
 
@@ -171,14 +162,27 @@ void LUMGenerator::prepareInterface() {
 }
 
 bool LUMGenerator::onInit() {
+	properties.correspondences_trees = correspondences_trees;
+	properties.correspondences_checks = correspondences_checks;
+	properties.correspondences_brute_force = correspondences_brute_force;
+	properties.correspondences_ratio = correspondences_ratio;
+	// SAC of the view registration.
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+
 	// Number of viewpoints.
 	counter = 0;
 	// Mean number of features per view.
 	mean_viewpoint_features_number = 0;
 
 	global_trans = Eigen::Matrix4f::Identity();
+	view_vocabulary.clear();
+	view_indices.clear();
 
-	cloud_merged = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
+	rgb_assembler.clear();
+	cloud_merged = rgb_assembler.getCloud();
 	cloud_sift_merged = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>());
 /*
 	cloud_prev = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
@@ -202,46 +206,12 @@ bool LUMGenerator::onStart() {
 	return true;
 }
 
-bool loopDetection (int end, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds, double dist, int &first, int &last)
-{
-  static double min_dist = -1;
-  int state = 0;
-
-  for (int i = end-1; i >= 0; i--)
-  {
-    Eigen::Vector4f cstart, cend;
-    pcl::compute3DCentroid (*(clouds[i]), cstart);
-    pcl::compute3DCentroid (*(clouds[end]), cend);
-    Eigen::Vector4f diff = cend - cstart;
-    double norm = diff.norm ();
-
-    std::cout << endl << "distance between " << i << " and " << end << " is " << norm << " state is " << state << endl;
-
-    if (state == 0 && norm > dist)
-    {
-      state = 1;
-      //std::cout << "state 1" << std::endl;
-    }
-    if (state > 0 && norm < dist)
-    {
-      state = 2;
-      std::cout << "loop detected between scan " << i << " and scan " << end  << endl;
-      if (min_dist < 0 || norm < min_dist)
-      {
-        min_dist = norm;
-        first = i;
-        last = end;
-      }
-    }
-  }
-  //std::cout << "min_dist: " << min_dist << " state: " << state << " first: " << first << " end: " << end << std::endl;
-   if (min_dist > 0 && (state < 2 || end == int (clouds.size ()) - 1)) //TODO
-   {
-     min_dist = -1;
-     return true;
-   }
-   return false;
- }
+DescriptorIndex::Ptr LUMGenerator::viewIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_sift) {
+	// Views matched exhaustively need no index.
+	if (MergeUtils::useBruteForce(*cloud_sift, *cloud_sift, properties))
+		return DescriptorIndex::Ptr();
+	return MergeUtils::buildIndex(cloud_sift, properties);
+}
 
 void LUMGenerator::addViewToModel() {
     CLOG(LTRACE) << "LUMGenerator::addViewToModel";
@@ -277,13 +247,9 @@ void LUMGenerator::addViewToModel() {
 			lum_sift.compute();
 			CLOG(LINFO) << "ended";
 			CLOG(LINFO) << "cloud_merged from LUM ";
-			*cloud_merged = *(rgb_views[0]);
 			for (int i = 1 ; i < threshold; i++)
-			{
-				pcl::PointCloud<pcl::PointXYZRGB> tmp = *(rgb_views[i]);
-				pcl::transformPointCloud(tmp, tmp, lum_sift.getTransformation (i));
-				*cloud_merged += tmp;
-			}
+				rgb_assembler.setPose(i, lum_sift.getTransformation (i));
+			rgb_assembler.assemble(threshold);
 
 			CLOG(LINFO) << "model cloud->size(): "<< cloud_merged->size();
 			CLOG(LINFO) << "model cloud_sift->size(): "<< cloud_sift_merged->size();
@@ -307,10 +273,13 @@ void LUMGenerator::addViewToModel() {
 		out_mean_viewpoint_features_number.write(mean_viewpoint_features_number);
 
 		lum_sift.addPointCloud(cloud_sift);
+		view_vocabulary.addView(cloud_sift);
+		view_indices.push_back(viewIndex(cloud_sift));
 		*rgb_views[0] = *cloud;
+		rgb_assembler.addView(rgb_views[0]);
+		rgb_assembler.assemble();
 
 
-		*cloud_merged = *cloud;
 		*cloud_sift_merged = *cloud_sift;
 
 		out_cloud_xyzrgb.write(cloud_merged);
@@ -324,13 +293,7 @@ void LUMGenerator::addViewToModel() {
 //	 Find corespondences between feature clouds.
 //	 Initialize parameters.
 	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-	pcl::registration::CorrespondenceEstimation<PointXYZSIFT, PointXYZSIFT> correst;
-	SIFTFeatureRepresentation::Ptr point_representation2(new SIFTFeatureRepresentation()) ;
-	correst.setPointRepresentation(point_representation2) ;
-	correst.setInputSource(cloud_sift) ;
-	correst.setInputTarget(cloud_sift_merged) ;
-	// Find correspondences.
-	correst.determineReciprocalCorrespondences(*correspondences) ;
+	MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, correspondences, properties);
 	CLOG(LINFO) << "Number of reciprocal correspondences: " << correspondences->size() << " out of " << cloud_sift->size() << " features";
 
 
@@ -343,31 +306,37 @@ void LUMGenerator::addViewToModel() {
 
 	lum_sift.addPointCloud(cloud_sift);
 	*rgb_views[counter -1] = *cloud;
+	rgb_assembler.addView(rgb_views[counter -1]);
 //	*cloud_sift_merged += *cloud_sift;
 
-//	loopDetection(counter-1, rgb_views, 0.03, first, last);
+	// Only the previous views most similar to the new one are matched and verified.
+	std::vector<int> candidates;
+	std::vector<float> scores;
+	if (shortlist_views > 0 && counter - 1 > shortlist_views)
+		view_vocabulary.query(cloud_sift, shortlist_views, candidates, scores);
+	if (candidates.empty())
+		for (int i = counter - 2 ; i >= 0; i--)
+			candidates.push_back(i);
+	view_vocabulary.addView(cloud_sift);
+	view_indices.push_back(viewIndex(cloud_sift));
+
+	// Pairs are registered in parallel, correspondences are set in the order of candidates.
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> targets;
+	std::vector<DescriptorIndex::Ptr> target_indices;
+	for (size_t c = 0; c < candidates.size(); ++c) {
+		targets.push_back(lum_sift.getPointCloud(candidates[c]));
+		target_indices.push_back(view_indices[candidates[c]]);
+	}
+	std::vector<pcl::CorrespondencesPtr> pair_inliers;
+	MergeUtils::registerPairs(lum_sift.getPointCloud(counter - 1), view_indices[counter - 1], targets, target_indices, pair_inliers, properties, registration_threads);
+
 	int added = 0;
-	for (int i = counter - 2 ; i >= 0; i--)
+	for (size_t c = 0; c < candidates.size(); ++c)
 	{
-		pcl::CorrespondencesPtr correspondences2(new pcl::Correspondences()) ;
-		pcl::registration::CorrespondenceEstimation<PointXYZSIFT, PointXYZSIFT> correst2;
-		SIFTFeatureRepresentation::Ptr point_representation(new SIFTFeatureRepresentation()) ;
-		correst2.setPointRepresentation(point_representation) ;
-		correst2.setInputSource(lum_sift.getPointCloud(counter - 1));
-		correst2.setInputTarget(lum_sift.getPointCloud(i));
-		// Find correspondences.
-		correst2.determineReciprocalCorrespondences(*correspondences2);
-		//CLOG(LINFO) << "Number of reciprocal correspondences: " << correspondences2->size() << " out of " << lum_sift.getPointCloud(counter - 1)->size() << " features";
-
-		pcl::CorrespondencesPtr correspondences3(new pcl::Correspondences()) ;
-		computeTransformationSAC(lum_sift.getPointCloud(counter - 1), lum_sift.getPointCloud(i), correspondences2, *correspondences3) ;
-		//cortab[counter-1][i] = inliers2;
-		if (correspondences3->size() > 10) {
-			lum_sift.setCorrespondences(counter-1, i, correspondences3);
+		if (pair_inliers[c]->size() > 10) {
+			lum_sift.setCorrespondences(counter-1, candidates[c], pair_inliers[c]);
 			added++;
 		}
-	//break;
-	//CLOG(LINFO) << "computet for "<<counter-1 <<" and "<< i << "  correspondences2: " << correspondences2->size() << " out of " << correspondences2->size();
 	}
 	CLOG(LINFO) << "view " << counter << " have correspondences with " << added << " views";
 	if (added == 0 )
@@ -393,13 +362,10 @@ void LUMGenerator::addViewToModel() {
 //		}
 //	}
 
-	*cloud_merged = *(rgb_views[0]);
+	// Only views moved by LUM are transformed again.
 	for (int i = 1 ; i < counter; i++)
-	{
-		pcl::PointCloud<pcl::PointXYZRGB> tmp = *(rgb_views[i]);
-		pcl::transformPointCloud(tmp, tmp, lum_sift.getTransformation (i));
-		*cloud_merged += tmp;
-	}
+		rgb_assembler.setPose(i, lum_sift.getTransformation (i));
+	rgb_assembler.assemble();
 
 	cloud_sift_merged = lum_sift.getConcatenatedCloud ();
 
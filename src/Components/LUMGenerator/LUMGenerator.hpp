@@ -18,6 +18,9 @@
 #include <Types/PointXYZSIFT.hpp>
 #include <Types/SIFTObjectModel.hpp>
 #include <Types/SIFTObjectModelFactory.hpp>
+#include <Types/MergeUtils.hpp>
+#include <Types/VocabularyTree.hpp>
+#include <Types/MergedCloudAssembler.hpp>
 
 #include <pcl/registration/correspondence_estimation.h>
 #include "pcl/registration/correspondence_rejection_sample_consensus.h"
@@ -120,6 +123,18 @@ protected:
 
 	std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> rgb_views;
     pcl::registration::LUM<PointXYZSIFT> lum_sift;
+
+	/// Bag of words of the views added to LUM, document ids equal to LUM vertices.
+	VocabularyTree view_vocabulary;
+
+	/// Descriptor index of every view added to LUM, built once and reused by all its pairwise matches.
+	std::vector<DescriptorIndex::Ptr> view_indices;
+
+	/// Builds the descriptor index of a view (null if the view is small enough to be matched exhaustively).
+	DescriptorIndex::Ptr viewIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_sift);
+
+	/// Views transformed by their LUM poses, its cloud is cloud_merged.
+	MergedCloudAssembler<pcl::PointXYZRGB> rgb_assembler;
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_merged;
 	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_sift_merged;
 	Eigen::Matrix4f global_trans;
@@ -128,16 +143,34 @@ protected:
 	/// ICP properties
     Base::Property<bool> prop_ICP_alignment;
     Base::Property<int> threshold, maxIterations;
-  //  Base::Property<bool> prop_ICP_iterations;
- /*   Base::Property<float> ICP_transformation_epsilon;
-    Base::Property<float> ICP_max_correspondence_distance;
-    Base::Property<int> ICP_max_iterations;
 
+    /// Descriptor search - number of randomized kd-trees and leaves checked per query (negative - exact search).
+    Base::Property<int> correspondences_trees;
+    Base::Property<int> correspondences_checks;
+
+    /// Clouds with at most this number of features are matched exhaustively (0 - never), with optional ratio test.
+    Base::Property<int> correspondences_brute_force;
+    Base::Property<float> correspondences_ratio;
+
+    /// Number of most similar previous views verified with every new view (0 - all of them).
+    Base::Property<int> shortlist_views;
+
+    /// Number of threads registering the new view with previous ones (1 - sequential, 0 - one per core).
+    Base::Property<int> registration_threads;
 
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
 
+    MergeUtils::Properties properties;
+  //  Base::Property<bool> prop_ICP_iterations;
+ /*   Base::Property<float> ICP_transformation_epsilon;
+    Base::Property<float> ICP_max_correspondence_distance;
+    Base::Property<int> ICP_max_iterations;
 */
 
 /*	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_prev ;
@@ -58,7 +58,24 @@ OpenCloudMerge::OpenCloudMerge(const std::string & name) :
 	ICP_max_correspondence_distance("ICP.Correspondence_distance", 0.1),
 	ICP_max_iterations("ICP.Iterations", 2000),
 	RanSAC_inliers_threshold("RanSac.Inliers_threshold", 0.01f),
-	RanSAC_max_iterations("RanSac.Iterations", 2000) {
+	RanSAC_max_iterations("RanSac.Iterations", 2000),
+	RanSAC_confidence("RanSac.Confidence", 0.99),
+	RanSAC_guided("RanSac.Guided", true),
+	RanSAC_threads("RanSac.Threads", 1),
+	correspondences_trees("Correspondences.Trees", 4),
+	correspondences_checks("Correspondences.Checks", -1),
+	correspondences_brute_force("Correspondences.BruteForce", 5000),
+	correspondences_ratio("Correspondences.Ratio", 0),
+	merge_leaf_size("Merge.LeafSize", 0),
+	ICP_submap_views("ICP.Submap_views", 0),
+	ICP_submap_crop("ICP.Submap_crop", false),
+	ICP_pyramid_levels("ICP.Pyramid_levels", 0),
+	ICP_pyramid_leaf("ICP.Pyramid_leaf", 0.005f),
+	ICP_pyramid_coarse_iterations("ICP.Pyramid_coarse_iterations", 20),
+	ICP_pyramid_fine_iterations("ICP.Pyramid_fine_iterations", 10),
+	ICP_min_correspondence_distance("ICP.Min_correspondence_distance", 0.01f),
+	ICP_color_weight("ICP.Color_weight", 0.001f),
+	ICP_threads("ICP.Threads", 1) {
 
 	ICP_max_iterations.addConstraint("1");
 	ICP_max_iterations.addConstraint("2000");
@@ -70,12 +87,23 @@ OpenCloudMerge::OpenCloudMerge(const std::string & name) :
 	registerProperty (ICP_max_iterations);
 	registerProperty (RanSAC_inliers_threshold);
 	registerProperty (RanSAC_max_iterations);
-
-	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
-	properties.ICP_max_iterations = ICP_max_iterations;
-	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
-	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
-	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	registerProperty (RanSAC_confidence);
+	registerProperty (RanSAC_guided);
+	registerProperty (RanSAC_threads);
+	registerProperty (correspondences_trees);
+	registerProperty (correspondences_checks);
+	registerProperty (correspondences_brute_force);
+	registerProperty (correspondences_ratio);
+	registerProperty (merge_leaf_size);
+	registerProperty (ICP_submap_views);
+	registerProperty (ICP_submap_crop);
+	registerProperty (ICP_pyramid_levels);
+	registerProperty (ICP_pyramid_leaf);
+	registerProperty (ICP_pyramid_coarse_iterations);
+	registerProperty (ICP_pyramid_fine_iterations);
+	registerProperty (ICP_min_correspondence_distance);
+	registerProperty (ICP_color_weight);
+	registerProperty (ICP_threads);
 }
 
 OpenCloudMerge::~OpenCloudMerge() {
@@ -105,15 +133,45 @@ void OpenCloudMerge::prepareInterface() {
 }
 
 bool OpenCloudMerge::onInit() {
+	// Properties are loaded after construction.
+	properties.ICP_transformation_epsilon = ICP_transformation_epsilon;
+	properties.ICP_max_iterations = ICP_max_iterations;
+	properties.ICP_max_correspondence_distance = ICP_max_correspondence_distance;
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	properties.RanSAC_threads = RanSAC_threads;
+	properties.correspondences_trees = correspondences_trees;
+	properties.correspondences_checks = correspondences_checks;
+	properties.correspondences_brute_force = correspondences_brute_force;
+	properties.correspondences_ratio = correspondences_ratio;
+	properties.ICP_pyramid_levels = ICP_pyramid_levels;
+	properties.ICP_pyramid_leaf = ICP_pyramid_leaf;
+	properties.ICP_pyramid_coarse_iterations = ICP_pyramid_coarse_iterations;
+	properties.ICP_pyramid_fine_iterations = ICP_pyramid_fine_iterations;
+	properties.ICP_min_correspondence_distance = ICP_min_correspondence_distance;
+	properties.ICP_color_weight = ICP_color_weight;
+	properties.ICP_threads = ICP_threads;
+
 	// Number of viewpoints.
 	counter = 0;
 	// Mean number of features per view.
 	mean_viewpoint_features_number = 0;
 
 	global_trans = Eigen::Matrix4f::Identity();
-
-	cloud_merged = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
+	recent_views.clear();
+
+	if (merge_leaf_size > 0) {
+		// Views are accumulated in voxels, cloud_merged holds their means.
+		voxel_merged.setLeafSize(merge_leaf_size);
+		cloud_merged = voxel_merged.getCloud();
+	} else
+		cloud_merged = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
 	cloud_sift_merged = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>());
+	merged_generation = 0;
+	merged_index.setParams(MergeUtils::searchParams(properties));
+	merged_index.reset(*cloud_sift_merged, merged_generation);
 	cloud_normal_merged = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
 	return true;
 }
@@ -130,6 +188,22 @@ bool OpenCloudMerge::onStart() {
 	return true;
 }
 
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr OpenCloudMerge::icpTarget(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud) {
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr target = cloud_merged;
+	if (ICP_submap_views > 0 && !recent_views.empty()) {
+		target = pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>());
+		for (size_t i = 0; i < recent_views.size(); ++i)
+			*target += *recent_views[i];
+	}
+	if (ICP_submap_crop)
+		target = MergeUtils::cropToBoundingBox(cloud, target, properties.ICP_max_correspondence_distance);
+	// Too small overlap - fall back to the whole model.
+	if (target->size() < 3)
+		target = cloud_merged;
+	CLOG(LDEBUG) << "ICP target: " << target->size() << " of " << cloud_merged->size() << " model points";
+	return target;
+}
+
 void OpenCloudMerge::addViewToModel(){
 
 		CLOG(LTRACE) << "OpenCloudMerged::addViewToModel";
@@ -159,8 +233,14 @@ void OpenCloudMerge::addViewToModel(){
 
 		// First cloud.
 		if (counter == 0 ){
-			*cloud_merged = *cloud;
+			if (merge_leaf_size > 0)
+				voxel_merged.addView(*cloud);
+			else
+				*cloud_merged = *cloud;
+			if (ICP_submap_views > 0)
+				recent_views.push_back(pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>(*cloud)));
 			*cloud_sift_merged = *cloud_sift;
+			merged_index.reset(*cloud_sift_merged, ++merged_generation);
 
 			counter++;
 			mean_viewpoint_features_number = cloud_sift->size();
@@ -177,7 +257,7 @@ void OpenCloudMerge::addViewToModel(){
 		total_viewpoint_features_number += cloud_sift->size();
 
 		pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-		MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, correspondences);
+		MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, merged_generation, merged_index, correspondences, properties);
 
 		// Compute multiplicity of features (designating how many multiplicity given feature appears in all views).
 		for(int i = 0; i< correspondences->size();i++){
@@ -211,20 +291,17 @@ void OpenCloudMerge::addViewToModel(){
 
 
 		// Delete points.
-		pcl::PointCloud<PointXYZSIFT>::iterator pt_iter = cloud_sift_merged->begin();
-		while(pt_iter!=cloud_sift_merged->end()){
-			if(pt_iter->multiplicity==-1){
-				pt_iter = cloud_sift_merged->erase(pt_iter);
-			} else {
-				++pt_iter;
-			}
-		}
+		std::vector<bool> removed(cloud_sift_merged->size());
+		for (size_t i = 0; i < cloud_sift_merged->size(); i++)
+			removed[i] = (cloud_sift_merged->points[i].multiplicity == -1);
+		merged_index.remove(removed, ++merged_generation);
+		MergeUtils::removePointsIf(*cloud_sift_merged, MergeUtils::RemovedFeature());
 
 		pcl::transformPointCloud(*cloud, *cloud, current_trans);
 		pcl::transformPointCloud(*cloud_sift, *cloud_sift, current_trans);
 
 	    if (prop_ICP_alignment) {
-	    	current_trans = MergeUtils::computeTransformationICP(cloud, cloud_merged, properties);
+	    	current_trans = MergeUtils::computeTransformationICP(cloud, icpTarget(cloud), properties);
 	    	CLOG(LINFO) << "ICP transformation refinement: " << current_trans;
 
 	    	// Refine the transformation.
@@ -233,7 +310,7 @@ void OpenCloudMerge::addViewToModel(){
 	    }
 	    if(prop_ICP_alignment_color)
 	    {
-	    	current_trans = MergeUtils::computeTransformationICPColor(cloud, cloud_merged, properties);
+	    	current_trans = MergeUtils::computeTransformationICPColor(cloud, icpTarget(cloud), properties);
 	    	CLOG(LINFO) << "ICP transformation refinement: " << current_trans;
 
 	    	// Refine the transformation.
@@ -243,8 +320,17 @@ void OpenCloudMerge::addViewToModel(){
 
 		// Add clouds.
 
-		*cloud_merged += *cloud;
+		if (merge_leaf_size > 0)
+			voxel_merged.addView(*cloud);
+		else
+			*cloud_merged += *cloud;
+		if (ICP_submap_views > 0) {
+			recent_views.push_back(pcl::PointCloud<pcl::PointXYZRGB>::Ptr (new pcl::PointCloud<pcl::PointXYZRGB>(*cloud)));
+			while (recent_views.size() > static_cast<size_t>(ICP_submap_views))
+				recent_views.pop_front();
+		}
 		*cloud_sift_merged += *cloud_sift;
+		merged_index.append(*cloud_sift, ++merged_generation);
 
 		CLOG(LINFO) << "model cloud->size(): "<<cloud_merged->size();
 		CLOG(LINFO) << "model cloud_sift->size(): "<<cloud_sift_merged->size();
@@ -307,6 +393,7 @@ void OpenCloudMerge::addViewToModelNormals() {
 		if (counter == 0 ){
 			*cloud_normal_merged = *cloud;
 			*cloud_sift_merged = *cloud_sift;
+			merged_index.reset(*cloud_sift_merged, ++merged_generation);
 
 			counter++;
 			mean_viewpoint_features_number = cloud_sift->size();
@@ -338,7 +425,7 @@ void OpenCloudMerge::addViewToModelNormals() {
 		// Find correspondences between feature clouds.
 		// Initialize parameters.
 		pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-		MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, correspondences);
+		MergeUtils::computeCorrespondences(cloud_sift, cloud_sift_merged, merged_generation, merged_index, correspondences, properties);
 
 
 	    // Compute transformation between clouds and SOMGenerator global transformation of cloud.
@@ -364,14 +451,11 @@ void OpenCloudMerge::addViewToModelNormals() {
 
 
 		// Delete points.
-		pcl::PointCloud<PointXYZSIFT>::iterator pt_iter = cloud_sift_merged->begin();
-		while(pt_iter!=cloud_sift_merged->end()){
-			if(pt_iter->multiplicity==-1){
-				pt_iter = cloud_sift_merged->erase(pt_iter);
-			} else {
-				++pt_iter;
-			}
-		}
+		std::vector<bool> removed(cloud_sift_merged->size());
+		for (size_t i = 0; i < cloud_sift_merged->size(); i++)
+			removed[i] = (cloud_sift_merged->points[i].multiplicity == -1);
+		merged_index.remove(removed, ++merged_generation);
+		MergeUtils::removePointsIf(*cloud_sift_merged, MergeUtils::RemovedFeature());
 
 		pcl::transformPointCloudWithNormals(*cloud, *cloud, current_trans);
 		pcl::transformPointCloud(*cloud_sift, *cloud_sift, current_trans);
@@ -379,8 +463,10 @@ void OpenCloudMerge::addViewToModelNormals() {
 
 	    if(prop_ICP_alignment_normal){
 
-	    	current_trans = MergeUtils::computeTransformationICPNormals(cloud, cloud_normal_merged, properties);
+	    	MergeUtils::ICPReport report;
+	    	current_trans = MergeUtils::computeTransformationICPNormals(cloud, cloud_normal_merged, properties, &report);
 	        CLOG(LINFO) << "ICP transformation refinement: " << std::endl << current_trans;
+	        CLOG(LINFO) << "ICP iterations: " << report.iterations << " fitness: " << report.fitness << " converged: " << report.converged;
 
 	        // Refine the transformation.
 			if (current_trans.isIdentity()){
@@ -415,6 +501,7 @@ void OpenCloudMerge::addViewToModelNormals() {
 
 		*cloud_normal_merged += *cloud;
 		*cloud_sift_merged += *cloud_sift;
+		merged_index.append(*cloud_sift, ++merged_generation);
 
 		CLOG(LINFO) << "model cloud->size(): "<<cloud_normal_merged->size();
 		CLOG(LINFO) << "model cloud_sift->size(): "<<cloud_sift_merged->size();
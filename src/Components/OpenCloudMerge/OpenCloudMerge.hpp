@@ -16,6 +16,7 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <Types/MergeUtils.hpp>
+#include <Types/VoxelHashCloud.hpp>
 #include <Types/PointXYZSIFT.hpp>
 #include <Types/SIFTObjectModel.hpp>
 #include <Types/SIFTObjectModelFactory.hpp>
@@ -27,6 +28,8 @@
 
 #include <opencv2/core/core.hpp>
 
+#include <deque>
+
 
 namespace Processors {
 namespace OpenCloudMerge {
@@ -111,6 +114,9 @@ protected:
 	void addViewToModel();
     void addViewToModelNormals();
 
+    /// Returns the ICP target for the (roughly aligned) view - the whole merged cloud or its part overlapping the view.
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr icpTarget(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud);
+
     MergeUtils::Properties properties;
 
     Base::Property<bool> prop_ICP_alignment;
@@ -123,6 +129,42 @@ protected:
     ///RanSAC Properties
     Base::Property<float> RanSAC_inliers_threshold;
     Base::Property<float> RanSAC_max_iterations;
+    /// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+    Base::Property<double> RanSAC_confidence;
+    /// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+    Base::Property<bool> RanSAC_guided;
+    /// Number of threads scoring SAC hypotheses (0 - one per core).
+    Base::Property<int> RanSAC_threads;
+
+    /// Descriptor search - number of randomized kd-trees and leaves checked per query (negative - exact search).
+    Base::Property<int> correspondences_trees;
+    Base::Property<int> correspondences_checks;
+
+    /// Clouds with at most this number of features are matched exhaustively (0 - never), with optional ratio test.
+    Base::Property<int> correspondences_brute_force;
+    Base::Property<float> correspondences_ratio;
+
+    /// Size of voxels of the merged XYZRGB cloud (0 - views are concatenated).
+    Base::Property<float> merge_leaf_size;
+
+    /// ICP submap: number of last views the view is aligned to (0 - the whole model) and cropping of the target to the view's bounding box.
+    Base::Property<int> ICP_submap_views;
+    Base::Property<bool> ICP_submap_crop;
+
+    /// Coarse-to-fine ICP: number of downsampled levels (0 - full resolution only), leaf size of the finest one, iterations at every level and at full resolution.
+    Base::Property<int> ICP_pyramid_levels;
+    Base::Property<float> ICP_pyramid_leaf;
+    Base::Property<int> ICP_pyramid_coarse_iterations;
+    Base::Property<int> ICP_pyramid_fine_iterations;
+
+    /// Point-to-plane ICP: correspondence distance at which the annealing stops.
+    Base::Property<float> ICP_min_correspondence_distance;
+
+    /// Colour ICP: weight of the Lab colour difference in the correspondence search (metres per Lab unit).
+    Base::Property<float> ICP_color_weight;
+
+    /// Colour ICP: number of threads searching the correspondences (1 - sequential, 0 - one per core).
+    Base::Property<int> ICP_threads;
 
 	/// Number of views.
 	int counter;
@@ -134,6 +176,18 @@ protected:
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_merged;
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_normal_merged;
 	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_sift_merged;
+
+	/// Descriptor index following cloud_sift_merged, updated with every added view.
+	IncrementalDescriptorIndex merged_index;
+
+	/// Generation of cloud_sift_merged - incremented whenever its features change.
+	unsigned long merged_generation;
+
+	/// Voxel accumulation backing cloud_merged (used if merge_leaf_size > 0).
+	VoxelHashCloud voxel_merged;
+
+	/// Last ICP_submap_views views (in the model frame).
+	std::deque<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> recent_views;
 	Eigen::Matrix4f global_trans;
 };
 
@@ -11,9 +11,14 @@
 #include "Common/Logger.hpp"
 
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 
 //#include <fstream>
 #include <pcl/point_representation.h>
+#include <Types/SIFTFeatureRepresentation.hpp>
+#include <Types/MergeUtils.hpp>
 
 #include "pcl/impl/instantiate.hpp"
 #include "pcl/search/kdtree.h" 
@@ -24,30 +29,20 @@
 namespace Processors {
 namespace SIFTAdder {
 
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-	public:
-	SIFTFeatureRepresentation ()
-	{
-		// Define the number of dimensions
-		nr_dimensions_ = 128 ;
-		trivial_ = false ;
-	}
-
-	// Override the copyToFloatArray method to define our feature vector
-	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-	{
-		//This representation is only for determining correspondences (not for use in Kd-tree for example - so use only SIFT part of the point	
-		for (register int i = 0; i < 128 ; i++)
-			out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-		//std::cout << "SIFTFeatureRepresentation:copyToFloatArray()" << std::endl ;
-	}
-};
-
 SIFTAdder::SIFTAdder(const std::string & name) :
-		Base::Component(name)  {
-
+		Base::Component(name),
+		merge_tree("merge_tree", false),
+		threads("threads", 1),
+		RanSAC_inliers_threshold("RanSac.Inliers_threshold", 0.001f),
+		RanSAC_max_iterations("RanSac.Iterations", 2000),
+		RanSAC_confidence("RanSac.Confidence", 0.99),
+		RanSAC_guided("RanSac.Guided", true)  {
+	registerProperty(merge_tree);
+	registerProperty(threads);
+	registerProperty(RanSAC_inliers_threshold);
+	registerProperty(RanSAC_max_iterations);
+	registerProperty(RanSAC_confidence);
+	registerProperty(RanSAC_guided);
 }
 
 SIFTAdder::~SIFTAdder() {
@@ -70,6 +65,12 @@ void SIFTAdder::prepareInterface() {
 
 bool SIFTAdder::onInit() {
 	cloud = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>());
+	properties.RanSAC_inliers_threshold = RanSAC_inliers_threshold;
+	properties.RanSAC_max_iterations = RanSAC_max_iterations;
+	properties.RanSAC_confidence = RanSAC_confidence;
+	properties.RanSAC_guided = RanSAC_guided;
+	// Merges run in parallel workers - hypotheses are scored by the calling thread.
+	properties.RanSAC_threads = 1;
 	return true;
 }
 
@@ -91,119 +92,153 @@ bool SIFTAdder::onStart() {
 	return true;
 }
 
+void SIFTAdder::merge(PartialCloud & target, PartialCloud & source) {
+	if (target.cloud->empty()) {
+		target.cloud = source.cloud;
+		target.multiplicities.insert(target.multiplicities.end(), source.multiplicities.begin(), source.multiplicities.end());
+		return;
+	}
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = target.cloud;
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_next = source.cloud;
+
+	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
+	MergeUtils::computeCorrespondences(cloud_next, cloud, correspondences);
+
+	if ( correspondences -> size() > 4 ) {
+		//ransac znalezienie blednych dopasowan
+		pcl::Correspondences inliers ;
+		MergeUtils::computeTransformationSAC(cloud_next, cloud, correspondences, inliers, properties);
+
+		//usuniecie blednych dopasowan - bitmap of inlier queries, single pass over correspondences
+		std::vector<bool> inlier_query(cloud_next->size(), false);
+		for (size_t i = 0; i < inliers.size(); ++i)
+			if (inliers[i].index_query >= 0 && inliers[i].index_query < static_cast<int>(inlier_query.size()))
+				inlier_query[inliers[i].index_query] = true;
+		size_t kept = 0;
+		for (size_t i = 0; i < correspondences->size(); ++i) {
+			int query = correspondences->at(i).index_query;
+			if (query >= 0 && query < static_cast<int>(inlier_query.size()) && inlier_query[query])
+				continue;
+			correspondences->at(kept++) = correspondences->at(i);
+		}
+		correspondences->resize(kept);
+	}
+
+	//zliczanie krotnosci - matched features are moved to the points of the target
+	std::vector<int> new_index(cloud_next->size(), -1);
+	std::vector<bool> matched(cloud_next->size(), false);
+	for(int i = 0; i< correspondences->size();i++){
+		if (correspondences->at(i).index_query >=cloud_next->size() ||
+		        correspondences->at(i).index_match >=cloud->size()){
+			continue;
+		}
+		int query = correspondences->at(i).index_query;
+		cloud->at(correspondences->at(i).index_match).multiplicity += cloud_next->at(query).multiplicity;
+		new_index[query] = correspondences->at(i).index_match;
+		matched[query] = true;
+	}
+
+	//dodanie pozostalych punktow
+	size_t appended = 0;
+	for (size_t k = 0; k < cloud_next->size(); ++k) {
+		if (matched[k])
+			continue;
+		new_index[k] = cloud->size() + appended++;
+	}
+	cloud->points.reserve(cloud->size() + appended);
+	for (size_t k = 0; k < cloud_next->size(); ++k)
+		if (!matched[k])
+			cloud->points.push_back(cloud_next->points[k]);
+	cloud->width = cloud->points.size();
+	cloud->height = 1;
+
+	for (size_t m = 0; m < source.multiplicities.size(); ++m) {
+		std::map<int,int> modelMultiplicity;
+		for (std::map<int,int>::const_iterator it = source.multiplicities[m].begin(); it != source.multiplicities[m].end(); ++it)
+			if (it->first >= 0 && it->first < static_cast<int>(new_index.size()))
+				modelMultiplicity.insert(std::make_pair(new_index[it->first], it->second));
+		target.multiplicities.push_back(modelMultiplicity);
+	}
+}
+
+void SIFTAdder::mergeWorker(std::vector<PartialCloud> * partials, size_t pairs) {
+	// Called from worker threads - must not log nor touch component state other than the given partial clouds and the (read-only) SAC properties.
+	for (;;) {
+		size_t i;
+		{
+			boost::mutex::scoped_lock lock(next_pair_mutex);
+			if (next_pair >= pairs)
+				return;
+			i = next_pair++;
+		}
+		merge((*partials)[2 * i], (*partials)[2 * i + 1]);
+	}
+}
+
 void SIFTAdder::add() {
 	LOG(LDEBUG) << "================= SIFTAdder: adding models to joint cloud =================";
 
 	models = in_models.read();
-    std::vector <std::map<int,int> > modelsMultiplicity;
 	LOG(LDEBUG) << "Number of models: " << models.size();
-	for (unsigned n=0; n<models.size(); ++n) {
 
+	// Every model (and the joint cloud of previous calls) starts as a separate partial cloud.
+	std::vector<PartialCloud> partials;
+	if (!cloud->empty()) {
+		PartialCloud joint;
+		joint.cloud = cloud;
+		partials.push_back(joint);
+	}
+	for (unsigned n=0; n<models.size(); ++n) {
+		PartialCloud partial;
+		partial.cloud = pcl::PointCloud<PointXYZSIFT>::Ptr (new pcl::PointCloud<PointXYZSIFT>(*dynamic_cast<SIFTObjectModel*>(models.at(n))->cloud_xyzsift));
+		LOG(LDEBUG) << "Model no " << n << ": model's cloud size = " << partial.cloud->size();
 		std::map<int,int> modelMultiplicity;
-		pcl::PointCloud<PointXYZSIFT>::Ptr cloud_next = dynamic_cast<SIFTObjectModel*>(models.at(n))->cloud_xyzsift;
-        LOG(LDEBUG) << "Model no " << n << ": model's cloud size = " << cloud_next->size();
-
-		if (cloud->empty()){
-            LOG(LDEBUG) << "Writing new cloud to empty joint cloud. Size: " << cloud_next->size();
-			cloud = cloud_next;
-			out_cloud.write(cloud);
-			for (unsigned k=0; k<cloud_next->size(); ++k) {
-				std::pair<int,int> nextMultiplicity = std::make_pair<int,int>(k, cloud_next->at(k).multiplicity);
-				modelMultiplicity.insert(nextMultiplicity);
-			}
-			LOG(LDEBUG) << "number of model's features: " << modelMultiplicity.size();
-			modelsMultiplicity.push_back(modelMultiplicity);
-			continue;
-		}
-        
-        LOG(LDEBUG) << "Joint cloud size before merge: " << cloud->size();
-
-		pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-		pcl::registration::CorrespondenceEstimation<PointXYZSIFT, PointXYZSIFT> correst ;
-
-		//SIFTFeatureRepresentation point_representation ;
-		//correst.setPointRepresentation (point_representation.makeShared()); //NEVER do like this, makeShared will return DefaultFeatureRepresentation<PointDefault>!
-		SIFTFeatureRepresentation::Ptr point_representation(new SIFTFeatureRepresentation()) ;
-		correst.setPointRepresentation(point_representation) ;
-		correst.setInputSource(cloud_next) ;
-		correst.setInputTarget(cloud) ;
-		correst.determineReciprocalCorrespondences(*correspondences) ;
-        
-        LOG(LDEBUG) << "Correspondences determined " << correspondences -> size();
-	
-        if ( correspondences -> size() > 4 ) {
-			//ransac znalezienie blednych dopasowan
-			pcl::Correspondences inliers ;
-			pcl::registration::CorrespondenceRejectorSampleConsensus<PointXYZSIFT> sac ;
-			sac.setInputSource(cloud_next) ;
-			sac.setInputTarget(cloud) ;
-			sac.setInlierThreshold(0.001f) ;
-			sac.setMaximumIterations(2000) ;
-			sac.setInputCorrespondences(correspondences) ;
-			sac.getCorrespondences(inliers);
-
-			LOG(LDEBUG) << "Wrong matches found";
-
-			//usuniecie blednych dopasowan
-			pcl::Correspondences::iterator iter_inliers = inliers.begin();
-			while(iter_inliers!=inliers.end()){
-				pcl::Correspondences::iterator iter_correspondences = correspondences->begin();
-				while(iter_correspondences!=correspondences->end()){
-					if(iter_correspondences->index_query == iter_inliers->index_query){
-						iter_correspondences= correspondences->erase(iter_correspondences);
-						break;
-					}
-					else 
-						++iter_correspondences;
-				}
-				++iter_inliers;	
-			}
-        }
-		
-		LOG(LINFO) << "Number of reciprocal correspondences: " << correspondences->size() << " out of " << cloud_next->size() << " keypoints";// << std::endl ;
-
-		//zliczanie krotnosci
-		for(int i = 0; i< correspondences->size();i++){	
-			if (correspondences->at(i).index_query >=cloud_next->size() ||
-			        correspondences->at(i).index_match >=cloud->size()){
-				continue;
-			}
-			cloud->at(correspondences->at(i).index_match).multiplicity += cloud_next->at(correspondences->at(i).index_query).multiplicity;
-			modelMultiplicity.insert(std::make_pair<int,int>(correspondences->at(i).index_match, cloud_next->at(correspondences->at(i).index_query).multiplicity));
-			cloud_next->at(correspondences->at(i).index_query).multiplicity=-1; //do usuniecia punkt w nowej chmurze, ktory juz jest zarejestrowany w polaczonej chmurze
-		}
+		for (unsigned k=0; k<partial.cloud->size(); ++k)
+			modelMultiplicity.insert(std::make_pair(static_cast<int>(k), partial.cloud->at(k).multiplicity));
+		partial.multiplicities.push_back(modelMultiplicity);
+		partials.push_back(partial);
+	}
+	if (partials.empty()) {
+		out_cloud.write(cloud);
+		out_multiplicityOfModels.write(std::vector <std::map<int,int> >());
+		return;
+	}
 
-		//usuniecie punktow
-		pcl::PointCloud<PointXYZSIFT>::iterator pt_iter = cloud_next->begin();
-		while(pt_iter!=cloud_next->end()){
-			if(pt_iter->multiplicity==-1){
-				pt_iter = cloud_next->erase(pt_iter);
-			}
-			else{
-				++pt_iter;	
+	if (merge_tree) {
+		int workers = threads;
+		if (workers <= 0)
+			workers = std::max(1u, boost::thread::hardware_concurrency());
+		// Each round merges disjoint pairs of neighbours, so the model order is kept and pairs are independent.
+		while (partials.size() > 1) {
+			size_t pairs = partials.size() / 2;
+			next_pair = 0;
+			if (workers > 1 && pairs > 1) {
+				boost::thread_group pool;
+				for (int t = 0; t < std::min<int>(workers, pairs); ++t)
+					pool.create_thread(boost::bind(&SIFTAdder::mergeWorker, this, &partials, pairs));
+				pool.join_all();
+			} else {
+				mergeWorker(&partials, pairs);
 			}
-		} 
-
-		LOG(LDEBUG) << "Reduced next cloud size: " << cloud_next->size();
-        if (cloud_next->empty()) {
-			LOG(LDEBUG) << "number of model's features: " << modelMultiplicity.size();
-            modelsMultiplicity.push_back(modelMultiplicity);
-			continue;
-        }
-		for (unsigned k=0; k<cloud_next->size(); ++k) {
-			std::pair<int,int> nextMultiplicity = std::make_pair<int,int>(cloud->size()+k, cloud_next->at(k).multiplicity);
-			modelMultiplicity.insert(nextMultiplicity);
+			std::vector<PartialCloud> merged;
+			merged.reserve(pairs + 1);
+			for (size_t i = 0; i < partials.size(); i += 2)
+				merged.push_back(partials[i]);
+			partials.swap(merged);
+			LOG(LDEBUG) << "Merge round done, partial clouds left: " << partials.size();
+		}
+	} else {
+		for (size_t n = 1; n < partials.size(); ++n) {
+			merge(partials[0], partials[n]);
+			LOG(LDEBUG) << "New joint cloud size: " << partials[0].cloud->size();
 		}
-
-		*cloud = *cloud + *cloud_next;
-        LOG(LDEBUG) << "New joint cloud size: " << cloud->size();
-		LOG(LDEBUG) << "number of model's features: " << modelMultiplicity.size();
-        modelsMultiplicity.push_back(modelMultiplicity);
-//		modelMultiplicity.clear();
 	}
-    LOG(LDEBUG) << "Added all models to joint cloud. Joint cloud size: " << cloud->size();
+
+	cloud = partials[0].cloud;
+	std::vector <std::map<int,int> > & modelsMultiplicity = partials[0].multiplicities;
+	LOG(LDEBUG) << "Added all models to joint cloud. Joint cloud size: " << cloud->size();
 	out_cloud.write(cloud);
-    LOG(LDEBUG) << "Writing multiplicity vectors of models merged to cloud. Number of vectors: " << modelsMultiplicity.size();
+	LOG(LDEBUG) << "Writing multiplicity vectors of models merged to cloud. Number of vectors: " << modelsMultiplicity.size();
 	out_multiplicityOfModels.write(modelsMultiplicity);
 }
 
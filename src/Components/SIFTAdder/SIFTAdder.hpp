@@ -14,9 +14,13 @@
 #include "EventHandler2.hpp"
 
 #include <opencv2/opencv.hpp>
+#include <map>
 #include <vector>
+
+#include <boost/thread/mutex.hpp>
 #include <Types/PointXYZSIFT.hpp> 
 #include <Types/SIFTObjectModel.hpp>
+#include <Types/MergeUtils.hpp>
 //#include "Types/Features.hpp"
 
 namespace Processors {
@@ -88,6 +92,41 @@ protected:
 	
 	// Handlers
 	void add();
+
+	/// Joint cloud of a group of merged models.
+	struct PartialCloud {
+		pcl::PointCloud<PointXYZSIFT>::Ptr cloud;
+
+		/// Multiplicity maps of the merged models (point of the cloud -> multiplicity of the model feature), in model order.
+		std::vector<std::map<int,int> > multiplicities;
+	};
+
+	/// Merges source into target - matched features are counted in the target, the others are appended to it.
+	void merge(PartialCloud & target, PartialCloud & source);
+
+	/// Worker thread - merges pairs of partial clouds (2i <- 2i+1) taken from the shared counter until all are done.
+	void mergeWorker(std::vector<PartialCloud> * partials, size_t pairs);
+
+	/// Next pair to be merged by the workers.
+	size_t next_pair;
+	boost::mutex next_pair_mutex;
+
+	/// Merge models as a tree of pairwise merges (in parallel) instead of adding them one by one to the joint cloud.
+	Base::Property<bool> merge_tree;
+
+	/// Number of threads merging pairs of clouds (0 - one per core).
+	Base::Property<int> threads;
+
+	/// SAC verifying the correspondences of merged clouds.
+	Base::Property<float> RanSAC_inliers_threshold;
+	Base::Property<float> RanSAC_max_iterations;
+	/// Probability of an all-inlier sample at which SAC stops before RanSac.Iterations.
+	Base::Property<double> RanSAC_confidence;
+	/// PROSAC: hypotheses are sampled from the correspondences with the smallest descriptor distances first (false - uniformly).
+	Base::Property<bool> RanSAC_guided;
+
+	/// SAC settings set in onInit(), only read by the merges.
+	MergeUtils::Properties properties;
 	
 	pcl::PointCloud<PointXYZSIFT>::Ptr cloud;
 //    std::vector <pcl::PointCloud<PointXYZSIFT>::Ptr> models;
@@ -7,6 +7,7 @@
 #include <memory>
 #include <string>
 #include <iomanip>
+#include <algorithm>
 
 #include "SIFTObjectMatcher.hpp"
 #include "Common/Logger.hpp"
@@ -16,12 +17,15 @@
 #include <pcl/search/kdtree.h> 
 #include <pcl/search/impl/kdtree.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include "Types/Features.hpp"
+#include <Types/SIFTFeatureRepresentation.hpp>
+#include <Types/DescriptorDistance.hpp>
 #include <pcl/recognition/cg/hough_3d.h>
 
 //
@@ -43,43 +47,48 @@
 namespace Processors {
 namespace SIFTObjectMatcher {
 
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation<PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-    using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-    public:
-    SIFTFeatureRepresentation ()
-    {
-        // Define the number of dimensions
-        nr_dimensions_ = 128 ;
-        trivial_ = false ;
-    }
-
-    // Override the copyToFloatArray method to define our feature vector
-    virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-    {
-        //This representation is only for determining correspondences (not for use in Kd-tree for example - so use only SIFT part of the point
-        for (register int i = 0; i < 128 ; i++)
-            out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-        //std::cout << "SIFTFeatureRepresentation:copyToFloatArray()" << std::endl ;
-    }
-};
-
 SIFTObjectMatcher::SIFTObjectMatcher(const std::string & name) :
 		Base::Component(name),
 		threshold("threshold", 0.75f),
         inlier_threshold("inlier_threshold", 0.001f),
-        //max_distance("max_distance", 150),
+        max_distance("max_distance", 0),
+        use_ratio_test("use_ratio_test", true),
         cg_size("cg_size", 0.01f),
         cg_thresh("cg_thresh", 5.0f),
         use_hough3d("use_hough3d", false),
-        model_out("model_out", 0){
+        use_joint_index("use_joint_index", true),
+        joint_knn("joint_knn", 5),
+        model_out("model_out", 0),
+        threads("threads", 1),
+        search_trees("search_trees", 4),
+        search_checks("search_checks", -1),
+        search_report("search_report", false),
+        compact_descriptors("compact_descriptors", false),
+        use_pq_index("use_pq_index", false),
+        pq_codebook("pq_codebook", std::string("")),
+        pq_lists("pq_lists", 256),
+        pq_probes("pq_probes", 8),
+        pq_rerank("pq_rerank", 64){
 			registerProperty(threshold);
 			registerProperty(inlier_threshold);
-            //registerProperty(max_distance);
+            registerProperty(max_distance);
+            registerProperty(use_ratio_test);
             registerProperty(cg_size);
             registerProperty(cg_thresh);
             registerProperty(use_hough3d);
+            registerProperty(use_joint_index);
+            registerProperty(joint_knn);
             registerProperty(model_out);
+            registerProperty(threads);
+            registerProperty(search_trees);
+            registerProperty(search_checks);
+            registerProperty(search_report);
+            registerProperty(compact_descriptors);
+            registerProperty(use_pq_index);
+            registerProperty(pq_codebook);
+            registerProperty(pq_lists);
+            registerProperty(pq_probes);
+            registerProperty(pq_rerank);
 }
 
 SIFTObjectMatcher::~SIFTObjectMatcher() {
@@ -112,6 +121,8 @@ void SIFTObjectMatcher::prepareInterface() {
 }
 
 bool SIFTObjectMatcher::onInit() {
+	CLOG(LINFO) << "Descriptor distance kernels: " << DescriptorDistance::backendName();
+	pq_training_failed = false;
 
 	return true;
 }
@@ -130,6 +141,11 @@ bool SIFTObjectMatcher::onStart() {
 
 void SIFTObjectMatcher::readModels() {
     CLOG(LTRACE) << "readModels()" << endl;
+	// Trees refer to model clouds - drop them before the models.
+	model_trees.clear();
+	joint_index.clear();
+	pq_index.clear();
+	pq_training_failed = false;
 	for( int i = 0 ; i<models.size(); i++){
 		delete models[i];
 	}
@@ -144,6 +160,157 @@ void SIFTObjectMatcher::readModels() {
             CLOG(LTRACE) << "niepoprawny model" << endl;
 	}
     CLOG(LTRACE) << models.size() << " models" << endl;
+	if (use_pq_index)
+		buildPQIndex();
+	else if (use_joint_index)
+		buildJointIndex();
+	else
+		buildModelTrees();
+}
+
+DescriptorIndex::Params SIFTObjectMatcher::searchParams() {
+	DescriptorIndex::Params params;
+	params.trees = search_trees;
+	params.checks = search_checks;
+	params.encoding = compact_descriptors ? DescriptorIndex::UINT8 : DescriptorIndex::FLOAT32;
+	return params;
+}
+
+void SIFTObjectMatcher::buildModelTrees() {
+	model_trees.clear();
+	model_trees.reserve(models.size());
+	for (size_t i = 0; i < models.size(); i++) {
+		DescriptorIndex::Ptr tree(new DescriptorIndex(searchParams()));
+		tree->addCloud(models[i]->cloud_xyzsift, i);
+		tree->build();
+		if (tree->empty())
+			CLOG(LWARNING) << "Model " << models[i]->name << " has no features";
+		model_trees.push_back(tree);
+	}
+	CLOG(LDEBUG) << "Built descriptor trees for " << model_trees.size() << " models";
+}
+
+void SIFTObjectMatcher::buildJointIndex() {
+	joint_index.clear();
+	joint_index.setParams(searchParams());
+	for (size_t i = 0; i < models.size(); i++)
+		joint_index.addCloud(models[i]->cloud_xyzsift, i);
+	joint_index.build();
+	// Second neighbours of models appearing once among the neighbours of a query are searched within the model.
+	joint_index.buildCloudIndices();
+	CLOG(LDEBUG) << "Built joint descriptor index: " << joint_index.size() << " features of " << models.size() << " models, "
+			<< joint_index.descriptorBytes() / 1024 << " kB of descriptors";
+}
+
+std::string SIFTObjectMatcher::codebookFilename() {
+	std::string filename = pq_codebook;
+	if (!filename.empty())
+		return filename;
+	// By default next to the model files.
+	for (size_t i = 0; i < models.size(); i++) {
+		if (models[i]->filename.empty())
+			continue;
+		std::string::size_type slash = models[i]->filename.find_last_of('/');
+		return (slash == std::string::npos ? std::string() : models[i]->filename.substr(0, slash + 1)) + "pq_codebooks.bin";
+	}
+	return std::string();
+}
+
+void SIFTObjectMatcher::buildPQIndex() {
+	// PQ index re-ranks with the model clouds, the other indices are not needed.
+	model_trees.clear();
+	joint_index.clear();
+
+	IVFPQIndex::Params params = pq_index.getParams();
+	params.lists = pq_lists;
+	params.probes = pq_probes;
+	params.rerank = pq_rerank;
+	pq_index.setParams(params);
+
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+	for (size_t i = 0; i < models.size(); i++)
+		clouds.push_back(models[i]->cloud_xyzsift);
+	// Codebooks are kept while the library is the same, otherwise loaded (if trained on this library) or trained.
+	boost::uint64_t fingerprint = IVFPQIndex::fingerprint(clouds);
+	if (!pq_index.trained() || pq_index.trainingFingerprint() != fingerprint) {
+		std::string filename = codebookFilename();
+		if (!filename.empty() && pq_index.load(filename, fingerprint)) {
+			CLOG(LINFO) << "Loaded PQ codebooks from " << filename;
+		} else {
+			if (!pq_index.train(clouds)) {
+				// Not retried for every scene - only when models are read again.
+				CLOG(LERROR) << "Training of PQ codebooks failed";
+				pq_training_failed = true;
+				return;
+			}
+			CLOG(LINFO) << "Trained PQ codebooks on " << models.size() << " models";
+			if (!filename.empty()) {
+				if (pq_index.save(filename))
+					CLOG(LINFO) << "Saved PQ codebooks to " << filename;
+				else
+					CLOG(LWARNING) << "Cannot save PQ codebooks to " << filename;
+			}
+		}
+	}
+
+	pq_index.clear();
+	for (size_t i = 0; i < models.size(); i++)
+		pq_index.addCloud(models[i]->cloud_xyzsift, i);
+	CLOG(LDEBUG) << "Built PQ index: " << pq_index.size() << " features of " << models.size() << " models, "
+			<< pq_index.codeBytes() / 1024 << " kB of codes";
+}
+
+ModelMatcher::Params SIFTObjectMatcher::matcherParams() {
+	ModelMatcher::Params params;
+	params.max_distance = max_distance;
+	params.use_ratio_test = use_ratio_test;
+	params.ratio = threshold;
+	params.joint_knn = joint_knn;
+	return params;
+}
+
+void SIFTObjectMatcher::reportSearch(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud_xyzsift) {
+	// PQ index re-ranks with exact distances, its recall is governed by pq_probes and pq_rerank.
+	if (use_pq_index)
+		return;
+
+	// Sample of (at most 100) finite scene descriptors, spread over the whole cloud.
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	size_t step = std::max<size_t>(1, cloud_xyzsift->size() / 100);
+	std::vector<float> queries;
+	for (size_t j = 0; j < cloud_xyzsift->size(); j += step) {
+		if (pcl_isfinite (cloud_xyzsift->at (j).descriptor[0]))
+			queries.insert(queries.end(), cloud_xyzsift->at (j).descriptor, cloud_xyzsift->at (j).descriptor + dim);
+	}
+	if (queries.empty())
+		return;
+
+	int k = use_joint_index ? ModelMatcher(matcherParams()).jointNeighbours(joint_index.size()) : (use_ratio_test ? 2 : 1);
+	std::vector<const DescriptorIndex *> indices;
+	if (use_joint_index)
+		indices.push_back(&joint_index);
+	else
+		for (size_t i = 0; i < model_trees.size(); i++)
+			indices.push_back(model_trees[i].get());
+	for (size_t i = 0; i < indices.size(); i++) {
+		DescriptorIndex::SearchReport report = indices[i]->evaluate(&queries[0], queries.size() / dim, k);
+		if (report.queries == 0)
+			continue;
+		CLOG(LINFO) << "Search " << (use_joint_index ? std::string("joint index") : models[i]->name)
+				<< " (trees: " << searchParams().trees << ", checks: " << searchParams().checks << "): recall@" << k << " "
+				<< report.recall << ", " << report.search_ms << " ms/query vs exact " << report.exact_ms << " ms/query";
+	}
+}
+
+template <typename Index>
+void SIFTObjectMatcher::findJointCorrespondences(const Index & index, const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud_xyzsift, std::vector<ModelRecognition> & results) {
+	std::vector<pcl::Correspondences> correspondences(models.size());
+	std::vector<size_t> candidates(models.size(), 0);
+	ModelMatcher(matcherParams()).matchJoint(index, *cloud_xyzsift, models.size(), correspondences, candidates);
+	for (size_t i = 0; i < models.size(); i++) {
+		results[i].correspondences->swap(correspondences[i]);
+		results[i].candidates = candidates[i];
+	}
 }
 
 void SIFTObjectMatcher::match() {
@@ -172,81 +339,112 @@ void SIFTObjectMatcher::match() {
 
         //pcl::registration::CorrespondenceEstimation<PointXYZSIFT, PointXYZSIFT> correst ;
 
-        SIFTFeatureRepresentation::Ptr point_representation(new SIFTFeatureRepresentation()) ;
-        //correst.setPointRepresentation(point_representation) ;
+        // Indices are built in readModels() and reused until the models change.
+        std::vector<ModelRecognition> results(models.size());
+        for (size_t i = 0; i < models.size(); i++) {
+            results[i].correspondences = pcl::CorrespondencesPtr(new pcl::Correspondences());
+            results[i].candidates = 0;
+        }
+        if (use_pq_index) {
+            if (pq_index.empty() && !pq_training_failed)
+                buildPQIndex();
+            findJointCorrespondences(pq_index, cloud_xyzsift, results);
+        } else if (use_joint_index) {
+            if (joint_index.size() == 0)
+                buildJointIndex();
+            findJointCorrespondences(joint_index, cloud_xyzsift, results);
+        } else {
+            if (model_trees.size() != models.size())
+                buildModelTrees();
+        }
+
+        if (search_report)
+            reportSearch(cloud_xyzsift);
+
+        // Models are independent - recognize them in parallel.
+        int workers = threads;
+        if (workers <= 0)
+            workers = std::max(1u, boost::thread::hardware_concurrency());
+        workers = std::min<int>(workers, models.size());
+        if (workers > 1) {
+            next_model = 0;
+            boost::thread_group pool;
+            for (int t = 0; t < workers; ++t)
+                pool.create_thread(boost::bind(&SIFTObjectMatcher::recognitionWorker, this, cloud_xyzsift, &results));
+            pool.join_all();
+        } else {
+            for (size_t i = 0; i < models.size(); i++)
+                recognizeModel(cloud_xyzsift, i, results[i]);
+        }
+
+        // Report and write results in model order, so they do not depend on the number of workers.
+        CLOG(LTRACE) << (use_hough3d ? "Using Hough3DGrouping" : "Using GeometricConsistencyGrouping") << ", workers: " << workers;
         for (int i = 0 ; i<models.size(); i++){
+            const pcl::CorrespondencesPtr & correspondences = results[i].correspondences;
+            const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > & rototranslations = results[i].rototranslations;
+            const std::vector<pcl::Correspondences> & clustered_corrs = results[i].clustered_corrs;
 
-            pcl::CorrespondencesPtr correspondences(new pcl::Correspondences()) ;
-
-            pcl::KdTreeFLANN<PointXYZSIFT> match_search;
-            match_search.setPointRepresentation(point_representation);
-            match_search.setInputCloud (models[i]->cloud_xyzsift);
-
-            //  For each scene keypoint descriptor, find nearest neighbor into the model keypoints descriptor cloud and add it to the correspondences vector.
-            for (size_t j = 0; j < cloud_xyzsift->size (); ++j)
-            {
-              std::vector<int> neigh_indices (1);
-              std::vector<float> neigh_sqr_dists (1);
-              if (!pcl_isfinite (cloud_xyzsift->at (j).descriptor[0])) //skipping NaNs
-              {
-                continue;
-              }
-              int found_neighs = match_search.nearestKSearch (cloud_xyzsift->at (j), 1, neigh_indices, neigh_sqr_dists);
-              if(found_neighs == 1)// && neigh_sqr_dists[0] < max_distance) //  add match only if the squared descriptor distance is less than 0.25 (SHOT descriptor distances are between 0 and 1 by design)
-              {
-                pcl::Correspondence corr (neigh_indices[0], static_cast<int> (j), neigh_sqr_dists[0]);
-//                pcl::Correspondence corr2 (static_cast<int> (j), neigh_indices[0], neigh_sqr_dists[0]);
-                correspondences->push_back (corr);
-              }
+            CLOG(LINFO) << "Correspondences found: " << correspondences->size () << " (of " << results[i].candidates << " before filtering)" << std::endl;
+            if(correspondences->empty()){
+                CLOG(LINFO) << "No correspondences with model " << models[i]->name;
+            }
+            else {
+                CLOG(LINFO) << "Model instances found: " << rototranslations.size () << std::endl;
+                for (size_t k = 0; k < rototranslations.size (); ++k){
+                      Eigen::Matrix3f rotation = rototranslations[k].block<3,3>(0, 0);
+                      Eigen::Vector3f translation = rototranslations[k].block<3,1>(0, 3);
+                      if(rotation != Eigen::Matrix3f::Identity()){
+                          CLOG(LINFO) << "\n    Instance " << k + 1 << ":";
+                          CLOG(LINFO) << "        Correspondences belonging to this instance: " << clustered_corrs[k].size () ;
+                          //Print the rotation matrix and translation vector
+                          CLOG(LINFO) << "            | "<< rotation (0,0)<<" "<< rotation (0,1)<< " "<<rotation (0,2)<<" | ";
+                          CLOG(LINFO) << "        R = | "<< rotation (1,0)<<" "<< rotation (1,1)<< " "<<rotation (1,2)<<" | ";
+                          CLOG(LINFO) << "            | "<< rotation (2,0)<<" "<< rotation (2,1)<< " "<<rotation (2,2)<<" | ";
+                          CLOG(LINFO) << "        t = < "<< translation (0)<<" "<< translation (1)<< " "<< translation (2)<<" > ";
+                      }
+                }
+            }
+            //Write only choosen model
+            if(i==model_out_){
+                out_cloud_xyzrgb.write(cloud_xyzrgb);
+                out_cloud_xyzrgb_model.write(models[i]->cloud_xyzrgb);
+                out_cloud_xyzsift.write(cloud_xyzsift);
+                out_cloud_xyzsift_model.write(models[i]->cloud_xyzsift);
+                out_correspondences.write(correspondences);//wszystkie dopasowania
+                //        out_good_correspondences.write(inliers);
+                out_clustered_correspondences.write(clustered_corrs);
+                out_rototranslations.write(rototranslations);
             }
+        }
+}
+
+void SIFTObjectMatcher::recognitionWorker(const pcl::PointCloud<PointXYZSIFT>::Ptr & cloud_xyzsift, std::vector<ModelRecognition> * results) {
+	for (;;) {
+		size_t i;
+		{
+			boost::mutex::scoped_lock lock(next_model_mutex);
+			i = next_model++;
+		}
+		if (i >= results->size())
+			return;
+		recognizeModel(cloud_xyzsift, i, (*results)[i]);
+	}
+}
 
-            CLOG(LINFO) << "Correspondences found: " << correspondences->size () << std::endl;
-//            correst.setInputSource(cloud_xyzsift) ;
-//            correst.setInputTarget(models[i]->cloud_xyzsift) ;
-//            correst.determineReciprocalCorrespondences(*correspondences, max_distance) ;
-//			//ransac - niepoprawne dopasowania
-//            pcl::CorrespondencesPtr inliers (new pcl::Correspondences());
-//        	pcl::registration::CorrespondenceRejectorSampleConsensus<PointXYZSIFT> sac ;
-//			sac.setInputSource(cloud_xyzsift) ;
-//			sac.setInputTarget(models[i]->cloud_xyzsift) ;
-//			sac.setInlierThreshold(inlier_threshold) ;
-//			sac.setMaximumIterations(2000) ;
-//			sac.setInputCorrespondences(correspondences) ;
-//            sac.getCorrespondences(*inliers) ;
-//			//std::cout << "SAC inliers " << inliers.size() << std::endl ;
-//            Eigen::Matrix4f  trans = sac.getBestTransformation();
-//            if (trans==Eigen::Matrix4f::Identity()){
-//                CLOG(LTRACE)  << "0 good correspondences!!" <<endl;
-//            }
-//            else{
-//                CLOG(LTRACE) << setprecision(2) << fixed;
-//                float percent = (float)inliers->size()/(float)models[i]->mean_viewpoint_features_number;
-//                CLOG(LTRACE)  << "\nNumber of reciprocal correspondences: " << correspondences->size() <<". Good correspondences:" << inliers->size() ;
-//                CLOG(LTRACE)  << " out of " << cloud_xyzsift->size() << " keypoints of instance, = " ;
-//                CLOG(LTRACE)  << percent << ". "<< models[i]->cloud_xyzsift->size() << " keypoints of model "<< models[i]->name << std::endl ;
-//                if (percent > threshold)
-//                    std::cout <<"Rozpoznano model "<< models[i]->name<<endl;
-//            }
-//        /////////////////////////////
-//            if(i==model_out_){
-//                out_cloud_xyzrgb.write(cloud_xyzrgb);
-//                out_cloud_xyzrgb_model.write(models[i]->cloud_xyzrgb);
-//                out_cloud_xyzsift.write(cloud_xyzsift);
-//                out_cloud_xyzsift_model.write(models[i]->cloud_xyzsift);
-//                out_correspondences.write(correspondences);//wszystkie dopasowania
-// //        out_good_correspondences.write(inliers);
-//            }
+void SIFTObjectMatcher::recognizeModel(const pcl::PointCloud<PointXYZSIFT>::Ptr & cloud_xyzsift, int i, ModelRecognition & result) {
+	// Called from worker threads - must not log nor touch component state other than the (read-only) models and indices.
+	if (!use_joint_index && !use_pq_index)
+		result.candidates = ModelMatcher(matcherParams()).matchModel(*model_trees[i], *cloud_xyzsift, *result.correspondences);
 
+	pcl::CorrespondencesPtr correspondences = result.correspondences;
+	if (correspondences->empty())
+		return;
 
         //Algorithm params
         float rf_rad_ (0.015f);
 
-        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > rototranslations;
-        std::vector<pcl::Correspondences> clustered_corrs;
-
         //  Clustering
         if(use_hough3d){//nie działa :(
-            CLOG(LTRACE) << "Using Hough3DGrouping";
             pcl::Hough3DGrouping<PointXYZSIFT, PointXYZSIFT, pcl::ReferenceFrame, pcl::ReferenceFrame> clusterer;
             clusterer.setHoughBinSize (cg_size);
             clusterer.setHoughThreshold (cg_thresh);
@@ -261,26 +459,9 @@ void SIFTObjectMatcher::match() {
             clusterer.setModelSceneCorrespondences (correspondences);
 
     //        clusterer.cluster (clustered_corrs);//tu sie wywala
-            clusterer.recognize (rototranslations, clustered_corrs);//tu sie wywala
-
-            CLOG(LINFO) << "Model instances found: " << rototranslations.size ();
-            for (size_t j = 0; j < rototranslations.size (); ++j)
-            {
-                Eigen::Matrix3f rotation = rototranslations[j].block<3,3>(0, 0);
-                Eigen::Vector3f translation = rototranslations[j].block<3,1>(0, 3);
-                if(rotation != Eigen::Matrix3f::Identity()){
-                    CLOG(LINFO) << "\n    Instance " << j + 1 << ":";
-                    CLOG(LINFO) << "        Correspondences belonging to this instance: " << clustered_corrs[j].size () ;
-                    // Print the rotation matrix and translation vector
-                    CLOG(LINFO) << "            | "<< rotation (0,0)<<" "<< rotation (0,1)<< " "<<rotation (0,2)<<" | ";
-                    CLOG(LINFO) << "        R = | "<< rotation (1,0)<<" "<< rotation (1,1)<< " "<<rotation (1,2)<<" | ";
-                    CLOG(LINFO) << "            | "<< rotation (2,0)<<" "<< rotation (2,1)<< " "<<rotation (2,2)<<" | ";
-                    CLOG(LINFO) << "        t = < "<< translation (0)<<" "<< translation (1)<< " "<< translation (2)<<" > ";
-                }
-            }
+            clusterer.recognize (result.rototranslations, result.clustered_corrs);//tu sie wywala
         }
         else{
-            CLOG(LTRACE) << "Using GeometricConsistencyGrouping";
         // Using GeometricConsistency
             pcl::GeometricConsistencyGrouping<PointXYZSIFT, PointXYZSIFT> gc_clusterer;
             gc_clusterer.setGCSize (cg_size);
@@ -290,40 +471,7 @@ void SIFTObjectMatcher::match() {
             gc_clusterer.setModelSceneCorrespondences (correspondences);
 
             //gc_clusterer.cluster (clustered_corrs);
-            gc_clusterer.recognize (rototranslations, clustered_corrs);
-            CLOG(LINFO) << "Model instances found: " << rototranslations.size () << std::endl;
-//            cout<<"clustered_corrs "<< clustered_corrs.size()<<endl;
-//            for(int j=0; j<clustered_corrs.size(); j++){
-//                for(int k =0; k<clustered_corrs[j].size();k++){
-//                    cout<<clustered_corrs[j][k].index_query<<"-"<<clustered_corrs[j][k].index_match<<", ";
-//                }
-//                cout<<endl<<"-----------"<<endl;
-//            }
-                for (size_t k = 0; k < rototranslations.size (); ++k){
-                      Eigen::Matrix3f rotation = rototranslations[k].block<3,3>(0, 0);
-                      Eigen::Vector3f translation = rototranslations[k].block<3,1>(0, 3);
-                      if(rotation != Eigen::Matrix3f::Identity()){
-                          CLOG(LINFO) << "\n    Instance " << k + 1 << ":";
-                          CLOG(LINFO) << "        Correspondences belonging to this instance: " << clustered_corrs[k].size () ;
-                          //Print the rotation matrix and translation vector
-                          CLOG(LINFO) << "            | "<< rotation (0,0)<<" "<< rotation (0,1)<< " "<<rotation (0,2)<<" | ";
-                          CLOG(LINFO) << "        R = | "<< rotation (1,0)<<" "<< rotation (1,1)<< " "<<rotation (1,2)<<" | ";
-                          CLOG(LINFO) << "            | "<< rotation (2,0)<<" "<< rotation (2,1)<< " "<<rotation (2,2)<<" | ";
-                          CLOG(LINFO) << "        t = < "<< translation (0)<<" "<< translation (1)<< " "<< translation (2)<<" > ";
-                      }
-                }
-            }
-            //Write only choosen model
-            if(i==model_out_){
-                out_cloud_xyzrgb.write(cloud_xyzrgb);
-                out_cloud_xyzrgb_model.write(models[i]->cloud_xyzrgb);
-                out_cloud_xyzsift.write(cloud_xyzsift);
-                out_cloud_xyzsift_model.write(models[i]->cloud_xyzsift);
-                out_correspondences.write(correspondences);//wszystkie dopasowania
-                //        out_good_correspondences.write(inliers);
-                out_clustered_correspondences.write(clustered_corrs);
-                out_rototranslations.write(rototranslations);
-            }
+            gc_clusterer.recognize (result.rototranslations, result.clustered_corrs);
         }
 }
 
@@ -14,8 +14,14 @@
 #include "EventHandler2.hpp"
 #include <Types/PointXYZSIFT.hpp> 
 #include <Types/SIFTObjectModel.hpp> 
+#include <Types/SIFTFeatureRepresentation.hpp>
+#include <Types/DescriptorDistance.hpp>
+#include <Types/DescriptorIndex.hpp>
+#include <Types/IVFPQIndex.hpp>
+#include <Types/ModelMatcher.hpp>
 #include <pcl/point_representation.h>
 #include <opencv2/core/core.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
@@ -97,16 +103,120 @@ protected:
 	void match();
 
 	std::vector<SIFTObjectModel*> models;
+
+	/// Descriptor trees of models, built once in readModels() (index i corresponds to models[i]).
+	std::vector<DescriptorIndex::Ptr> model_trees;
+
+	/// Returns parameters of the descriptor search set by properties.
+	DescriptorIndex::Params searchParams();
+
+	/// Logs recall and latency of the descriptor search against the exact search for a sample of scene features.
+	void reportSearch(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud_xyzsift);
+
+	/// Builds descriptor trees for all loaded models.
+	void buildModelTrees();
+
+	/// Index over descriptors of all models, rows labelled with model id and point index.
+	DescriptorIndex joint_index;
+
+	/// Builds the joint index over all loaded models.
+	void buildJointIndex();
+
+	/// Product-quantized index over all models, for large model libraries.
+	IVFPQIndex pq_index;
+
+	/// Loads (or trains and saves) the codebooks of the loaded models and encodes them.
+	void buildPQIndex();
+
+	/// Returns the codebook file - pq_codebook, or pq_codebooks.bin next to the model files (empty - not persisted).
+	std::string codebookFilename();
+
+	/// Training of the codebooks on the loaded models failed - not retried until models are read again.
+	bool pq_training_failed;
+
+	/// Returns matching parameters set by properties.
+	ModelMatcher::Params matcherParams();
+
+	/// Result of recognition of a single model in the scene.
+	struct ModelRecognition {
+		/// Model-scene correspondences.
+		pcl::CorrespondencesPtr correspondences;
+
+		/// Number of nearest neighbour matches before the ratio test and distance cutoff.
+		size_t candidates;
+
+		/// Poses of the found model instances.
+		std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > rototranslations;
+
+		/// Correspondences supporting each instance.
+		std::vector<pcl::Correspondences> clustered_corrs;
+	};
+
+	/// Finds correspondences (unless joint index is used) and clusters them into instances of the i-th model.
+	void recognizeModel(const pcl::PointCloud<PointXYZSIFT>::Ptr & cloud_xyzsift, int i, ModelRecognition & result);
+
+	/// Worker thread - recognizes models taken from the shared counter until all are done.
+	void recognitionWorker(const pcl::PointCloud<PointXYZSIFT>::Ptr & cloud_xyzsift, std::vector<ModelRecognition> * results);
+
+	/// Next model to be processed by the workers.
+	size_t next_model;
+	boost::mutex next_model_mutex;
+
+	/// Finds correspondences between the scene and all models with one query (to the joint or PQ index) per scene feature.
+	template <typename Index>
+	void findJointCorrespondences(const Index & index, const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud_xyzsift, std::vector<ModelRecognition> & results);
 	
+	/// Ratio of the distances to the nearest and second nearest model feature (Lowe's ratio test).
 	Base::Property<float> threshold;
 	Base::Property<float> inlier_threshold;
-    //Base::Property<float> max_distance;
+
+    /// Maximal descriptor distance of a correspondence (0 - no limit).
+    Base::Property<float> max_distance;
+
+    /// Filter correspondences with the ratio test.
+    Base::Property<bool> use_ratio_test;
     Base::Property<float> cg_size;
     Base::Property<float> cg_thresh;
     Base::Property<bool> use_hough3d;
 
+    /// Search all models with one joint index instead of per-model trees.
+    Base::Property<bool> use_joint_index;
+
+    /// Number of neighbours retrieved from the joint index per scene feature (at least 2) - models not reaching them are not matched.
+    Base::Property<int> joint_knn;
+
     Base::Property<int> model_out;
 
+    /// Number of threads recognizing models in parallel (0 - one per core).
+    Base::Property<int> threads;
+
+    /// Number of randomized kd-trees used by the approximate descriptor search.
+    Base::Property<int> search_trees;
+
+    /// Number of leaves checked per query (negative - exact search).
+    Base::Property<int> search_checks;
+
+    /// Log recall and latency of the descriptor search for every scene.
+    Base::Property<bool> search_report;
+
+    /// Store the index copies of model descriptors as 8-bit values instead of floats (model clouds keep floats).
+    Base::Property<bool> compact_descriptors;
+
+    /// Search all models with the product-quantized index (overrides use_joint_index).
+    Base::Property<bool> use_pq_index;
+
+    /// File with PQ codebooks - loaded if trained on the same models, otherwise trained and saved (empty - next to the model files).
+    Base::Property<std::string> pq_codebook;
+
+    /// Number of inverted lists of the trained codebooks.
+    Base::Property<int> pq_lists;
+
+    /// Number of lists visited per query.
+    Base::Property<int> pq_probes;
+
+    /// Number of candidates re-ranked with exact distances.
+    Base::Property<int> pq_rerank;
+
 };
 
 } //: namespace SIFTObjectMatcher
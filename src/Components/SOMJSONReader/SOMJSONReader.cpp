@@ -85,6 +85,7 @@ void SOMJSONReader::loadModels() {
 			read_json(namesList[i], ptree_file);
 			// Read JSON properties.
 			model_name = ptree_file.get<std::string>("name");
+			model_filename = namesList[i];
 			mean_viewpoint_features_number = ptree_file.get<int>("mean_viewpoint_features_number");
 			name_cloud_xyzrgb = ptree_file.get<std::string>("cloud_xyzrgb");
 			name_cloud_xyzsift = ptree_file.get<std::string>("cloud_xyzsift");
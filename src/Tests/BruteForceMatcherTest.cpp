@@ -0,0 +1,124 @@
+/*!
+ * \file
+ * \brief Unit test of BruteForceMatcher against a direct nearest neighbour search.
+ */
+
+#include <limits>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <pcl/pcl_macros.h>
+
+#include <Types/BruteForceMatcher.hpp>
+#include <Types/DescriptorDistance.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// Nearest and second nearest finite descriptor of the cloud.
+int nearest(const float * query, const pcl::PointCloud<PointXYZSIFT> & cloud, float & best, float & second) {
+	int index = -1;
+	best = second = std::numeric_limits<float>::max();
+	for (size_t j = 0; j < cloud.size(); ++j) {
+		if (!pcl_isfinite(cloud.points[j].descriptor[0]))
+			continue;
+		float d = DescriptorDistance::l2Sqr(query, cloud.points[j].descriptor);
+		if (d < best) {
+			second = best;
+			best = d;
+			index = j;
+		} else if (d < second) {
+			second = d;
+		}
+	}
+	return index;
+}
+
+/// Correspondences expected from the parameters, computed directly.
+pcl::Correspondences expectedMatches(const pcl::PointCloud<PointXYZSIFT> & src, const pcl::PointCloud<PointXYZSIFT> & trg, const BruteForceMatcher::Params & params) {
+	pcl::Correspondences expected;
+	float best, second, back_best, back_second;
+	for (size_t i = 0; i < src.size(); ++i) {
+		if (!pcl_isfinite(src.points[i].descriptor[0]))
+			continue;
+		int j = nearest(src.points[i].descriptor, trg, best, second);
+		if (params.reciprocal && nearest(trg.points[j].descriptor, src, back_best, back_second) != static_cast<int>(i))
+			continue;
+		if (params.max_distance > 0 && best > params.max_distance * params.max_distance)
+			continue;
+		if (params.ratio > 0 && best >= params.ratio * params.ratio * second)
+			continue;
+		expected.push_back(pcl::Correspondence(i, j, best));
+	}
+	return expected;
+}
+
+bool sameMatches(const pcl::Correspondences & a, const pcl::Correspondences & b) {
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		if (a[i].index_query != b[i].index_query || a[i].index_match != b[i].index_match || a[i].distance != b[i].distance)
+			return false;
+	return true;
+}
+
+/// Blocks not dividing the clouds, NaNs skipped, all filters compared with the direct search.
+void testAgainstDirectSearch() {
+	boost::mt19937 rng(1);
+	pcl::PointCloud<PointXYZSIFT> src = *Tests::randomCloud(rng, 70, 64);
+	pcl::PointCloud<PointXYZSIFT> trg = *Tests::randomCloud(rng, 150, 64);
+	src.points[5].descriptor[0] = std::numeric_limits<float>::quiet_NaN();
+	trg.points[7].descriptor[0] = std::numeric_limits<float>::quiet_NaN();
+
+	BruteForceMatcher::Params params;
+	params.block = 16;
+	pcl::Correspondences correspondences;
+	for (int reciprocal = 0; reciprocal < 2; ++reciprocal) {
+		params.reciprocal = reciprocal != 0;
+		params.ratio = 0;
+		params.max_distance = 0;
+		BruteForceMatcher(params).match(src, trg, correspondences);
+		TEST_CHECK(sameMatches(correspondences, expectedMatches(src, trg, params)));
+
+		params.ratio = 0.95f;
+		BruteForceMatcher(params).match(src, trg, correspondences);
+		TEST_CHECK(sameMatches(correspondences, expectedMatches(src, trg, params)));
+
+		params.ratio = 0;
+		params.max_distance = 240;
+		BruteForceMatcher(params).match(src, trg, correspondences);
+		TEST_CHECK(sameMatches(correspondences, expectedMatches(src, trg, params)));
+	}
+}
+
+/// Shuffled copy of a cloud is matched back point by point.
+void testPermutedCopy() {
+	boost::mt19937 rng(2);
+	pcl::PointCloud<PointXYZSIFT> src = *Tests::randomCloud(rng, 100, 64);
+	pcl::PointCloud<PointXYZSIFT> trg;
+	std::vector<int> positions;
+	for (size_t i = 0; i < src.size(); ++i)
+		positions.push_back((i * 37) % src.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+		trg.points.push_back(src.points[positions[i]]);
+	trg.width = trg.points.size();
+	trg.height = 1;
+
+	pcl::Correspondences correspondences;
+	BruteForceMatcher().match(src, trg, correspondences);
+	TEST_CHECK(correspondences.size() == src.size());
+	for (size_t c = 0; c < correspondences.size(); ++c) {
+		TEST_CHECK(positions[correspondences[c].index_match] == correspondences[c].index_query);
+		TEST_CHECK(correspondences[c].distance == 0);
+	}
+}
+
+} //: namespace
+
+int main() {
+	testAgainstDirectSearch();
+	testPermutedCopy();
+	return TEST_RESULT();
+}
@@ -0,0 +1,103 @@
+/*!
+ * \file
+ * \brief Unit test of CorrespondenceEstimationColor - colour changes the matched points, also inside the ICP.
+ */
+
+#include <cmath>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Types/CorrespondenceEstimationColor.hpp>
+#include <Types/MergeUtils.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+typedef pcl::registration::CorrespondenceEstimationColor<pcl::PointXYZRGB, pcl::PointXYZRGB, float> Estimation;
+
+pcl::PointXYZRGB point(float x, float y, int r, int g, int b) {
+	pcl::PointXYZRGB p;
+	p.x = x;
+	p.y = y;
+	p.z = 0;
+	p.r = r;
+	p.g = g;
+	p.b = b;
+	return p;
+}
+
+/// Target of red points on a grid, each with a green one 1 cm to the right.
+Cloud::Ptr redGreenTarget() {
+	Cloud::Ptr cloud(new Cloud());
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j) {
+			cloud->push_back(point(0.1f * i, 0.1f * j, 255, 0, 0));
+			cloud->push_back(point(0.1f * i + 0.01f, 0.1f * j, 0, 255, 0));
+		}
+	return cloud;
+}
+
+/// Green points 4 mm right of the red ones of the target - spatially closer to red, in colour to green.
+Cloud::Ptr greenSource() {
+	Cloud::Ptr cloud(new Cloud());
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			cloud->push_back(point(0.1f * i + 0.004f, 0.1f * j, 0, 255, 0));
+	return cloud;
+}
+
+/// With colour the green target points are matched (odd indices), without colour the red ones.
+void testColorChangesMatch() {
+	Cloud::Ptr target = redGreenTarget(), source = greenSource();
+	Estimation estimation;
+	estimation.setInputSource(source);
+	estimation.setInputTarget(target);
+
+	pcl::Correspondences correspondences;
+	estimation.determineCorrespondences(correspondences, 0.05);
+	TEST_CHECK(correspondences.size() == source->size());
+	for (size_t i = 0; i < correspondences.size(); ++i) {
+		TEST_CHECK(correspondences[i].index_match == 2 * correspondences[i].index_query + 1);
+		// The spatial distance is reported.
+		TEST_CHECK(std::abs(correspondences[i].distance - 0.006f * 0.006f) < 1e-7f);
+	}
+
+	estimation.determineReciprocalCorrespondences(correspondences, 0.05);
+	TEST_CHECK(correspondences.size() == source->size());
+	for (size_t i = 0; i < correspondences.size(); ++i)
+		TEST_CHECK(correspondences[i].index_match == 2 * correspondences[i].index_query + 1);
+
+	estimation.setColorWeight(0);
+	estimation.determineCorrespondences(correspondences, 0.05);
+	TEST_CHECK(correspondences.size() == source->size());
+	for (size_t i = 0; i < correspondences.size(); ++i)
+		TEST_CHECK(correspondences[i].index_match == 2 * correspondences[i].index_query);
+}
+
+/// The registration replaces the search trees of the estimation - the colour still decides which points are aligned.
+void testColorInsideICP() {
+	Cloud::Ptr target = redGreenTarget(), source = greenSource();
+	MergeUtils::Properties properties;
+	properties.ICP_max_iterations = 1;
+	properties.ICP_max_correspondence_distance = 0.05f;
+
+	// One ICP iteration moves the source onto its correspondences.
+	properties.ICP_color_weight = 0.001f;
+	Eigen::Matrix4f transformation = MergeUtils::computeTransformationICPColor(source, target, properties);
+	TEST_CHECK(std::abs(transformation(0, 3) - 0.006f) < 1e-4f);
+
+	properties.ICP_color_weight = 0;
+	transformation = MergeUtils::computeTransformationICPColor(source, target, properties);
+	TEST_CHECK(std::abs(transformation(0, 3) + 0.004f) < 1e-4f);
+}
+
+} //: namespace
+
+int main() {
+	testColorChangesMatch();
+	testColorInsideICP();
+	return TEST_RESULT();
+}
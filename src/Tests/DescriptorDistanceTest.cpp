@@ -0,0 +1,97 @@
+/*!
+ * \file
+ * \brief Unit test of DescriptorDistance - dispatched kernels against a scalar reference.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <Types/DescriptorDistance.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+double referenceL2Sqr(const float * a, const float * b, size_t size) {
+	double sum = 0;
+	for (size_t i = 0; i < size; ++i)
+		sum += (static_cast<double>(a[i]) - b[i]) * (static_cast<double>(a[i]) - b[i]);
+	return sum;
+}
+
+double referenceDot(const float * a, const float * b, size_t size) {
+	double sum = 0;
+	for (size_t i = 0; i < size; ++i)
+		sum += static_cast<double>(a[i]) * b[i];
+	return sum;
+}
+
+/// Integer descriptors (as SIFT ones) give exact sums in any order, for every length - also the ones leaving a tail after the vector loop.
+void testIntegerDescriptors() {
+	boost::mt19937 rng(1);
+	std::vector<float> a(DescriptorDistance::SIFT_SIZE + 1), b(DescriptorDistance::SIFT_SIZE + 1);
+	std::vector<unsigned char> a8(a.size()), b8(b.size());
+	for (size_t size = 0; size <= DescriptorDistance::SIFT_SIZE; ++size) {
+		for (size_t i = 0; i < size; ++i) {
+			a[i] = static_cast<float>(rng() % 256);
+			b[i] = static_cast<float>(rng() % 256);
+		}
+		// Rows starting at odd positions are unaligned.
+		const float * pa = &a[size % 2], * pb = &b[1 - size % 2];
+		TEST_CHECK(DescriptorDistance::l2Sqr(pa, pb, size) == referenceL2Sqr(pa, pb, size));
+		TEST_CHECK(DescriptorDistance::dot(pa, pb, size) == referenceDot(pa, pb, size));
+
+		DescriptorDistance::quantizeU8(pa, &a8[0], size);
+		DescriptorDistance::quantizeU8(pb, &b8[0], size);
+		TEST_CHECK(DescriptorDistance::l2SqrU8(&a8[0], &b8[0], size) == referenceL2Sqr(pa, pb, size));
+	}
+
+	boost::mt19937 sift_rng(2);
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = Tests::randomCloud(sift_rng, 20);
+	for (size_t i = 1; i < cloud->size(); ++i) {
+		const float * p = cloud->points[i - 1].descriptor, * q = cloud->points[i].descriptor;
+		TEST_CHECK(DescriptorDistance::l2Sqr(p, q) == referenceL2Sqr(p, q, DescriptorDistance::SIFT_SIZE));
+		TEST_CHECK(DescriptorDistance::dot(p, q) == referenceDot(p, q, DescriptorDistance::SIFT_SIZE));
+		TEST_CHECK(DescriptorDistance::l2Sqr(p, q) == SIFTDescriptorL2()(p, q, DescriptorDistance::SIFT_SIZE));
+	}
+}
+
+/// Real-valued descriptors agree with the reference up to the rounding of the summation order.
+void testRealDescriptors() {
+	boost::mt19937 rng(3);
+	std::vector<float> a(DescriptorDistance::SIFT_SIZE), b(DescriptorDistance::SIFT_SIZE);
+	for (size_t size = 1; size <= DescriptorDistance::SIFT_SIZE; size += 7) {
+		for (size_t i = 0; i < size; ++i) {
+			a[i] = Tests::uniform(rng, -1, 1);
+			b[i] = Tests::uniform(rng, -1, 1);
+		}
+		double l2 = referenceL2Sqr(&a[0], &b[0], size), dot = referenceDot(&a[0], &b[0], size);
+		TEST_CHECK(std::abs(DescriptorDistance::l2Sqr(&a[0], &b[0], size) - l2) <= 1e-5 * (1 + l2));
+		TEST_CHECK(std::abs(DescriptorDistance::dot(&a[0], &b[0], size) - dot) <= 1e-5 * size);
+	}
+}
+
+/// Quantization rounds to the nearest integer and saturates.
+void testQuantization() {
+	const float in[] = { -3.0f, 0.0f, 0.4f, 0.6f, 17.0f, 254.6f, 255.0f, 300.0f };
+	unsigned char out[8];
+	DescriptorDistance::quantizeU8(in, out, 8);
+	const unsigned char expected[] = { 0, 0, 0, 1, 17, 255, 255, 255 };
+	TEST_CHECK(std::memcmp(out, expected, 8) == 0);
+}
+
+void testBackendName() {
+	const char * name = DescriptorDistance::backendName();
+	TEST_CHECK(std::strcmp(name, "avx2") == 0 || std::strcmp(name, "sse") == 0 || std::strcmp(name, "scalar") == 0);
+}
+
+} //: namespace
+
+int main() {
+	testIntegerDescriptors();
+	testRealDescriptors();
+	testQuantization();
+	testBackendName();
+	return TEST_RESULT();
+}
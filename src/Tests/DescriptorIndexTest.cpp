@@ -0,0 +1,108 @@
+/*!
+ * \file
+ * \brief Unit test of DescriptorIndex - exact search in both encodings, labels and skipped NaNs.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Types/DescriptorIndex.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// Every indexed descriptor finds itself, the second neighbour agrees with a linear scan.
+void testExactSearch(DescriptorIndex::Encoding encoding) {
+	boost::mt19937 rng(1);
+	std::vector<pcl::PointCloud<PointXYZSIFT>::Ptr> clouds;
+	clouds.push_back(Tests::randomCloud(rng, 150));
+	clouds.push_back(Tests::randomCloud(rng, 100));
+
+	DescriptorIndex::Params params;
+	params.encoding = encoding;
+	params.checks = -1;
+	DescriptorIndex index(params);
+	for (size_t c = 0; c < clouds.size(); ++c)
+		index.addCloud(clouds[c], c);
+	index.build();
+	TEST_CHECK(index.size() == 250);
+
+	std::vector<int> rows;
+	std::vector<float> sqr_dists;
+	for (size_t c = 0; c < clouds.size(); ++c) {
+		for (size_t i = 0; i < clouds[c]->size(); ++i) {
+			const float * query = clouds[c]->points[i].descriptor;
+			TEST_CHECK(index.knnSearch(query, 2, rows, sqr_dists) == 2);
+			TEST_CHECK(index.label(rows[0]).cloud_id == static_cast<int>(c));
+			TEST_CHECK(index.label(rows[0]).point_index == static_cast<int>(i));
+			TEST_CHECK(sqr_dists[0] == 0);
+
+			float second = std::numeric_limits<float>::max();
+			for (size_t o = 0; o < clouds.size(); ++o)
+				for (size_t j = 0; j < clouds[o]->size(); ++j)
+					if (o != c || j != i)
+						second = std::min(second, DescriptorDistance::l2Sqr(query, clouds[o]->points[j].descriptor));
+			TEST_CHECK(sqr_dists[1] == second);
+		}
+	}
+}
+
+/// Points with NaN descriptors are not indexed.
+void testNaNSkipped() {
+	boost::mt19937 rng(2);
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = Tests::randomCloud(rng, 10);
+	cloud->points[3].descriptor[0] = std::numeric_limits<float>::quiet_NaN();
+	DescriptorIndex index;
+	index.addCloud(cloud, 0);
+	index.build();
+	TEST_CHECK(index.size() == 9);
+	for (size_t r = 0; r < index.size(); ++r)
+		TEST_CHECK(index.label(r).point_index != 3);
+}
+
+/// The 8-bit copy of the descriptors takes a quarter of the float one.
+void testCompactStorage() {
+	boost::mt19937 rng(3);
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = Tests::randomCloud(rng, 50);
+	DescriptorIndex::Params params;
+	DescriptorIndex floats(params);
+	params.encoding = DescriptorIndex::UINT8;
+	DescriptorIndex bytes(params);
+	floats.addCloud(cloud, 0);
+	bytes.addCloud(cloud, 0);
+	TEST_CHECK(bytes.descriptorBytes() * 4 == floats.descriptorBytes());
+}
+
+/// Randomized trees checking more leaves than there are descriptors find the exact neighbours.
+void testApproximateRecall() {
+	boost::mt19937 rng(4);
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = Tests::randomCloud(rng, 200);
+	DescriptorIndex::Params params;
+	params.trees = 4;
+	params.checks = 1000;
+	DescriptorIndex index(params);
+	index.addCloud(cloud, 0);
+	index.build();
+
+	std::vector<float> queries;
+	for (size_t i = 0; i < cloud->size(); i += 10)
+		queries.insert(queries.end(), cloud->points[i].descriptor, cloud->points[i].descriptor + DescriptorDistance::SIFT_SIZE);
+	DescriptorIndex::SearchReport report = index.evaluate(&queries[0], queries.size() / DescriptorDistance::SIFT_SIZE, 1);
+	TEST_CHECK(report.queries == 20);
+	TEST_CHECK(report.recall >= 0.9f);
+}
+
+} //: namespace
+
+int main() {
+	testExactSearch(DescriptorIndex::FLOAT32);
+	testExactSearch(DescriptorIndex::UINT8);
+	testNaNSkipped();
+	testCompactStorage();
+	testApproximateRecall();
+	return TEST_RESULT();
+}
@@ -0,0 +1,184 @@
+/*!
+ * \file
+ * \brief Unit test of IVFPQIndex - training, exact re-ranking, recall and codebook files with library fingerprints.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Types/IVFPQIndex.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// Cloud with integer descriptors scattered around a few random centres, as SIFT descriptors of similar features.
+pcl::PointCloud<PointXYZSIFT>::Ptr clusteredCloud(boost::mt19937 & rng, size_t size, size_t centres) {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	std::vector<float> centre_data(centres * dim);
+	for (size_t i = 0; i < centre_data.size(); ++i)
+		centre_data[i] = static_cast<float>(rng() % 256);
+
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud(new pcl::PointCloud<PointXYZSIFT>());
+	cloud->points.resize(size);
+	cloud->width = size;
+	cloud->height = 1;
+	for (size_t i = 0; i < size; ++i) {
+		PointXYZSIFT & p = cloud->points[i];
+		p.x = p.y = p.z = static_cast<float>(i);
+		const float * centre = &centre_data[(i % centres) * dim];
+		for (size_t d = 0; d < dim; ++d) {
+			int value = static_cast<int>(centre[d]) + static_cast<int>(rng() % 41) - 20;
+			p.descriptor[d] = static_cast<float>(std::max(0, std::min(255, value)));
+		}
+	}
+	return cloud;
+}
+
+IVFPQIndex::Params testParams() {
+	IVFPQIndex::Params params;
+	params.lists = 8;
+	params.subquantizers = 16;
+	params.probes = 2;
+	params.rerank = 16;
+	params.iterations = 5;
+	return params;
+}
+
+/// Returns the fraction of descriptors of the cloud which find themselves as the nearest neighbour.
+float selfRecall(const IVFPQIndex & index, const pcl::PointCloud<PointXYZSIFT> & cloud, int cloud_id) {
+	std::vector<int> rows;
+	std::vector<float> sqr_dists;
+	size_t found = 0;
+	for (size_t i = 0; i < cloud.size(); ++i) {
+		if (index.knnSearch(cloud.points[i].descriptor, 1, rows, sqr_dists) < 1)
+			continue;
+		const DescriptorLabel & label = index.label(rows[0]);
+		found += (label.cloud_id == cloud_id && label.point_index == static_cast<int>(i) && sqr_dists[0] == 0);
+	}
+	return static_cast<float>(found) / cloud.size();
+}
+
+/// Visiting all lists and re-ranking all rows gives the exact search, the index keeps the clouds it re-ranks with.
+void testExhaustiveSearch() {
+	boost::mt19937 rng(1);
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+	clouds.push_back(clusteredCloud(rng, 300, 10));
+	clouds.push_back(clusteredCloud(rng, 200, 10));
+
+	IVFPQIndex::Params params = testParams();
+	IVFPQIndex index(params);
+	TEST_CHECK(!index.trained());
+	TEST_CHECK(index.train(clouds));
+	TEST_CHECK(index.trained());
+	TEST_CHECK(!index.exact());
+	params.probes = params.lists;
+	params.rerank = 500;
+	index.setParams(params);
+	for (size_t c = 0; c < clouds.size(); ++c)
+		index.addCloud(clouds[c], c);
+	TEST_CHECK(index.size() == 500);
+	TEST_CHECK(index.codeBytes() == 500 * 16);
+
+	// Only the index refers to the clouds now.
+	pcl::PointCloud<PointXYZSIFT> copy0 = *clouds[0], copy1 = *clouds[1];
+	clouds.clear();
+	TEST_CHECK(selfRecall(index, copy0, 0) == 1.0f);
+	TEST_CHECK(selfRecall(index, copy1, 1) == 1.0f);
+
+	std::vector<int> rows;
+	std::vector<float> sqr_dists;
+	TEST_CHECK(index.knnSearch(copy0.points[0].descriptor, 5, rows, sqr_dists) == 5);
+	for (size_t n = 1; n < sqr_dists.size(); ++n)
+		TEST_CHECK(sqr_dists[n - 1] <= sqr_dists[n]);
+
+	// Search restricted to one cloud returns only its rows.
+	TEST_CHECK(index.knnSearchCloud(1, copy0.points[0].descriptor, 5, rows, sqr_dists) == 5);
+	for (size_t n = 0; n < rows.size(); ++n)
+		TEST_CHECK(index.label(rows[n]).cloud_id == 1);
+	TEST_CHECK(index.knnSearchCloud(1, copy1.points[7].descriptor, 1, rows, sqr_dists) == 1);
+	TEST_CHECK(index.label(rows[0]).point_index == 7 && sqr_dists[0] == 0);
+}
+
+/// With a few probed lists and a short re-ranking list most descriptors still find themselves.
+void testApproximateRecall() {
+	boost::mt19937 rng(2);
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = clusteredCloud(rng, 400, 8);
+	clouds.push_back(cloud);
+
+	IVFPQIndex index(testParams());
+	TEST_CHECK(index.train(clouds));
+	index.addCloud(cloud, 0);
+	TEST_CHECK(selfRecall(index, *cloud, 0) >= 0.9f);
+}
+
+/// Codebooks saved to a file and loaded into another index encode the same rows, codebooks of another library are not loaded.
+void testCodebookFile() {
+	boost::mt19937 rng(3);
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = clusteredCloud(rng, 200, 5);
+	clouds.push_back(cloud);
+
+	IVFPQIndex trained(testParams());
+	TEST_CHECK(trained.train(clouds));
+	trained.addCloud(cloud, 0);
+
+	const std::string filename = "IVFPQIndexTest.codebooks";
+	TEST_CHECK(trained.save(filename));
+	const boost::uint64_t fingerprint = IVFPQIndex::fingerprint(clouds);
+	TEST_CHECK(trained.trainingFingerprint() == fingerprint);
+
+	// Another library - one descriptor differs.
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> other_clouds;
+	pcl::PointCloud<PointXYZSIFT>::Ptr other = pcl::PointCloud<PointXYZSIFT>::Ptr(new pcl::PointCloud<PointXYZSIFT>(*cloud));
+	other->points[17].descriptor[5] += 1;
+	other_clouds.push_back(other);
+	TEST_CHECK(IVFPQIndex::fingerprint(other_clouds) != fingerprint);
+	IVFPQIndex mismatched(testParams());
+	TEST_CHECK(!mismatched.load(filename, IVFPQIndex::fingerprint(other_clouds)));
+	TEST_CHECK(!mismatched.trained());
+
+	IVFPQIndex loaded(testParams());
+	TEST_CHECK(loaded.load(filename, fingerprint));
+	TEST_CHECK(loaded.trainingFingerprint() == fingerprint);
+	std::remove(filename.c_str());
+	loaded.addCloud(cloud, 0);
+	TEST_CHECK(loaded.size() == trained.size());
+
+	std::vector<int> rows_trained, rows_loaded;
+	std::vector<float> dists_trained, dists_loaded;
+	for (size_t i = 0; i < cloud->size(); i += 10) {
+		trained.knnSearch(cloud->points[i].descriptor, 3, rows_trained, dists_trained);
+		loaded.knnSearch(cloud->points[i].descriptor, 3, rows_loaded, dists_loaded);
+		TEST_CHECK(rows_trained == rows_loaded);
+		TEST_CHECK(dists_trained == dists_loaded);
+	}
+
+	IVFPQIndex missing;
+	TEST_CHECK(!missing.load("IVFPQIndexTest.missing", fingerprint));
+	TEST_CHECK(!missing.trained());
+}
+
+/// Training without descriptors fails and leaves the index untrained.
+void testTrainingFailure() {
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+	clouds.push_back(pcl::PointCloud<PointXYZSIFT>::ConstPtr(new pcl::PointCloud<PointXYZSIFT>()));
+	IVFPQIndex index(testParams());
+	TEST_CHECK(!index.train(clouds));
+	TEST_CHECK(!index.trained());
+}
+
+} //: namespace
+
+int main() {
+	testExhaustiveSearch();
+	testApproximateRecall();
+	testCodebookFile();
+	testTrainingFailure();
+	return TEST_RESULT();
+}
@@ -0,0 +1,152 @@
+/*!
+ * \file
+ * \brief Unit test of IncrementalDescriptorIndex - positions in the tracked cloud through appends, removals and rebuilds.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <pcl/pcl_macros.h>
+
+#include <Types/IncrementalDescriptorIndex.hpp>
+#include <Types/MergeUtils.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<PointXYZSIFT> Cloud;
+
+/// Squared distances and positions of the k nearest finite descriptors of the cloud (linear scan).
+std::vector<std::pair<float, int> > linearSearch(const Cloud & cloud, const float * query, size_t k) {
+	std::vector<std::pair<float, int> > all;
+	for (size_t i = 0; i < cloud.size(); ++i)
+		if (pcl_isfinite(cloud.points[i].descriptor[0]))
+			all.push_back(std::make_pair(DescriptorDistance::l2Sqr(query, cloud.points[i].descriptor), static_cast<int>(i)));
+	std::sort(all.begin(), all.end());
+	all.resize(std::min(k, all.size()));
+	return all;
+}
+
+/// Every query (all tracked descriptors and a few random ones) finds the positions found by the linear scan.
+void checkSearch(const IncrementalDescriptorIndex & index, const Cloud & tracked, boost::mt19937 & rng) {
+	TEST_CHECK(index.size() == tracked.size());
+	Cloud::Ptr random = Tests::randomCloud(rng, 10);
+	std::vector<const float *> queries;
+	for (size_t i = 0; i < tracked.size(); ++i)
+		if (pcl_isfinite(tracked.points[i].descriptor[0]))
+			queries.push_back(tracked.points[i].descriptor);
+	for (size_t i = 0; i < random->size(); ++i)
+		queries.push_back(random->points[i].descriptor);
+
+	std::vector<int> positions;
+	std::vector<float> sqr_dists;
+	for (size_t q = 0; q < queries.size(); ++q) {
+		std::vector<std::pair<float, int> > expected = linearSearch(tracked, queries[q], 3);
+		TEST_CHECK(index.knnSearch(queries[q], 3, positions, sqr_dists) == static_cast<int>(expected.size()));
+		for (size_t n = 0; n < std::min(expected.size(), positions.size()); ++n) {
+			TEST_CHECK(positions[n] == expected[n].second);
+			TEST_CHECK(sqr_dists[n] == expected[n].first);
+		}
+	}
+}
+
+/// Appends the view to the tracked cloud and the index.
+void append(IncrementalDescriptorIndex & index, Cloud & tracked, const Cloud & view, unsigned long & generation) {
+	tracked += view;
+	index.append(view, ++generation);
+}
+
+/// Removes every n-th point (starting at the offset) from the tracked cloud and the index.
+void removeEvery(IncrementalDescriptorIndex & index, Cloud & tracked, size_t n, size_t offset, unsigned long & generation) {
+	std::vector<bool> removed(tracked.size(), false);
+	std::vector<int> indices;
+	for (size_t i = offset; i < tracked.size(); i += n) {
+		removed[i] = true;
+		indices.push_back(i);
+	}
+	index.remove(removed, ++generation);
+	MergeUtils::removePoints(tracked, indices);
+}
+
+/// Interleaved appends and removals keep search results equal to the linear scan of the tracked cloud.
+void testAppendRemove() {
+	boost::mt19937 rng(1);
+	DescriptorIndex::Params params;
+	params.checks = -1;
+	IncrementalDescriptorIndex index(params);
+	Cloud tracked;
+	unsigned long generation = 0;
+	index.reset(tracked, generation);
+	checkSearch(index, tracked, rng);
+
+	// NaN descriptors keep their positions, but are never found.
+	Cloud::Ptr view = Tests::randomCloud(rng, 40);
+	view->points[5].descriptor[0] = std::numeric_limits<float>::quiet_NaN();
+	append(index, tracked, *view, generation);
+	checkSearch(index, tracked, rng);
+
+	append(index, tracked, *Tests::randomCloud(rng, 15), generation);
+	checkSearch(index, tracked, rng);
+	removeEvery(index, tracked, 4, 1, generation);
+	checkSearch(index, tracked, rng);
+	append(index, tracked, *Tests::randomCloud(rng, 20), generation);
+	removeEvery(index, tracked, 5, 3, generation);
+	checkSearch(index, tracked, rng);
+
+	// The indexed points more than double - FLANN rebuilds its trees.
+	append(index, tracked, *Tests::randomCloud(rng, 150), generation);
+	checkSearch(index, tracked, rng);
+
+	// More than half of the ids removed - the index rebuilds the trees over the remaining descriptors.
+	removeEvery(index, tracked, 3, 0, generation);
+	removeEvery(index, tracked, 2, 1, generation);
+	checkSearch(index, tracked, rng);
+	append(index, tracked, *Tests::randomCloud(rng, 30), generation);
+	removeEvery(index, tracked, 7, 2, generation);
+	checkSearch(index, tracked, rng);
+	TEST_CHECK(index.generation() == generation);
+
+	// Removing everything leaves an empty index, which can be appended to again.
+	removeEvery(index, tracked, 1, 0, generation);
+	TEST_CHECK(tracked.empty());
+	checkSearch(index, tracked, rng);
+	append(index, tracked, *Tests::randomCloud(rng, 10), generation);
+	checkSearch(index, tracked, rng);
+}
+
+/// The index recognizes the generation of the cloud it mirrors, also when the size did not change.
+void testGenerations() {
+	boost::mt19937 rng(2);
+	Cloud::Ptr cloud = Tests::randomCloud(rng, 30);
+	IncrementalDescriptorIndex index;
+	index.reset(*cloud, 4);
+	TEST_CHECK(index.generation() == 4);
+	TEST_CHECK(index.tracks(*cloud, 4));
+	TEST_CHECK(!index.tracks(*cloud, 5));
+	Cloud::Ptr other = Tests::randomCloud(rng, 31);
+	TEST_CHECK(!index.tracks(*other, 4));
+
+	// Correspondences with a cloud replaced behind the index's back (same size, next generation) are found in the new cloud.
+	Cloud::Ptr replaced = Tests::randomCloud(rng, 30);
+	pcl::CorrespondencesPtr correspondences(new pcl::Correspondences());
+	MergeUtils::Properties properties;
+	properties.correspondences_brute_force = 0;
+	MergeUtils::computeCorrespondences(replaced, replaced, 5, index, correspondences, properties);
+	TEST_CHECK(index.tracks(*replaced, 5));
+	TEST_CHECK(correspondences->size() == replaced->size());
+	for (size_t c = 0; c < correspondences->size(); ++c)
+		TEST_CHECK((*correspondences)[c].index_query == (*correspondences)[c].index_match);
+}
+
+} //: namespace
+
+int main() {
+	testAppendRemove();
+	testGenerations();
+	return TEST_RESULT();
+}
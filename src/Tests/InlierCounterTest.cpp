@@ -0,0 +1,84 @@
+/*!
+ * \file
+ * \brief Unit test of InlierCounter - the dispatched kernel against known inlier counts.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Eigen/Geometry>
+
+#include <Types/InlierCounter.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// Point pairs under a rigid transformation, targets moved by a half or twice the threshold - far from the threshold, so the count does not depend on rounding.
+struct Pairs {
+	std::vector<float> src_x, src_y, src_z;
+	std::vector<float> trg_x, trg_y, trg_z;
+	float transformation[12];
+	int inliers;
+
+	Pairs(boost::mt19937 & rng, size_t size, float threshold) : src_x(size), src_y(size), src_z(size), trg_x(size), trg_y(size), trg_z(size), inliers(0) {
+		Eigen::Affine3f pose = Eigen::Translation3f(0.3f, -0.1f, 0.2f) * Eigen::AngleAxisf(0.7f, Eigen::Vector3f(1, 2, 3).normalized());
+		for (int r = 0; r < 3; ++r)
+			for (int c = 0; c < 4; ++c)
+				transformation[4 * r + c] = pose.matrix()(r, c);
+		for (size_t i = 0; i < size; ++i) {
+			Eigen::Vector3f p(Tests::uniform(rng, -1, 1), Tests::uniform(rng, -1, 1), Tests::uniform(rng, -1, 1));
+			Eigen::Vector3f direction(Tests::uniform(rng, -1, 1), Tests::uniform(rng, -1, 1), Tests::uniform(rng, 0.1f, 1));
+			bool inlier = rng() % 3 != 0;
+			Eigen::Vector3f q = pose * p + (inlier ? 0.5f : 2.0f) * threshold * direction.normalized();
+			inliers += inlier;
+			src_x[i] = p[0];
+			src_y[i] = p[1];
+			src_z[i] = p[2];
+			trg_x[i] = q[0];
+			trg_y[i] = q[1];
+			trg_z[i] = q[2];
+		}
+	}
+
+	int count(size_t offset, size_t size, float sqr_threshold) const {
+		InlierCounter::Coordinates src = { &src_x[0] + offset, &src_y[0] + offset, &src_z[0] + offset };
+		InlierCounter::Coordinates trg = { &trg_x[0] + offset, &trg_y[0] + offset, &trg_z[0] + offset };
+		return InlierCounter::count(src, trg, size, transformation, sqr_threshold);
+	}
+};
+
+/// Sizes around the vector widths (tails of every length) and unaligned starts.
+void testCounts() {
+	boost::mt19937 rng(1);
+	const float threshold = 0.01f;
+	for (size_t size = 1; size <= 40; ++size) {
+		Pairs pairs(rng, size, threshold);
+		TEST_CHECK(pairs.count(0, size, threshold * threshold) == pairs.inliers);
+	}
+
+	Pairs pairs(rng, 1000, threshold);
+	TEST_CHECK(pairs.count(0, 1000, threshold * threshold) == pairs.inliers);
+	TEST_CHECK(pairs.count(0, 0, threshold * threshold) == 0);
+	// Counts of parts starting at unaligned positions add up.
+	TEST_CHECK(pairs.count(0, 3, threshold * threshold) + pairs.count(3, 500, threshold * threshold) + pairs.count(503, 497, threshold * threshold) == pairs.inliers);
+	// Larger threshold accepts all pairs, smaller none.
+	TEST_CHECK(pairs.count(0, 1000, 9 * threshold * threshold) == 1000);
+	TEST_CHECK(pairs.count(0, 1000, 0.1f * threshold * threshold) == 0);
+}
+
+void testBackendName() {
+	const char * name = InlierCounter::backendName();
+	TEST_CHECK(std::strcmp(name, "avx2") == 0 || std::strcmp(name, "sse") == 0 || std::strcmp(name, "scalar") == 0);
+}
+
+} //: namespace
+
+int main() {
+	testCounts();
+	testBackendName();
+	return TEST_RESULT();
+}
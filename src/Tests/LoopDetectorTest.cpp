@@ -0,0 +1,137 @@
+/*!
+ * \file
+ * \brief Unit test of LoopDetector - loops reported when the trajectory leaves them or ends, moved views.
+ */
+
+#include <cmath>
+
+#include <pcl/point_types.h>
+
+#include <Types/LoopDetector.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// View of a few points around the given centroid.
+pcl::PointCloud<pcl::PointXYZRGB> view(float x, float y) {
+	pcl::PointCloud<pcl::PointXYZRGB> cloud;
+	for (int i = -1; i <= 1; i += 2) {
+		pcl::PointXYZRGB p;
+		p.x = x + 0.01f * i;
+		p.y = y;
+		p.z = 1.0f;
+		cloud.push_back(p);
+	}
+	return cloud;
+}
+
+/// Position of the i-th view on a circle of 12 views with radius 1.
+pcl::PointCloud<pcl::PointXYZRGB> circleView(int i) {
+	const float angle = static_cast<float>(i) * 2.0f * static_cast<float>(M_PI) / 12.0f;
+	return view(std::cos(angle), std::sin(angle));
+}
+
+/// Views added and checked one by one, as by ELECHGenerator; returns the number of reported loops.
+int addAndDetect(LoopDetector & detector, const pcl::PointCloud<pcl::PointXYZRGB> & cloud, int & first, int & last) {
+	int end = detector.addView(cloud);
+	return detector.detect(end, first, last) ? 1 : 0;
+}
+
+/// Going around a circle twice - the loop is reported when the trajectory leaves the closest return, not at it.
+void testCircle() {
+	LoopDetector detector(0.3);
+	int first = -1, last = -1, loops = 0;
+	for (int i = 0; i < 12; ++i)
+		loops += addAndDetect(detector, circleView(i), first, last);
+	TEST_CHECK(loops == 0);
+
+	// Back at the start (view 12) the closure with view 0 becomes pending.
+	loops += addAndDetect(detector, view(1.0f, 0.1f), first, last);
+	TEST_CHECK(loops == 0);
+	// Still within the loop region - a closer return replaces the pending closure.
+	loops += addAndDetect(detector, view(1.0f, 0.0f), first, last);
+	TEST_CHECK(loops == 0);
+	// Leaving the region (not returning to any other view) reports the best closure.
+	loops += addAndDetect(detector, view(3.0f, 3.0f), first, last);
+	TEST_CHECK(loops == 1);
+	TEST_CHECK(first == 0);
+	TEST_CHECK(last == 13);
+	TEST_CHECK(detector.size() == 15);
+
+	// The reported loop is not pending any more.
+	loops += addAndDetect(detector, view(6.0f, 6.0f), first, last);
+	TEST_CHECK(loops == 1);
+}
+
+/// A loop still pending when the trajectory ends is reported by finish(), once.
+void testFinish() {
+	LoopDetector detector(0.3);
+	int first = -1, last = -1, loops = 0;
+	for (int i = 0; i < 12; ++i)
+		loops += addAndDetect(detector, circleView(i), first, last);
+	TEST_CHECK(!detector.finish(first, last));
+
+	loops += addAndDetect(detector, view(1.0f, 0.0f), first, last);
+	loops += addAndDetect(detector, view(1.0f, 0.1f), first, last);
+	TEST_CHECK(loops == 0);
+	TEST_CHECK(detector.finish(first, last));
+	TEST_CHECK(first == 0);
+	TEST_CHECK(last == 12);
+	TEST_CHECK(!detector.finish(first, last));
+
+	// Leaving the region afterwards does not report it again.
+	loops += addAndDetect(detector, view(3.0f, 3.0f), first, last);
+	TEST_CHECK(loops == 0);
+
+	// Clearing forgets the pending loop.
+	LoopDetector other(0.3);
+	for (int i = 0; i < 13; ++i)
+		loops += addAndDetect(other, circleView(i), first, last);
+	TEST_CHECK(loops == 0);
+	other.clear();
+	TEST_CHECK(!other.finish(first, last));
+	TEST_CHECK(other.size() == 0);
+}
+
+/// A straight trajectory never returns.
+void testNoLoop() {
+	LoopDetector detector(0.1);
+	int first, last, loops = 0;
+	for (int i = 0; i < 30; ++i)
+		loops += addAndDetect(detector, view(0.05f * i, 0), first, last);
+	TEST_CHECK(loops == 0);
+}
+
+/// Updated views are found in their new cells, not in the old ones.
+void testUpdateView() {
+	LoopDetector detector(0.3);
+	int first, last;
+	detector.addView(view(5.0f, 5.0f));
+	for (int i = 1; i < 6; ++i)
+		detector.addView(view(i * 1.0f, 0));
+
+	// View 0 moved next to the last view - a return to it is pending now.
+	detector.updateView(0, view(5.0f, 0.1f));
+	TEST_CHECK(!detector.detect(5, first, last));
+	TEST_CHECK(detector.addView(view(10.0f, 0)) == 6);
+	TEST_CHECK(detector.detect(6, first, last));
+	TEST_CHECK(first == 0 && last == 5);
+
+	// Moved far away it is not a candidate any more.
+	detector.updateView(0, view(-5.0f, 0));
+	detector.addView(view(5.0f, 0.1f));
+	TEST_CHECK(!detector.detect(7, first, last));
+	detector.addView(view(10.0f, 0));
+	TEST_CHECK(!detector.detect(8, first, last));
+}
+
+} //: namespace
+
+int main() {
+	testCircle();
+	testFinish();
+	testNoLoop();
+	testUpdateView();
+	return TEST_RESULT();
+}
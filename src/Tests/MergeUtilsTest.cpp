@@ -0,0 +1,107 @@
+/*!
+ * \file
+ * \brief Unit test of MergeUtils point removal - order of the kept points, duplicate and invalid indices, cloud dimensions.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Types/MergeUtils.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<PointXYZSIFT> Cloud;
+
+/// Organized cloud of the given dimensions, x coordinate of a point is its index.
+Cloud::Ptr organizedCloud(uint32_t width, uint32_t height) {
+	boost::mt19937 rng(1);
+	Cloud::Ptr cloud = Tests::randomCloud(rng, width * height);
+	cloud->width = width;
+	cloud->height = height;
+	return cloud;
+}
+
+/// Checks that the cloud holds (in order) the points with the given original indices and is unorganized.
+void checkKept(const Cloud & cloud, const std::vector<int> & expected) {
+	TEST_CHECK(cloud.size() == expected.size());
+	TEST_CHECK(cloud.width == expected.size());
+	TEST_CHECK(cloud.height == 1);
+	for (size_t i = 0; i < std::min(cloud.size(), expected.size()); ++i)
+		TEST_CHECK(cloud.points[i].x == static_cast<float>(expected[i]));
+}
+
+/// Features marked with multiplicity -1 are removed, the rest keeps its order.
+void testRemovePointsIf() {
+	Cloud::Ptr cloud = organizedCloud(4, 3);
+	std::vector<int> expected;
+	for (size_t i = 0; i < cloud->size(); ++i) {
+		cloud->points[i].multiplicity = (i % 3 == 1 || i == 11) ? -1 : 1;
+		if (cloud->points[i].multiplicity != -1)
+			expected.push_back(i);
+	}
+	TEST_CHECK(MergeUtils::removePointsIf(*cloud, MergeUtils::RemovedFeature()) == 5);
+	checkKept(*cloud, expected);
+
+	// Nothing to remove - the cloud is only made unorganized.
+	cloud = organizedCloud(2, 2);
+	for (size_t i = 0; i < cloud->size(); ++i)
+		cloud->points[i].multiplicity = 1;
+	TEST_CHECK(MergeUtils::removePointsIf(*cloud, MergeUtils::RemovedFeature()) == 0);
+	expected.clear();
+	for (int i = 0; i < 4; ++i)
+		expected.push_back(i);
+	checkKept(*cloud, expected);
+
+	// Everything removed.
+	for (size_t i = 0; i < cloud->size(); ++i)
+		cloud->points[i].multiplicity = -1;
+	TEST_CHECK(MergeUtils::removePointsIf(*cloud, MergeUtils::RemovedFeature()) == 4);
+	checkKept(*cloud, std::vector<int>());
+}
+
+/// Indices may come in any order and repeat, invalid ones are ignored - every point is removed at most once.
+void testRemovePoints() {
+	Cloud::Ptr cloud = organizedCloud(5, 2);
+	std::vector<int> indices;
+	indices.push_back(7);
+	indices.push_back(2);
+	indices.push_back(7);
+	indices.push_back(-1);
+	indices.push_back(10);
+	indices.push_back(0);
+	indices.push_back(2);
+	indices.push_back(1000);
+	TEST_CHECK(MergeUtils::removePoints(*cloud, indices) == 3);
+	int kept[] = { 1, 3, 4, 5, 6, 8, 9 };
+	checkKept(*cloud, std::vector<int>(kept, kept + 7));
+
+	// Only invalid indices.
+	indices.clear();
+	indices.push_back(-5);
+	indices.push_back(7);
+	TEST_CHECK(MergeUtils::removePoints(*cloud, indices) == 0);
+	checkKept(*cloud, std::vector<int>(kept, kept + 7));
+
+	// All points, the last one first.
+	indices.clear();
+	for (int i = static_cast<int>(cloud->size()) - 1; i >= 0; --i)
+		indices.push_back(i);
+	TEST_CHECK(MergeUtils::removePoints(*cloud, indices) == 7);
+	checkKept(*cloud, std::vector<int>());
+
+	// Empty cloud.
+	TEST_CHECK(MergeUtils::removePoints(*cloud, indices) == 0);
+	checkKept(*cloud, std::vector<int>());
+}
+
+} //: namespace
+
+int main() {
+	testRemovePointsIf();
+	testRemovePoints();
+	return TEST_RESULT();
+}
@@ -0,0 +1,132 @@
+/*!
+ * \file
+ * \brief Unit test of MergedCloudAssembler - transformed segments, partial reassembling, tolerance.
+ */
+
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+#include <pcl/point_types.h>
+
+#include <Types/MergedCloudAssembler.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+/// View of the given number of points on a line, coloured by the view number.
+Cloud::Ptr lineView(size_t size, int view) {
+	Cloud::Ptr cloud(new Cloud());
+	for (size_t i = 0; i < size; ++i) {
+		pcl::PointXYZRGB p;
+		p.x = static_cast<float>(i);
+		p.y = 1.0f;
+		p.z = 2.0f;
+		p.r = p.g = p.b = view;
+		cloud->push_back(p);
+	}
+	return cloud;
+}
+
+Eigen::Matrix4f translation(float x, float y, float z) {
+	Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+	pose(0, 3) = x;
+	pose(1, 3) = y;
+	pose(2, 3) = z;
+	return pose;
+}
+
+/// Checks that the segment of the merged cloud holds the view transformed by the pose.
+bool segmentEquals(const Cloud & merged, size_t offset, const Cloud & view, const Eigen::Matrix4f & pose) {
+	for (size_t i = 0; i < view.size(); ++i) {
+		Eigen::Vector3f expected = pose.topLeftCorner<3, 3>() * view.points[i].getVector3fMap() + pose.topRightCorner<3, 1>();
+		const pcl::PointXYZRGB & p = merged.points[offset + i];
+		if ((p.getVector3fMap() - expected).norm() > 1e-5f || p.r != view.points[i].r)
+			return false;
+	}
+	return true;
+}
+
+/// Views are concatenated in order, only new views are transformed.
+void testConcatenation() {
+	MergedCloudAssembler<pcl::PointXYZRGB> assembler;
+	Cloud::Ptr v0 = lineView(3, 0), v1 = lineView(2, 1), v2 = lineView(4, 2);
+	Eigen::Matrix4f p1 = translation(1, 0, 0);
+	Eigen::Matrix4f p2 = Eigen::Matrix4f::Identity();
+	p2.topLeftCorner<3, 3>() = Eigen::AngleAxisf(0.5f, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+
+	TEST_CHECK(assembler.addView(v0) == 0);
+	TEST_CHECK(assembler.addView(v1, p1) == 1);
+	TEST_CHECK(assembler.assemble() == 2);
+	TEST_CHECK(assembler.getCloud()->size() == 5);
+
+	TEST_CHECK(assembler.addView(v2, p2) == 2);
+	TEST_CHECK(assembler.assemble() == 1);
+	const Cloud & merged = *assembler.getCloud();
+	TEST_CHECK(merged.size() == 9);
+	TEST_CHECK(merged.width == 9 && merged.height == 1);
+	TEST_CHECK(segmentEquals(merged, 0, *v0, Eigen::Matrix4f::Identity()));
+	TEST_CHECK(segmentEquals(merged, 3, *v1, p1));
+	TEST_CHECK(segmentEquals(merged, 5, *v2, p2));
+	TEST_CHECK(assembler.assemble() == 0);
+}
+
+/// Only views moved by more than the tolerance or invalidated are transformed again.
+void testPoseUpdates() {
+	MergedCloudAssembler<pcl::PointXYZRGB> assembler(1e-3f);
+	Cloud::Ptr v0 = lineView(3, 0), v1 = lineView(3, 1), v2 = lineView(3, 2);
+	assembler.addView(v0);
+	assembler.addView(v1);
+	assembler.addView(v2);
+	TEST_CHECK(assembler.assemble() == 3);
+
+	TEST_CHECK(!assembler.setPose(0, translation(1e-4f, 0, 0)));
+	Eigen::Matrix4f moved = translation(0, 0.5f, 0);
+	TEST_CHECK(assembler.setPose(1, moved));
+	TEST_CHECK(assembler.assemble() == 1);
+	TEST_CHECK(segmentEquals(*assembler.getCloud(), 0, *v0, Eigen::Matrix4f::Identity()));
+	TEST_CHECK(segmentEquals(*assembler.getCloud(), 3, *v1, moved));
+
+	// Points moved in place are picked up after invalidation only.
+	v2->points[0].x = 10.0f;
+	TEST_CHECK(assembler.assemble() == 0);
+	TEST_CHECK(assembler.getCloud()->points[6].x == 0.0f);
+	assembler.invalidate(2);
+	TEST_CHECK(assembler.assemble() == 1);
+	TEST_CHECK(assembler.getCloud()->points[6].x == 10.0f);
+
+	assembler.invalidateAll();
+	TEST_CHECK(assembler.assemble() == 3);
+}
+
+/// Assembling a prefix of the views, clearing empties the cloud in place.
+void testPrefixAndClear() {
+	MergedCloudAssembler<pcl::PointXYZRGB> assembler;
+	Cloud::Ptr cloud = assembler.getCloud();
+	assembler.addView(lineView(2, 0));
+	assembler.addView(lineView(5, 1));
+	TEST_CHECK(assembler.assemble(1) == 1);
+	TEST_CHECK(cloud->size() == 2);
+	TEST_CHECK(assembler.assemble() == 1);
+	TEST_CHECK(cloud->size() == 7);
+
+	assembler.clear();
+	TEST_CHECK(assembler.size() == 0);
+	TEST_CHECK(assembler.getCloud() == cloud);
+	TEST_CHECK(cloud->empty());
+	assembler.addView(lineView(4, 2));
+	TEST_CHECK(assembler.assemble() == 1);
+	TEST_CHECK(cloud->size() == 4);
+}
+
+} //: namespace
+
+int main() {
+	testConcatenation();
+	testPoseUpdates();
+	testPrefixAndClear();
+	return TEST_RESULT();
+}
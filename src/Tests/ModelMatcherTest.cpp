@@ -0,0 +1,151 @@
+/*!
+ * \file
+ * \brief Unit test of ModelMatcher - matching with one library index against matching every model with its own.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Types/ModelMatcher.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<PointXYZSIFT> Cloud;
+
+/// Copy of the point with the descriptor shifted by random integers from [-amplitude, amplitude], kept in [0, 255].
+PointXYZSIFT perturbed(boost::mt19937 & rng, const PointXYZSIFT & point, int amplitude) {
+	PointXYZSIFT p = point;
+	for (size_t d = 0; d < DescriptorDistance::SIFT_SIZE; ++d) {
+		int value = static_cast<int>(p.descriptor[d]) + static_cast<int>(rng() % (2 * amplitude + 1)) - amplitude;
+		p.descriptor[d] = static_cast<float>(std::max(0, std::min(255, value)));
+	}
+	return p;
+}
+
+/// Random models and a scene made of perturbed model features and of clutter.
+/// First features of the second model are close copies of the first model ones, so both models
+/// compete for the same scene features and the ratio test needs the second neighbour of every model.
+struct Library {
+	std::vector<Cloud::Ptr> models;
+	Cloud scene;
+
+	explicit Library(unsigned seed) {
+		boost::mt19937 rng(seed);
+		for (int m = 0; m < 4; ++m)
+			models.push_back(Tests::randomCloud(rng, 60));
+		for (size_t i = 0; i < 10; ++i)
+			models[1]->points[i] = perturbed(rng, models[0]->points[i], 4);
+		for (size_t m = 0; m < models.size(); ++m)
+			for (size_t i = 0; i < models[m]->size(); i += 3)
+				scene.push_back(perturbed(rng, models[m]->points[i], 8));
+		Cloud::Ptr clutter = Tests::randomCloud(rng, 50);
+		scene += *clutter;
+	}
+};
+
+/// Number of library descriptors strictly closer to the query than the given squared distance.
+size_t closerDescriptors(const Library & library, const float * query, float sqr_dist) {
+	size_t closer = 0;
+	for (size_t m = 0; m < library.models.size(); ++m)
+		for (size_t i = 0; i < library.models[m]->size(); ++i)
+			if (DescriptorDistance::l2Sqr(query, library.models[m]->points[i].descriptor) < sqr_dist)
+				++closer;
+	return closer;
+}
+
+bool sameCorrespondence(const pcl::Correspondence & a, const pcl::Correspondence & b) {
+	return a.index_query == b.index_query && a.index_match == b.index_match && a.distance == b.distance;
+}
+
+/// With the exact library index, a model is matched jointly as with its own index whenever its nearest descriptor is among the k nearest.
+void testJointEqualsPerModel(const ModelMatcher::Params & params, DescriptorIndex::Encoding encoding) {
+	Library library(1);
+	DescriptorIndex::Params index_params;
+	index_params.encoding = encoding;
+	DescriptorIndex joint(index_params);
+	std::vector<boost::shared_ptr<DescriptorIndex> > trees;
+	for (size_t m = 0; m < library.models.size(); ++m) {
+		joint.addCloud(library.models[m], m);
+		trees.push_back(boost::shared_ptr<DescriptorIndex>(new DescriptorIndex(index_params)));
+		trees.back()->addCloud(library.models[m], m);
+		trees.back()->build();
+	}
+	joint.build();
+	joint.buildCloudIndices();
+
+	ModelMatcher matcher(params);
+	std::vector<pcl::Correspondences> joint_correspondences(library.models.size());
+	std::vector<size_t> joint_candidates(library.models.size(), 0);
+	matcher.matchJoint(joint, library.scene, library.models.size(), joint_correspondences, joint_candidates);
+
+	const size_t k = matcher.jointNeighbours(joint.size());
+	size_t matched = 0;
+	for (size_t m = 0; m < library.models.size(); ++m) {
+		pcl::Correspondences correspondences;
+		TEST_CHECK(matcher.matchModel(*trees[m], library.scene, correspondences) == library.scene.size());
+
+		// Per-model correspondences reaching the k nearest, in the order of the scene features.
+		pcl::Correspondences expected;
+		for (size_t c = 0; c < correspondences.size(); ++c) {
+			const float * query = library.scene.points[correspondences[c].index_match].descriptor;
+			if (closerDescriptors(library, query, correspondences[c].distance) < k)
+				expected.push_back(correspondences[c]);
+		}
+		TEST_CHECK(joint_correspondences[m].size() == expected.size());
+		for (size_t c = 0; c < std::min(expected.size(), joint_correspondences[m].size()); ++c)
+			TEST_CHECK(sameCorrespondence(joint_correspondences[m][c], expected[c]));
+		TEST_CHECK(joint_candidates[m] <= library.scene.size());
+		matched += expected.size();
+	}
+	// Every perturbed model feature of the scene is matched (the shared ones by both models).
+	TEST_CHECK(matched >= library.scene.size() - 50);
+}
+
+/// Neighbours per query stay at joint_knn (at least 2) regardless of the library size.
+void testJointNeighbours() {
+	ModelMatcher::Params params;
+	params.joint_knn = 5;
+	TEST_CHECK(ModelMatcher(params).jointNeighbours(1000) == 5);
+	TEST_CHECK(ModelMatcher(params).jointNeighbours(3) == 3);
+	params.joint_knn = 1;
+	TEST_CHECK(ModelMatcher(params).jointNeighbours(1000) == 2);
+}
+
+/// The distance cutoff and the ratio test.
+void testAccept() {
+	ModelMatcher::Params params;
+	params.max_distance = 10;
+	params.ratio = 0.5f;
+	ModelMatcher matcher(params);
+	TEST_CHECK(matcher.accept(99, -1));
+	TEST_CHECK(!matcher.accept(101, -1));
+	TEST_CHECK(matcher.accept(24, 100));
+	TEST_CHECK(!matcher.accept(25, 100));
+	params.use_ratio_test = false;
+	TEST_CHECK(ModelMatcher(params).accept(25, 100));
+}
+
+}
+
+int main() {
+	ModelMatcher::Params params;
+	testJointEqualsPerModel(params, DescriptorIndex::FLOAT32);
+	testJointEqualsPerModel(params, DescriptorIndex::UINT8);
+	// Most models appear once among the neighbours - second distances come from the bound or the per-model query.
+	params.joint_knn = 2;
+	testJointEqualsPerModel(params, DescriptorIndex::FLOAT32);
+	// All descriptors returned - identical to the per-model matching.
+	params.joint_knn = 1000;
+	testJointEqualsPerModel(params, DescriptorIndex::FLOAT32);
+	params.joint_knn = 5;
+	params.use_ratio_test = false;
+	params.max_distance = 150;
+	testJointEqualsPerModel(params, DescriptorIndex::FLOAT32);
+	testJointNeighbours();
+	testAccept();
+	return TEST_RESULT();
+}
@@ -0,0 +1,124 @@
+/*!
+ * \file
+ * \brief Unit test of MergeUtils point-to-plane ICP - recovery of a known motion, the report and the identity fallback.
+ */
+
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+#include <pcl/point_types.h>
+#include <pcl/common/transforms.h>
+
+#include <Types/MergeUtils.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<pcl::PointXYZRGBNormal> Cloud;
+
+/// Point with the given normal.
+pcl::PointXYZRGBNormal point(float x, float y, float z, float nx, float ny, float nz) {
+	pcl::PointXYZRGBNormal p;
+	p.x = x;
+	p.y = y;
+	p.z = z;
+	p.normal_x = nx;
+	p.normal_y = ny;
+	p.normal_z = nz;
+	p.r = p.g = p.b = 128;
+	return p;
+}
+
+/// Inner corner of a box - three orthogonal planes sampled on a grid with 1 cm spacing, together they constrain all six parameters.
+Cloud::Ptr corner() {
+	Cloud::Ptr cloud(new Cloud());
+	for (int i = 1; i <= 30; ++i)
+		for (int j = 1; j <= 30; ++j) {
+			const float u = 0.01f * i, v = 0.01f * j;
+			cloud->push_back(point(u, v, 0, 0, 0, 1));
+			cloud->push_back(point(0, u, v, 1, 0, 0));
+			cloud->push_back(point(u, 0, v, 0, 1, 0));
+		}
+	return cloud;
+}
+
+/// Small rigid motion - 2 degrees around a skew axis and a few millimetres.
+Eigen::Matrix4f motion() {
+	Eigen::Affine3f transformation = Eigen::Translation3f(0.006f, -0.004f, 0.005f)
+			* Eigen::AngleAxisf(2.0f * static_cast<float>(M_PI) / 180.0f, Eigen::Vector3f(1, 2, 3).normalized());
+	return transformation.matrix();
+}
+
+MergeUtils::Properties icpProperties() {
+	MergeUtils::Properties properties;
+	properties.ICP_max_iterations = 100;
+	properties.ICP_max_correspondence_distance = 0.04f;
+	properties.ICP_min_correspondence_distance = 0.01f;
+	properties.ICP_transformation_epsilon = 1e-10;
+	return properties;
+}
+
+/// The source is the target moved by the inverse of the motion - ICP recovers the motion.
+void testKnownMotion(int pyramid_levels) {
+	Cloud::Ptr target = corner();
+	Cloud::Ptr source(new Cloud());
+	const Eigen::Matrix4f expected = motion();
+	pcl::transformPointCloudWithNormals(*target, *source, Eigen::Matrix4f(expected.inverse()));
+
+	MergeUtils::Properties properties = icpProperties();
+	properties.ICP_pyramid_levels = pyramid_levels;
+	properties.ICP_pyramid_leaf = 0.02f;
+	properties.ICP_pyramid_fine_iterations = 50;
+	MergeUtils::ICPReport report;
+	Eigen::Matrix4f transformation = MergeUtils::computeTransformationICPNormals(source, target, properties, &report);
+
+	TEST_CHECK((transformation.topLeftCorner<3, 3>() - expected.topLeftCorner<3, 3>()).norm() < 1e-3f);
+	TEST_CHECK((transformation.topRightCorner<3, 1>() - expected.topRightCorner<3, 1>()).norm() < 1e-4f);
+	TEST_CHECK(report.converged);
+	TEST_CHECK(report.iterations > 0);
+	TEST_CHECK(report.iterations < properties.ICP_pyramid_fine_iterations);
+	// Aligned points coincide with the target ones.
+	TEST_CHECK(report.correspondences == static_cast<int>(source->size()));
+	TEST_CHECK(report.fitness < 1e-8);
+}
+
+/// Fewer than six correspondences cannot constrain the transformation - identity is returned.
+void testTooFewCorrespondences() {
+	Cloud::Ptr target = corner();
+	MergeUtils::Properties properties = icpProperties();
+	MergeUtils::ICPReport report;
+
+	// Five source points.
+	Cloud::Ptr source(new Cloud());
+	for (size_t i = 0; i < 5; ++i)
+		source->push_back(target->points[i * 7]);
+	source->points[0].x += 0.005f;
+	Eigen::Matrix4f transformation = MergeUtils::computeTransformationICPNormals(source, target, properties, &report);
+	TEST_CHECK(transformation == Eigen::Matrix4f::Identity());
+	TEST_CHECK(!report.converged);
+	TEST_CHECK(report.iterations == 1);
+	TEST_CHECK(report.correspondences == 5);
+
+	// A source beyond the correspondence distance.
+	pcl::transformPointCloudWithNormals(*target, *source, Eigen::Matrix4f(Eigen::Affine3f(Eigen::Translation3f(1, 1, 1)).matrix()));
+	transformation = MergeUtils::computeTransformationICPNormals(source, target, properties, &report);
+	TEST_CHECK(transformation == Eigen::Matrix4f::Identity());
+	TEST_CHECK(!report.converged);
+	TEST_CHECK(report.correspondences == 0);
+
+	// An empty target.
+	transformation = MergeUtils::computeTransformationICPNormals(source, Cloud::Ptr(new Cloud()), properties, &report);
+	TEST_CHECK(transformation == Eigen::Matrix4f::Identity());
+	TEST_CHECK(report.iterations == 0);
+}
+
+} //: namespace
+
+int main() {
+	testKnownMotion(0);
+	testKnownMotion(2);
+	testTooFewCorrespondences();
+	return TEST_RESULT();
+}
@@ -0,0 +1,139 @@
+/*!
+ * \file
+ * \brief Unit test of RigidSampleConsensus - known transformation recovered among outliers, early termination.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Eigen/Geometry>
+
+#include <pcl/point_types.h>
+
+#include <Types/RigidSampleConsensus.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+/// Correspondences of random points under a known transformation.
+struct Problem {
+	pcl::PointCloud<pcl::PointXYZ> src, trg;
+	pcl::Correspondences correspondences;
+	Eigen::Matrix4f transformation;
+	/// Positions of the true inliers in the correspondences, increasing.
+	std::vector<int> inliers;
+};
+
+/// Every pair is an outlier with the given percentage. Inliers get 1 mm of noise, outliers are moved at least 10 cm away.
+/// Inliers tend to have smaller (better) correspondence distances, as matched descriptors do.
+Problem makeProblem(unsigned seed, size_t size, int outlier_percent) {
+	boost::mt19937 rng(seed);
+	Problem problem;
+	Eigen::Affine3f transformation = Eigen::Translation3f(0.1f, 0.2f, -0.05f) * Eigen::AngleAxisf(0.4f, Eigen::Vector3f(0, 1, 1).normalized());
+	problem.transformation = transformation.matrix();
+	for (size_t i = 0; i < size; ++i) {
+		pcl::PointXYZ p;
+		p.x = Tests::uniform(rng, 0, 1);
+		p.y = Tests::uniform(rng, 0, 1);
+		p.z = Tests::uniform(rng, 0, 1);
+		Eigen::Vector3f v = transformation * p.getVector3fMap();
+		bool outlier = static_cast<int>(rng() % 100) < outlier_percent;
+		if (outlier) {
+			Eigen::Vector3f direction(Tests::uniform(rng, -1, 1), Tests::uniform(rng, -1, 1), Tests::uniform(rng, -1, 1));
+			v += (0.1f + Tests::uniform(rng, 0, 0.5f)) * direction.normalized();
+		} else {
+			v += Eigen::Vector3f(Tests::uniform(rng, -0.001f, 0.001f), Tests::uniform(rng, -0.001f, 0.001f), Tests::uniform(rng, -0.001f, 0.001f));
+			problem.inliers.push_back(i);
+		}
+		pcl::PointXYZ q;
+		q.x = v[0];
+		q.y = v[1];
+		q.z = v[2];
+		problem.src.push_back(p);
+		problem.trg.push_back(q);
+		problem.correspondences.push_back(pcl::Correspondence(i, i, outlier ? Tests::uniform(rng, 0, 1000) : Tests::uniform(rng, 0, 700)));
+	}
+	return problem;
+}
+
+/// Runs the estimation, checks the transformation and the inlier set, returns the number of iterations.
+int checkSolution(const Problem & problem, const RigidSampleConsensus::Params & params) {
+	RigidSampleConsensus sac(params);
+	sac.setCorrespondences(problem.src, problem.trg, problem.correspondences);
+	Eigen::Matrix4f transformation;
+	std::vector<int> inliers;
+	TEST_CHECK(sac.compute(transformation, inliers));
+	TEST_CHECK((transformation - problem.transformation).cwiseAbs().maxCoeff() < 0.005f);
+	TEST_CHECK(inliers == problem.inliers);
+	return sac.getIterations();
+}
+
+/// Half of the correspondences are outliers - both samplings stop long before the budget.
+void testHalfOutliers() {
+	Problem problem = makeProblem(1, 500, 50);
+	RigidSampleConsensus::Params params;
+	params.guided = false;
+	int uniform_iterations = checkSolution(problem, params);
+	TEST_CHECK(uniform_iterations < params.max_iterations / 10);
+	params.guided = true;
+	int guided_iterations = checkSolution(problem, params);
+	TEST_CHECK(guided_iterations < params.max_iterations / 10);
+	TEST_CHECK(guided_iterations <= uniform_iterations);
+}
+
+/// 90% of outliers - PROSAC exploits the better distances of inliers and still stops early, the result is the same.
+void testNinetyPercentOutliers() {
+	Problem problem = makeProblem(2, 500, 90);
+	RigidSampleConsensus::Params params;
+	params.max_iterations = 5000;
+	int guided_iterations = checkSolution(problem, params);
+	TEST_CHECK(guided_iterations < params.max_iterations);
+	params.guided = false;
+	int uniform_iterations = checkSolution(problem, params);
+	TEST_CHECK(guided_iterations < uniform_iterations);
+}
+
+/// Without early termination all hypotheses are drawn, the result does not depend on the number of threads.
+void testNoEarlyTermination() {
+	Problem problem = makeProblem(3, 300, 50);
+	RigidSampleConsensus::Params params;
+	params.max_iterations = 300;
+	params.confidence = 1;
+	TEST_CHECK(checkSolution(problem, params) == params.max_iterations);
+
+	RigidSampleConsensus single(params);
+	params.threads = 4;
+	RigidSampleConsensus multi(params);
+	single.setCorrespondences(problem.src, problem.trg, problem.correspondences);
+	multi.setCorrespondences(problem.src, problem.trg, problem.correspondences);
+	Eigen::Matrix4f single_transformation, multi_transformation;
+	std::vector<int> single_inliers, multi_inliers;
+	single.compute(single_transformation, single_inliers);
+	multi.compute(multi_transformation, multi_inliers);
+	TEST_CHECK(single_transformation == multi_transformation);
+	TEST_CHECK(single_inliers == multi_inliers);
+}
+
+/// Less than three correspondences give no hypothesis.
+void testTooFewCorrespondences() {
+	Problem problem = makeProblem(4, 2, 0);
+	RigidSampleConsensus sac;
+	sac.setCorrespondences(problem.src, problem.trg, problem.correspondences);
+	Eigen::Matrix4f transformation;
+	std::vector<int> inliers;
+	TEST_CHECK(!sac.compute(transformation, inliers));
+	TEST_CHECK(transformation == Eigen::Matrix4f::Identity());
+}
+
+} //: namespace
+
+int main() {
+	testHalfOutliers();
+	testNinetyPercentOutliers();
+	testNoEarlyTermination();
+	testTooFewCorrespondences();
+	return TEST_RESULT();
+}
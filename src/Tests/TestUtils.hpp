@@ -0,0 +1,61 @@
+/*!
+ * \file
+ * \brief Checks and fixtures used by the unit tests of the types.
+ */
+
+#ifndef TESTUTILS_HPP_
+#define TESTUTILS_HPP_
+
+#include <iostream>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <pcl/point_cloud.h>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+
+namespace Tests {
+
+/// Number of failed checks of the test.
+inline int & failures() {
+	static int count = 0;
+	return count;
+}
+
+/// Uniformly distributed value from [min, max).
+inline float uniform(boost::mt19937 & rng, float min, float max) {
+	return min + (max - min) * static_cast<float>(rng()) / 4294967296.0f;
+}
+
+/// Cloud with random integer (SIFT-like) descriptors from [0, max_value), coordinates of a point are its index.
+/// Small values keep the expanded distances exact in floats.
+inline pcl::PointCloud<PointXYZSIFT>::Ptr randomCloud(boost::mt19937 & rng, size_t size, int max_value = 256) {
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud(new pcl::PointCloud<PointXYZSIFT>());
+	cloud->points.resize(size);
+	cloud->width = size;
+	cloud->height = 1;
+	for (size_t i = 0; i < size; ++i) {
+		PointXYZSIFT & p = cloud->points[i];
+		p.x = p.y = p.z = static_cast<float>(i);
+		for (size_t d = 0; d < DescriptorDistance::SIFT_SIZE; ++d)
+			p.descriptor[d] = static_cast<float>(rng() % max_value);
+	}
+	return cloud;
+}
+
+} //: namespace Tests
+
+/// Reports the failed condition and marks the test as failed, the test goes on.
+#define TEST_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << std::endl; \
+			++Tests::failures(); \
+		} \
+	} while (0)
+
+/// Exit code of the test - non-zero if any check failed.
+#define TEST_RESULT() (Tests::failures() == 0 ? 0 : 1)
+
+#endif /* TESTUTILS_HPP_ */
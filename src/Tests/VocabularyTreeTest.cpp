@@ -0,0 +1,147 @@
+/*!
+ * \file
+ * \brief Unit test of VocabularyTree - retrieval of perturbed views and scores with incrementally maintained norms.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Types/VocabularyTree.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+typedef pcl::PointCloud<PointXYZSIFT> Cloud;
+
+/// Vocabulary tree scoring also with norms recomputed from scratch at every query.
+class ReferenceTree : public VocabularyTree {
+public:
+	explicit ReferenceTree(const Params & params) : VocabularyTree(params) {}
+
+	/// Scores of all views, with idf and norms of the views computed from the inverted file.
+	std::vector<float> referenceScores(const Cloud & cloud) const {
+		const float nr_views = clouds.size();
+		std::vector<float> idf(nr_words, 0.0f);
+		for (size_t w = 0; w < nr_words; ++w)
+			if (!inverted[w].empty())
+				idf[w] = std::log(nr_views / inverted[w].size());
+
+		std::vector<std::pair<int, float> > query_words;
+		histogram(cloud, query_words);
+		float query_norm = 0;
+		for (size_t i = 0; i < query_words.size(); ++i)
+			query_norm += query_words[i].second * idf[query_words[i].first];
+
+		std::vector<float> view_norms(clouds.size(), 0.0f);
+		for (size_t v = 0; v < view_words.size(); ++v)
+			for (size_t i = 0; i < view_words[v].size(); ++i)
+				view_norms[v] += view_words[v][i].second * idf[view_words[v][i].first];
+
+		std::vector<float> scores(clouds.size(), 0.0f);
+		for (size_t i = 0; i < query_words.size(); ++i) {
+			int w = query_words[i].first;
+			if (idf[w] <= 0)
+				continue;
+			for (size_t e = 0; e < inverted[w].size(); ++e)
+				scores[inverted[w][e].first] += std::min(query_words[i].second * idf[w] / query_norm, inverted[w][e].second * idf[w] / view_norms[inverted[w][e].first]);
+		}
+		return scores;
+	}
+};
+
+/// Copy of the cloud with descriptors shifted by random integers from [-amplitude, amplitude], kept in [0, 255].
+Cloud::Ptr perturbed(boost::mt19937 & rng, const Cloud & cloud, int amplitude) {
+	Cloud::Ptr copy(new Cloud(cloud));
+	for (size_t i = 0; i < copy->size(); ++i)
+		for (size_t d = 0; d < DescriptorDistance::SIFT_SIZE; ++d) {
+			int value = static_cast<int>(copy->points[i].descriptor[d]) + static_cast<int>(rng() % (2 * amplitude + 1)) - amplitude;
+			copy->points[i].descriptor[d] = static_cast<float>(std::max(0, std::min(255, value)));
+		}
+	return copy;
+}
+
+/// Scores of the query equal the reference scores of all views (the returned ones) and are sorted.
+void checkScores(ReferenceTree & tree, const Cloud::Ptr & query) {
+	std::vector<int> views;
+	std::vector<float> scores;
+	int k = tree.query(query, tree.size(), views, scores);
+	TEST_CHECK(k == static_cast<int>(tree.size()));
+	std::vector<float> reference = tree.referenceScores(*query);
+	for (int n = 0; n < k; ++n) {
+		TEST_CHECK(std::fabs(scores[n] - reference[views[n]]) < 1e-4f);
+		if (n > 0)
+			TEST_CHECK(scores[n] <= scores[n - 1]);
+	}
+}
+
+/// Views added after the training keep their norms (and those of views sharing their words) up to date.
+void testIncrementalNorms() {
+	boost::mt19937 rng(1);
+	VocabularyTree::Params params;
+	params.branching = 4;
+	params.depth = 3;
+	ReferenceTree tree(params);
+	std::vector<Cloud::Ptr> views;
+	for (int v = 0; v < 12; ++v) {
+		views.push_back(Tests::randomCloud(rng, 60));
+		TEST_CHECK(tree.addView(views.back()) == v);
+	}
+	// The first query trains the vocabulary.
+	checkScores(tree, perturbed(rng, *views[3], 8));
+	size_t words = tree.words();
+	TEST_CHECK(words > 0);
+
+	// Fewer new descriptors than trained on - the vocabulary stays, views are added to the inverted file.
+	for (int v = 0; v < 8; ++v) {
+		views.push_back(v % 3 == 0 ? perturbed(rng, *views[v], 8) : Tests::randomCloud(rng, 60));
+		tree.addView(views.back());
+		checkScores(tree, perturbed(rng, *views[v * 2], 8));
+		TEST_CHECK(tree.words() == words);
+	}
+
+	// A view without a cloud scores nothing.
+	tree.addView(Cloud::ConstPtr());
+	checkScores(tree, views[0]);
+}
+
+/// A perturbed copy of a view finds the view first, also after the vocabulary is retrained.
+void testRetrieval() {
+	boost::mt19937 rng(2);
+	VocabularyTree::Params params;
+	params.branching = 4;
+	params.depth = 3;
+	VocabularyTree tree(params);
+	std::vector<Cloud::Ptr> views;
+	std::vector<int> found;
+	std::vector<float> scores;
+	for (int round = 0; round < 2; ++round) {
+		for (int v = 0; v < 10; ++v) {
+			views.push_back(Tests::randomCloud(rng, 80));
+			tree.addView(views.back());
+		}
+		for (size_t v = 0; v < views.size(); ++v) {
+			TEST_CHECK(tree.query(perturbed(rng, *views[v], 8), 3, found, scores) == 3);
+			TEST_CHECK(!found.empty() && found[0] == static_cast<int>(v));
+		}
+	}
+
+	// Nothing to rank.
+	TEST_CHECK(tree.query(views[0], 0, found, scores) == 0);
+	TEST_CHECK(tree.query(Cloud::ConstPtr(), 3, found, scores) == 0);
+	TEST_CHECK(found.empty() && scores.empty());
+	tree.clear();
+	TEST_CHECK(tree.size() == 0 && tree.words() == 0);
+	TEST_CHECK(tree.query(views[0], 3, found, scores) == 0);
+}
+
+} //: namespace
+
+int main() {
+	testIncrementalNorms();
+	testRetrieval();
+	return TEST_RESULT();
+}
@@ -0,0 +1,99 @@
+/*!
+ * \file
+ * \brief Unit test of VoxelHashCloud - voxel means, point and view counts, in-place updates.
+ */
+
+#include <cmath>
+#include <limits>
+
+#include <Types/VoxelHashCloud.hpp>
+
+#include "TestUtils.hpp"
+
+namespace {
+
+pcl::PointXYZRGB point(float x, float y, float z, int r, int g, int b) {
+	pcl::PointXYZRGB p;
+	p.x = x;
+	p.y = y;
+	p.z = z;
+	p.r = r;
+	p.g = g;
+	p.b = b;
+	return p;
+}
+
+/// Points falling into one voxel are averaged, points of other voxels (also at negative coordinates) are kept apart.
+void testVoxelMeans() {
+	pcl::PointCloud<pcl::PointXYZRGB> view;
+	view.push_back(point(0.1f, 0.1f, 0.1f, 10, 20, 30));
+	view.push_back(point(0.3f, 0.3f, 0.3f, 30, 40, 51));
+	view.push_back(point(-0.1f, 0.1f, 0.1f, 100, 100, 100));
+	view.push_back(point(1.5f, 0.1f, 0.1f, 0, 0, 0));
+
+	VoxelHashCloud voxels(1.0f);
+	voxels.addView(view);
+	TEST_CHECK(voxels.size() == 3);
+	const pcl::PointCloud<pcl::PointXYZRGB> & cloud = *voxels.getCloud();
+	TEST_CHECK(cloud.size() == 3);
+	TEST_CHECK(cloud.width == 3 && cloud.height == 1);
+
+	TEST_CHECK(voxels.pointCount(0) == 2);
+	TEST_CHECK(std::abs(cloud.points[0].x - 0.2f) < 1e-6f);
+	TEST_CHECK(std::abs(cloud.points[0].z - 0.2f) < 1e-6f);
+	TEST_CHECK(cloud.points[0].r == 20 && cloud.points[0].g == 30 && cloud.points[0].b == 41);
+	TEST_CHECK(voxels.pointCount(1) == 1);
+	TEST_CHECK(cloud.points[1].x == -0.1f && cloud.points[1].r == 100);
+	TEST_CHECK(voxels.pointCount(2) == 1);
+	TEST_CHECK(cloud.points[2].x == 1.5f);
+}
+
+/// Views count once per voxel, untouched voxels keep their points, new voxels are appended.
+void testViews() {
+	VoxelHashCloud voxels(1.0f);
+	pcl::PointCloud<pcl::PointXYZRGB> first;
+	first.push_back(point(0.5f, 0.5f, 0.5f, 0, 0, 0));
+	first.push_back(point(0.6f, 0.5f, 0.5f, 0, 0, 0));
+	first.push_back(point(2.5f, 0.5f, 0.5f, 0, 0, 0));
+	voxels.addView(first);
+
+	pcl::PointCloud<pcl::PointXYZRGB> second;
+	second.push_back(point(0.7f, 0.5f, 0.5f, 0, 0, 0));
+	second.push_back(point(5.5f, 0.5f, 0.5f, 0, 0, 0));
+	voxels.addView(second);
+
+	TEST_CHECK(voxels.size() == 3);
+	TEST_CHECK(voxels.pointCount(0) == 3 && voxels.viewCount(0) == 2);
+	TEST_CHECK(std::abs(voxels.getCloud()->points[0].x - 0.6f) < 1e-6f);
+	TEST_CHECK(voxels.pointCount(1) == 1 && voxels.viewCount(1) == 1);
+	TEST_CHECK(voxels.getCloud()->points[1].x == 2.5f);
+	TEST_CHECK(voxels.viewCount(2) == 1);
+	TEST_CHECK(voxels.getCloud()->points[2].x == 5.5f);
+}
+
+/// NaNs are skipped, changing the leaf size clears the cloud in place.
+void testNaNsAndClear() {
+	VoxelHashCloud voxels(0.5f);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = voxels.getCloud();
+	pcl::PointCloud<pcl::PointXYZRGB> view;
+	view.push_back(point(std::numeric_limits<float>::quiet_NaN(), 0, 0, 0, 0, 0));
+	view.push_back(point(0.1f, 0.1f, 0.1f, 0, 0, 0));
+	voxels.addView(view);
+	TEST_CHECK(voxels.size() == 1);
+	TEST_CHECK(cloud->size() == 1);
+
+	voxels.setLeafSize(0.25f);
+	TEST_CHECK(voxels.getLeafSize() == 0.25f);
+	TEST_CHECK(voxels.size() == 0);
+	TEST_CHECK(voxels.getCloud() == cloud);
+	TEST_CHECK(cloud->empty());
+}
+
+} //: namespace
+
+int main() {
+	testVoxelMeans();
+	testViews();
+	testNaNsAndClear();
+	return TEST_RESULT();
+}
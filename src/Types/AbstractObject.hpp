@@ -10,6 +10,9 @@ class AbstractObject
 	/// Name of the object.
 	string name;
 
+	/// File the object was read from (empty if it was not read from a file).
+	string filename;
+
 	virtual ~AbstractObject() {}
 };
 
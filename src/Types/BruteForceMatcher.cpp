@@ -0,0 +1,99 @@
+/*!
+ * \file
+ * \brief Exhaustive SIFT descriptor matching with blocked matrix products.
+ */
+
+#include "BruteForceMatcher.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <pcl/pcl_macros.h>
+
+#include <Types/DescriptorDistance.hpp>
+
+BruteForceMatcher::BruteForceMatcher() {
+}
+
+BruteForceMatcher::BruteForceMatcher(const Params & params) : params(params) {
+}
+
+void BruteForceMatcher::pack(const pcl::PointCloud<PointXYZSIFT> & cloud, DescriptorMatrix & descriptors, std::vector<int> & point_indices) {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	point_indices.clear();
+	point_indices.reserve(cloud.size());
+	for (size_t i = 0; i < cloud.size(); ++i) {
+		// Skip NaNs.
+		if (pcl_isfinite(cloud.points[i].descriptor[0]))
+			point_indices.push_back(static_cast<int>(i));
+	}
+	descriptors.resize(point_indices.size(), dim);
+	for (size_t r = 0; r < point_indices.size(); ++r)
+		std::copy(cloud.points[point_indices[r]].descriptor, cloud.points[point_indices[r]].descriptor + dim, descriptors.row(r).data());
+}
+
+void BruteForceMatcher::match(const pcl::PointCloud<PointXYZSIFT> & cloud_src, const pcl::PointCloud<PointXYZSIFT> & cloud_trg, pcl::Correspondences & correspondences) const {
+	correspondences.clear();
+	DescriptorMatrix src, trg;
+	std::vector<int> src_points, trg_points;
+	pack(cloud_src, src, src_points);
+	pack(cloud_trg, trg, trg_points);
+	const int n = src.rows(), m = trg.rows();
+	if (n == 0 || m == 0)
+		return;
+
+	const Eigen::VectorXf src_norms = src.rowwise().squaredNorm();
+	const Eigen::VectorXf trg_norms = trg.rowwise().squaredNorm();
+
+	// Two nearest targets of every source and the nearest source of every target.
+	const float inf = std::numeric_limits<float>::max();
+	std::vector<float> best(n, inf), second(n, inf), trg_best(m, inf);
+	std::vector<int> best_trg(n, -1), best_src(m, -1);
+
+	const int block = std::max(params.block, 1);
+	Eigen::MatrixXf tile;
+	for (int j0 = 0; j0 < m; j0 += block) {
+		const int bj = std::min(block, m - j0);
+		for (int i0 = 0; i0 < n; i0 += block) {
+			const int bi = std::min(block, n - i0);
+			// Column-major tile - column c holds products of target j0 + c with the block of sources.
+			tile.noalias() = src.middleRows(i0, bi) * trg.middleRows(j0, bj).transpose();
+			for (int c = 0; c < bj; ++c) {
+				const int j = j0 + c;
+				const float * products = tile.col(c).data();
+				for (int r = 0; r < bi; ++r) {
+					const int i = i0 + r;
+					// Rounding may give small negative values for (almost) equal descriptors.
+					const float d = std::max(src_norms[i] + trg_norms[j] - 2.0f * products[r], 0.0f);
+					if (d < best[i]) {
+						second[i] = best[i];
+						best[i] = d;
+						best_trg[i] = j;
+					} else if (d < second[i]) {
+						second[i] = d;
+					}
+					if (d < trg_best[j]) {
+						trg_best[j] = d;
+						best_src[j] = i;
+					}
+				}
+			}
+		}
+	}
+
+	// Distances are squared, so are the ratio and the cutoff.
+	const float sqr_ratio = params.ratio * params.ratio;
+	const float sqr_max_distance = params.max_distance * params.max_distance;
+	correspondences.reserve(n);
+	for (int i = 0; i < n; ++i) {
+		const int j = best_trg[i];
+		if (params.reciprocal && best_src[j] != i)
+			continue;
+		if (params.max_distance > 0 && best[i] > sqr_max_distance)
+			continue;
+		if (params.ratio > 0 && second[i] < inf && best[i] >= sqr_ratio * second[i])
+			continue;
+		// The expanded form loses precision for large norms - the reported distance is computed directly.
+		correspondences.push_back(pcl::Correspondence(src_points[i], trg_points[j], DescriptorDistance::l2Sqr(src.row(i).data(), trg.row(j).data())));
+	}
+}
@@ -0,0 +1,70 @@
+/*!
+ * \file
+ * \brief Exhaustive SIFT descriptor matching with blocked matrix products.
+ */
+
+#ifndef BRUTEFORCEMATCHER_HPP_
+#define BRUTEFORCEMATCHER_HPP_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+
+#include <Types/PointXYZSIFT.hpp>
+
+/*!
+ * \class BruteForceMatcher
+ * \brief Matches all descriptors of two (small) clouds computing every pairwise distance.
+ *
+ * Squared distances are expanded to ||a||^2 + ||b||^2 - 2 a.b, so a tile of
+ * distances is a single matrix product of two blocks of descriptors (Eigen GEMM).
+ * Tiles are small enough to stay in the cache and are reduced on the fly to the
+ * two nearest neighbours of every source and the nearest neighbour of every target
+ * descriptor, from which the reciprocal and ratio test filtering is done.
+ *
+ * For clouds of up to a few thousand features this is much faster than building
+ * and querying kd-trees, which in 128 dimensions visit most of the leaves anyway.
+ */
+class BruteForceMatcher {
+public:
+	/// Matching parameters.
+	struct Params {
+		/// Keep only matches being mutual nearest neighbours.
+		bool reciprocal;
+
+		/// Lowe's ratio of the distances to the nearest and second nearest target descriptor (0 - disabled).
+		float ratio;
+
+		/// Maximal descriptor distance of a match (0 - no limit).
+		float max_distance;
+
+		/// Number of descriptors in a block - a tile holds block x block distances.
+		int block;
+
+		Params() : reciprocal(true), ratio(0), max_distance(0), block(128) {}
+	};
+
+	BruteForceMatcher();
+
+	explicit BruteForceMatcher(const Params & params);
+
+	void setParams(const Params & params) { this->params = params; }
+
+	const Params & getParams() const { return params; }
+
+	/// Finds correspondences (source -> target point indices, squared distances) between finite descriptors of the clouds.
+	void match(const pcl::PointCloud<PointXYZSIFT> & cloud_src, const pcl::PointCloud<PointXYZSIFT> & cloud_trg, pcl::Correspondences & correspondences) const;
+
+protected:
+	typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> DescriptorMatrix;
+
+	/// Copies finite descriptors of the cloud into rows of the matrix, stores their point indices.
+	static void pack(const pcl::PointCloud<PointXYZSIFT> & cloud, DescriptorMatrix & descriptors, std::vector<int> & point_indices);
+
+	Params params;
+};
+
+#endif /* BRUTEFORCEMATCHER_HPP_ */
@@ -8,13 +8,19 @@
 #ifndef CORRESPONDENCE_ESTIMATION_COLOR_H_
 #define CORRESPONDENCE_ESTIMATION_COLOR_H_
 
+#include <cmath>
 #include <string>
 #include <iostream>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 #include <pcl/pcl_base.h>
 #include <pcl/common/transforms.h>
 #include <pcl/search/kdtree.h>
 #include <pcl/pcl_macros.h>
+#include <pcl/point_representation.h>
+#include <pcl/common/distances.h>
 
 #include <pcl/registration/correspondence_types.h>
 #include <pcl/registration/correspondence_estimation.h>
@@ -24,14 +30,78 @@
 
 namespace pcl {
 namespace registration {
+
+/*!
+ * \class LabPointRepresentation
+ * \brief Point as < x, y, z, w L*, w a*, w b* > - coordinates followed by the weighted CIE Lab colour.
+ *
+ * Euclidean distance in this space combines the spatial distance with the
+ * perceptual colour difference, the weight converts Lab units into metres.
+ */
+template<typename PointT>
+class LabPointRepresentation: public pcl::PointRepresentation<PointT> {
+	using pcl::PointRepresentation<PointT>::nr_dimensions_;
+public:
+	typedef boost::shared_ptr<LabPointRepresentation<PointT> > Ptr;
+	typedef boost::shared_ptr<const LabPointRepresentation<PointT> > ConstPtr;
+
+	explicit LabPointRepresentation(float color_weight = 0.001f) : color_weight_(color_weight) {
+		nr_dimensions_ = 6;
+		// sRGB components to linear intensities.
+		for (int i = 0; i < 256; ++i) {
+			float c = i / 255.0f;
+			linear_[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+	}
+
+	virtual void copyToFloatArray(const PointT &p, float * out) const {
+		out[0] = p.x;
+		out[1] = p.y;
+		out[2] = p.z;
+
+		// Linear RGB to XYZ (D65 white), normalized by the white point.
+		float r = linear_[p.r], g = linear_[p.g], b = linear_[p.b];
+		float fx = labFunction((0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f);
+		float fy = labFunction(0.2126f * r + 0.7152f * g + 0.0722f * b);
+		float fz = labFunction((0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f);
+		out[3] = color_weight_ * (116.0f * fy - 16.0f);
+		out[4] = color_weight_ * 500.0f * (fx - fy);
+		out[5] = color_weight_ * 200.0f * (fy - fz);
+	}
+
+	float getColorWeight() const {
+		return color_weight_;
+	}
+
+protected:
+	static float labFunction(float t) {
+		return t > 0.008856f ? std::pow(t, 1.0f / 3.0f) : 7.787f * t + 16.0f / 116.0f;
+	}
+
+	float color_weight_;
+
+	float linear_[256];
+};
+
+/*!
+ * \class CorrespondenceEstimationColor
+ * \brief Correspondence estimation matching points by coordinates and colour at once.
+ *
+ * Both search trees use LabPointRepresentation, so a single nearest neighbour
+ * query returns the best colour-geometric match. The representation is also
+ * installed in the trees set by the registration (which replaces the trees of
+ * the estimation with its own ones) before they are searched. The maximal distance limits
+ * the spatial distance of the matched points, which is also the reported one.
+ * Source points are searched in contiguous blocks by several threads.
+ */
 template<typename PointSource, typename PointTarget, typename Scalar = float>
 class CorrespondenceEstimationColor: // public CorrespondenceEstimationBase<PointSource, PointTarget, Scalar>,
 public CorrespondenceEstimation<PointSource, PointTarget, Scalar> {
 public:
 	typedef boost::shared_ptr<
-			CorrespondenceEstimation<PointSource, PointTarget, Scalar> > Ptr;
+			CorrespondenceEstimationColor<PointSource, PointTarget, Scalar> > Ptr;
 	typedef boost::shared_ptr<
-			const CorrespondenceEstimation<PointSource, PointTarget, Scalar> > ConstPtr;
+			const CorrespondenceEstimationColor<PointSource, PointTarget, Scalar> > ConstPtr;
 
 	using CorrespondenceEstimationBase<PointSource, PointTarget, Scalar>::point_representation_;
 	using CorrespondenceEstimationBase<PointSource, PointTarget, Scalar>::input_transformed_;
@@ -62,14 +132,39 @@ public:
 	typedef typename KdTree::PointRepresentationConstPtr PointRepresentationConstPtr;
 
 	/** \brief Empty constructor. */
-	CorrespondenceEstimationColor() {
+	CorrespondenceEstimationColor() : nr_threads_(1) {
 		corr_name_ = "CorrespondenceEstimationColor";
+		setColorWeight(0.001f);
 	}
 
 	/** \brief Empty destructor */
 	virtual ~CorrespondenceEstimationColor() {
 	}
 
+	/** \brief Set the weight of the colour (metres per unit of the Lab distance), 0 - spatial search only.
+	 * Search trees are rebuilt with the new representation when they are searched next time.
+	 */
+	void setColorWeight(float color_weight) {
+		color_weight_ = color_weight;
+		target_representation_.reset(new LabPointRepresentation<PointTarget>(color_weight));
+		source_representation_.reset(new LabPointRepresentation<PointSource>(color_weight));
+		// Used by initCompute() whenever the target tree is built.
+		this->setPointRepresentation(target_representation_);
+	}
+
+	float getColorWeight() const {
+		return color_weight_;
+	}
+
+	/** \brief Set the number of threads searching the correspondences (1 - sequential, the default, 0 - one per core). */
+	void setNumberOfThreads(int nr_threads) {
+		nr_threads_ = nr_threads;
+	}
+
+	int getNumberOfThreads() const {
+		return nr_threads_;
+	}
+
 	/** \brief Determine the correspondences between input and target cloud.
 	 * \param[out] correspondences the found correspondences (index of query point, index of target point, distance)
 	 * \param[in] max_distance maximum allowed distance between correspondences
@@ -79,183 +174,209 @@ public:
 
 		if (!initCompute())
 			return;
+		useLabRepresentation(false);
 
-		double max_dist_sqr = max_distance * max_distance;
+		computeInBlocks(&CorrespondenceEstimationColor::correspondencesInRange, max_distance * max_distance, correspondences);
+		deinitCompute();
+	}
 
-		correspondences.resize(indices_->size());
+	/** \brief Determine the reciprocal correspondences between input and target cloud.
+	 * A correspondence is considered reciprocal if both Src_i has Tgt_i as a
+	 * correspondence, and Tgt_i has Src_i as one.
+	 *
+	 * \param[out] correspondences the found correspondences (index of query and target point, distance)
+	 * \param[in] max_distance maximum allowed distance between correspondences
+	 */
+	virtual void determineReciprocalCorrespondences(
+			pcl::Correspondences &correspondences, double max_distance =
+					std::numeric_limits<double>::max()) {
 
-		std::vector<int> index(1);
-		std::vector<float> distance(1);
-		std::vector<float> distanceRGB(1);
+		if (!initCompute())
+			return;
+
+		// setup tree for reciprocal search
+		// Set the internal point representation of choice
+		if (!initComputeReciprocal())
+			return;
+		useLabRepresentation(true);
 
-		//narazie na pale
-		float minRGB = 2000;
-		int minIndex = -2;
-		float distance_ = 1000;
+		computeInBlocks(&CorrespondenceEstimationColor::reciprocalCorrespondencesInRange, max_distance * max_distance, correspondences);
+		deinitCompute();
+	}
 
+	/** \brief Clone and cast to CorrespondenceEstimationBase */
+	virtual boost::shared_ptr<
+			CorrespondenceEstimationBase<PointSource, PointTarget, Scalar> > clone() const {
+		Ptr copy(
+				new CorrespondenceEstimationColor<PointSource, PointTarget, Scalar>(
+						*this));
+		return (copy);
+	}
+
+protected:
+	/// Searches correspondences of the source indices [begin, end) and appends them to the output.
+	typedef void (CorrespondenceEstimationColor::*RangeFunction)(size_t begin, size_t end, double max_dist_sqr, pcl::Correspondences * correspondences) const;
+
+	/** \brief Installs the Lab representation in the search trees which do not use it yet (the tree is rebuilt).
+	 * Registration::initCompute() replaces the trees with its own ones, built with the default representation.
+	 */
+	void useLabRepresentation(bool reciprocal) {
+		if (tree_->getPointRepresentation() != target_representation_)
+			tree_->setPointRepresentation(target_representation_);
+		if (reciprocal && tree_reciprocal_->getPointRepresentation() != source_representation_)
+			tree_reciprocal_->setPointRepresentation(source_representation_);
+	}
+
+	/// Minimal number of source points of a thread.
+	static const size_t MIN_BLOCK_SIZE = 1000;
+
+	/** \brief Splits the source indices into contiguous blocks searched by separate threads.
+	 * Every thread fills its own buffer, buffers are concatenated in the block order,
+	 * so the result is the same as of a single thread.
+	 */
+	void computeInBlocks(RangeFunction function, double max_dist_sqr, pcl::Correspondences &correspondences) const {
+		const size_t size = indices_->size();
+		int threads = nr_threads_ > 0 ? nr_threads_ : std::max(1u, boost::thread::hardware_concurrency());
+		threads = std::max<int>(1, std::min<size_t>(threads, size / MIN_BLOCK_SIZE));
+
+		correspondences.clear();
+		if (threads == 1) {
+			(this->*function)(0, size, max_dist_sqr, &correspondences);
+			return;
+		}
+
+		std::vector<pcl::Correspondences> blocks(threads);
+		boost::thread_group group;
+		for (int t = 0; t < threads; ++t)
+			group.create_thread(boost::bind(function, this, size * t / threads, size * (t + 1) / threads, max_dist_sqr, &blocks[t]));
+		group.join_all();
+
+		size_t total = 0;
+		for (int t = 0; t < threads; ++t)
+			total += blocks[t].size();
+		correspondences.reserve(total);
+		for (int t = 0; t < threads; ++t)
+			correspondences.insert(correspondences.end(), blocks[t].begin(), blocks[t].end());
+	}
+
+	void correspondencesInRange(size_t begin, size_t end, double max_dist_sqr, pcl::Correspondences * correspondences) const {
+		std::vector<int> index(1);
+		std::vector<float> distance(1);
 		pcl::Correspondence corr;
-		unsigned int nr_valid_correspondences = 0;
+		correspondences->reserve(correspondences->size() + end - begin);
 
 		// Check if the template types are the same. If true, avoid a copy.
 		// Both point types MUST be registered using the POINT_CLOUD_REGISTER_POINT_STRUCT macro!
 		if (isSamePointType<PointSource, PointTarget>()) {
 			// Iterate over the input set of source indices
-			for (std::vector<int>::const_iterator idx = indices_->begin(); idx != indices_->end(); ++idx) {
-
-				int r = input_->points[*idx].r;
-				int g = input_->points[*idx].g;
-				int b = input_->points[*idx].b;
-
-				tree_->nearestKSearch (input_->points[*idx], 25, index, distance);
-				float mindist = distance[24];
-				float minrgbdist = 999999;
-				int minind = 24;
-				for (int i = 0; i < index.size(); i++) {
-
-					int rr = target_->points[index[i]].r;
-					int gg = target_->points[index[i]].g;
-					int bb = target_->points[index[i]].b;
-
-					float rd = r - rr;
-					float gd = g - gg;
-					float bd = b - bb;
-
-					float distancergb = sqrt(rd*rd + gd*gd + bd*bd);
-
-					if (distancergb < minrgbdist) {
-						minrgbdist = distancergb;
-						minind = i;
-						mindist = distance[i];
-					}
-				}
-				if (mindist > max_dist_sqr)
+			for (size_t i = begin; i < end; ++i) {
+				const int idx = (*indices_)[i];
+				// Closest point in the colour-geometric space.
+				tree_->nearestKSearch(input_->points[idx], 1, index, distance);
+				float sqr_dist = pcl::squaredEuclideanDistance(input_->points[idx], target_->points[index[0]]);
+				if (sqr_dist > max_dist_sqr)
 					continue;
 
-				corr.index_query = *idx;
-				corr.index_match = index[minind];
-				corr.distance = mindist;
-				correspondences[nr_valid_correspondences++] = corr;
+				corr.index_query = idx;
+				corr.index_match = index[0];
+				corr.distance = sqr_dist;
+				correspondences->push_back(corr);
 			}
 		} else {
 			PointTarget pt;
 			// Iterate over the input set of source indices
-			for (std::vector<int>::const_iterator idx = indices_->begin();
-					idx != indices_->end(); ++idx) {
+			for (size_t i = begin; i < end; ++i) {
+				const int idx = (*indices_)[i];
 				// Copy the source data to a target PointTarget format so we can search in the tree
-				pt = input_->points[*idx];
+				pt = input_->points[idx];
 
 				tree_->nearestKSearch(pt, 1, index, distance);
-				if (distance[0] > max_dist_sqr)
+				float sqr_dist = pcl::squaredEuclideanDistance(pt, target_->points[index[0]]);
+				if (sqr_dist > max_dist_sqr)
 					continue;
 
-				corr.index_query = *idx;
+				corr.index_query = idx;
 				corr.index_match = index[0];
-				corr.distance = distance[0];
-				correspondences[nr_valid_correspondences++] = corr;
+				corr.distance = sqr_dist;
+				correspondences->push_back(corr);
 			}
 		}
-		correspondences.resize(nr_valid_correspondences);
-		deinitCompute();
 	}
 
-	/** \brief Determine the reciprocal correspondences between input and target cloud.
-	 * A correspondence is considered reciprocal if both Src_i has Tgt_i as a
-	 * correspondence, and Tgt_i has Src_i as one.
-	 *
-	 * \param[out] correspondences the found correspondences (index of query and target point, distance)
-	 * \param[in] max_distance maximum allowed distance between correspondences
-	 */
-	virtual void determineReciprocalCorrespondences(
-			pcl::Correspondences &correspondences, double max_distance =
-					std::numeric_limits<double>::max()) {
-
-		if (!initCompute())
-			return;
-
-		// setup tree for reciprocal search
-		// Set the internal point representation of choice
-		if (!initComputeReciprocal())
-			return;
-		double max_dist_sqr = max_distance * max_distance;
-
-		correspondences.resize(indices_->size());
+	void reciprocalCorrespondencesInRange(size_t begin, size_t end, double max_dist_sqr, pcl::Correspondences * correspondences) const {
 		std::vector<int> index(1);
 		std::vector<float> distance(1);
 		std::vector<int> index_reciprocal(1);
 		std::vector<float> distance_reciprocal(1);
 		pcl::Correspondence corr;
-		unsigned int nr_valid_correspondences = 0;
 		int target_idx = 0;
+		correspondences->reserve(correspondences->size() + end - begin);
 
 		// Check if the template types are the same. If true, avoid a copy.
 		// Both point types MUST be registered using the POINT_CLOUD_REGISTER_POINT_STRUCT macro!
 		if (isSamePointType<PointSource, PointTarget>()) {
 			// Iterate over the input set of source indices
-			for (std::vector<int>::const_iterator idx = indices_->begin();
-					idx != indices_->end(); ++idx) {
-				tree_->nearestKSearch(input_->points[*idx], 1, index, distance);
-
-				if (distance[0] > max_dist_sqr)
-					continue;
+			for (size_t i = begin; i < end; ++i) {
+				const int idx = (*indices_)[i];
+				tree_->nearestKSearch(input_->points[idx], 1, index, distance);
 
 				target_idx = index[0];
+				float sqr_dist = pcl::squaredEuclideanDistance(input_->points[idx], target_->points[target_idx]);
+				if (sqr_dist > max_dist_sqr)
+					continue;
 
 				tree_reciprocal_->nearestKSearch(target_->points[target_idx], 1,
 						index_reciprocal, distance_reciprocal);
-				if (distance_reciprocal[0] > max_dist_sqr
-						|| *idx != index_reciprocal[0])
+				if (idx != index_reciprocal[0])
 					continue;
 
-				corr.index_query = *idx;
-				corr.index_match = index[0];
-				corr.distance = distance[0];
-				correspondences[nr_valid_correspondences++] = corr;
+				corr.index_query = idx;
+				corr.index_match = target_idx;
+				corr.distance = sqr_dist;
+				correspondences->push_back(corr);
 			}
 		} else {
 			PointTarget pt_src;
 			PointSource pt_tgt;
 
 			// Iterate over the input set of source indices
-			for (std::vector<int>::const_iterator idx = indices_->begin();
-					idx != indices_->end(); ++idx) {
+			for (size_t i = begin; i < end; ++i) {
+				const int idx = (*indices_)[i];
 				// Copy the source data to a target PointTarget format so we can search in the tree
-				pt_src = input_->points[*idx];
+				pt_src = input_->points[idx];
 
 				tree_->nearestKSearch(pt_src, 1, index, distance);
-				//
-
-				if (distance[0] > max_dist_sqr)
-					continue;
 
 				target_idx = index[0];
+				float sqr_dist = pcl::squaredEuclideanDistance(pt_src, target_->points[target_idx]);
+				if (sqr_dist > max_dist_sqr)
+					continue;
 
 				// Copy the target data to a target PointSource format so we can search in the tree_reciprocal
 				pt_tgt = target_->points[target_idx];
 
 				tree_reciprocal_->nearestKSearch(pt_tgt, 1, index_reciprocal,
 						distance_reciprocal);
-				if (distance_reciprocal[0] > max_dist_sqr
-						|| *idx != index_reciprocal[0])
+				if (idx != index_reciprocal[0])
 					continue;
 
-				corr.index_query = *idx;
-				corr.index_match = index[0];
-				corr.distance = distance[0];
-				correspondences[nr_valid_correspondences++] = corr;
+				corr.index_query = idx;
+				corr.index_match = target_idx;
+				corr.distance = sqr_dist;
+				correspondences->push_back(corr);
 			}
 		}
-		correspondences.resize(nr_valid_correspondences);
-		deinitCompute();
 	}
 
-	/** \brief Clone and cast to CorrespondenceEstimationBase */
-	virtual boost::shared_ptr<
-			CorrespondenceEstimationBase<PointSource, PointTarget, Scalar> > clone() const {
-		Ptr copy(
-				new CorrespondenceEstimation<PointSource, PointTarget, Scalar>(
-						*this));
-		return (copy);
-	}
+	/// Weight of the Lab colour in the search space.
+	float color_weight_;
+
+	/// Representations of the target and source search trees.
+	typename LabPointRepresentation<PointTarget>::ConstPtr target_representation_;
+	typename LabPointRepresentation<PointSource>::ConstPtr source_representation_;
+
+	/// Number of threads (0 - one per core).
+	int nr_threads_;
 };
 }
 }
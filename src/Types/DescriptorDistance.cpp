@@ -0,0 +1,192 @@
+/*!
+ * \file
+ * \brief Vectorized distance kernels for SIFT descriptors - scalar/SSE kernels and CPU dispatch.
+ */
+
+#include "DescriptorDistance.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef SIFTOBJECTMODEL_WITH_AVX2
+// Kernels compiled with -mavx2 -mfma in DescriptorDistanceAVX2.cpp.
+float descriptorL2SqrAVX2(const float * a, const float * b, size_t size);
+float descriptorDotAVX2(const float * a, const float * b, size_t size);
+float descriptorL2SqrU8AVX2(const unsigned char * a, const unsigned char * b, size_t size);
+#endif
+
+namespace {
+
+typedef float (*DistanceKernel)(const float *, const float *, size_t);
+typedef float (*DistanceKernelU8)(const unsigned char *, const unsigned char *, size_t);
+
+float l2SqrScalar(const float * a, const float * b, size_t size)
+{
+	float sum = 0;
+	for (size_t i = 0; i < size; ++i) {
+		float d = a[i] - b[i];
+		sum += d * d;
+	}
+	return sum;
+}
+
+float dotScalar(const float * a, const float * b, size_t size)
+{
+	float sum = 0;
+	for (size_t i = 0; i < size; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+float l2SqrU8Scalar(const unsigned char * a, const unsigned char * b, size_t size)
+{
+	int sum = 0;
+	for (size_t i = 0; i < size; ++i) {
+		int d = int(a[i]) - int(b[i]);
+		sum += d * d;
+	}
+	return float(sum);
+}
+
+#if defined(__SSE2__)
+inline float horizontalSum(__m128 v)
+{
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+}
+
+float l2SqrSSE(const float * a, const float * b, size_t size)
+{
+	// Two independent accumulators hide the latency of the adds.
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+	}
+	float sum = horizontalSum(_mm_add_ps(acc0, acc1));
+	return sum + l2SqrScalar(a + i, b + i, size - i);
+}
+
+float dotSSE(const float * a, const float * b, size_t size)
+{
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	float sum = horizontalSum(_mm_add_ps(acc0, acc1));
+	return sum + dotScalar(a + i, b + i, size - i);
+}
+
+float l2SqrU8SSE(const unsigned char * a, const unsigned char * b, size_t size)
+{
+	// Bytes are widened to 16 bits, squares of differences summed in pairs into 32-bit lanes
+	// (128 x 255^2 fits easily, so the result is exact).
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		__m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+		__m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(dlo, dlo));
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(dhi, dhi));
+	}
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return float(_mm_cvtsi128_si32(acc)) + l2SqrU8Scalar(a + i, b + i, size - i);
+}
+#endif
+
+bool cpuHasAVX2()
+{
+#if defined(SIFTOBJECTMODEL_WITH_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif
+}
+
+struct KernelSet {
+	DistanceKernel l2;
+	DistanceKernel dot;
+	DistanceKernelU8 l2u8;
+	const char * name;
+
+	KernelSet() : l2(&l2SqrScalar), dot(&dotScalar), l2u8(&l2SqrU8Scalar), name("scalar") {
+#if defined(__SSE2__)
+		l2 = &l2SqrSSE;
+		dot = &dotSSE;
+		l2u8 = &l2SqrU8SSE;
+		name = "sse";
+#endif
+#ifdef SIFTOBJECTMODEL_WITH_AVX2
+		if (cpuHasAVX2()) {
+			l2 = &descriptorL2SqrAVX2;
+			dot = &descriptorDotAVX2;
+			l2u8 = &descriptorL2SqrU8AVX2;
+			name = "avx2";
+		}
+#endif
+	}
+};
+
+/// Returns kernels selected on first use (safe to call from other static initializers).
+const KernelSet & kernels()
+{
+	static const KernelSet set;
+	return set;
+}
+
+} //: namespace
+
+
+float DescriptorDistance::l2Sqr(const float * a, const float * b)
+{
+	return kernels().l2(a, b, SIFT_SIZE);
+}
+
+float DescriptorDistance::l2Sqr(const float * a, const float * b, size_t size)
+{
+	return kernels().l2(a, b, size);
+}
+
+float DescriptorDistance::dot(const float * a, const float * b)
+{
+	return kernels().dot(a, b, SIFT_SIZE);
+}
+
+float DescriptorDistance::dot(const float * a, const float * b, size_t size)
+{
+	return kernels().dot(a, b, size);
+}
+
+float DescriptorDistance::l2SqrU8(const unsigned char * a, const unsigned char * b, size_t size)
+{
+	return kernels().l2u8(a, b, size);
+}
+
+void DescriptorDistance::quantizeU8(const float * in, unsigned char * out, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		float v = in[i] + 0.5f;
+		out[i] = v <= 0 ? 0 : (v >= 255 ? 255 : static_cast<unsigned char>(v));
+	}
+}
+
+const char * DescriptorDistance::backendName()
+{
+	return kernels().name;
+}
@@ -0,0 +1,94 @@
+/*!
+ * \file
+ * \brief Vectorized distance kernels for SIFT descriptors.
+ */
+
+#ifndef DESCRIPTORDISTANCE_HPP_
+#define DESCRIPTORDISTANCE_HPP_
+
+#include <cstddef>
+
+/*!
+ * \class DescriptorDistance
+ * \brief Squared L2 and dot-product kernels over float and 8-bit descriptors.
+ *
+ * The implementation (scalar, SSE or AVX2+FMA) is selected once at startup
+ * basing on the features reported by the CPU, so a single binary runs on every
+ * machine and still uses the widest available registers.
+ * Descriptors do not have to be aligned, but 32-byte aligned rows avoid
+ * split loads on the AVX2 path.
+ */
+class DescriptorDistance {
+public:
+	/// Number of dimensions of the SIFT descriptor.
+	static const size_t SIFT_SIZE = 128;
+
+	/// Squared euclidean distance between two SIFT descriptors.
+	static float l2Sqr(const float * a, const float * b);
+
+	/// Squared euclidean distance between two descriptors of the given length.
+	static float l2Sqr(const float * a, const float * b, size_t size);
+
+	/// Dot product of two SIFT descriptors.
+	static float dot(const float * a, const float * b);
+
+	/// Dot product of two descriptors of the given length.
+	static float dot(const float * a, const float * b, size_t size);
+
+	/// Squared euclidean distance between two 8-bit descriptors of the given length (computed exactly in integers).
+	static float l2SqrU8(const unsigned char * a, const unsigned char * b, size_t size);
+
+	/// Quantizes a descriptor to 8 bits - SIFT values are integers from [0, 255], so the conversion is lossless for them.
+	static void quantizeU8(const float * in, unsigned char * out, size_t size);
+
+	/// Returns the name of the kernel set chosen for this CPU ("avx2", "sse" or "scalar").
+	static const char * backendName();
+};
+
+/*!
+ * \struct SIFTDescriptorL2
+ * \brief FLANN distance functor computing squared L2 with DescriptorDistance kernels.
+ *
+ * Drop-in replacement for flann::L2_Simple<float>, e.g. pcl::KdTreeFLANN<PointXYZSIFT, SIFTDescriptorL2>.
+ */
+struct SIFTDescriptorL2 {
+	typedef bool is_kdtree_distance;
+	typedef float ElementType;
+	typedef float ResultType;
+
+	template <typename Iterator1, typename Iterator2>
+	ResultType operator()(Iterator1 a, Iterator2 b, size_t size, ResultType /*worst_dist*/ = -1) const
+	{
+		return DescriptorDistance::l2Sqr(&(*a), &(*b), size);
+	}
+
+	template <typename U, typename V>
+	inline ResultType accum_dist(const U& a, const V& b, int) const
+	{
+		return (a - b) * (a - b);
+	}
+};
+
+/*!
+ * \struct SIFTDescriptorL2U8
+ * \brief FLANN distance functor computing squared L2 between 8-bit descriptors.
+ */
+struct SIFTDescriptorL2U8 {
+	typedef bool is_kdtree_distance;
+	typedef unsigned char ElementType;
+	typedef float ResultType;
+
+	template <typename Iterator1, typename Iterator2>
+	ResultType operator()(Iterator1 a, Iterator2 b, size_t size, ResultType /*worst_dist*/ = -1) const
+	{
+		return DescriptorDistance::l2SqrU8(&(*a), &(*b), size);
+	}
+
+	template <typename U, typename V>
+	inline ResultType accum_dist(const U& a, const V& b, int) const
+	{
+		return ((ResultType)a - (ResultType)b) * ((ResultType)a - (ResultType)b);
+	}
+};
+
+#endif /* DESCRIPTORDISTANCE_HPP_ */
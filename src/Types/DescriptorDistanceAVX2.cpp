@@ -0,0 +1,107 @@
+/*!
+ * \file
+ * \brief AVX2/FMA distance kernels for SIFT descriptors.
+ *
+ * This file is compiled with -mavx2 -mfma, its functions are only called
+ * when DescriptorDistance detected AVX2 support at runtime.
+ */
+
+#include <cstddef>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace {
+
+inline float horizontalSum(__m256 v)
+{
+	__m128 lo = _mm256_castps256_ps128(v);
+	__m128 hi = _mm256_extractf128_ps(v, 1);
+	lo = _mm_add_ps(lo, hi);
+	__m128 shuf = _mm_movehdup_ps(lo);
+	__m128 sums = _mm_add_ps(lo, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+}
+
+} //: namespace
+
+float descriptorL2SqrAVX2(const float * a, const float * b, size_t size)
+{
+	// 128-d descriptor = 8 iterations of 2 x 8 floats, four accumulators keep both FMA ports busy.
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	__m256 acc2 = _mm256_setzero_ps();
+	__m256 acc3 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+		__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+		__m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+		__m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+		acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+		acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+		acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+	}
+	for (; i + 8 <= size; i += 8) {
+		__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+		acc0 = _mm256_fmadd_ps(d, d, acc0);
+	}
+	float sum = horizontalSum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+	for (; i < size; ++i) {
+		float d = a[i] - b[i];
+		sum += d * d;
+	}
+	return sum;
+}
+
+float descriptorDotAVX2(const float * a, const float * b, size_t size)
+{
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	__m256 acc2 = _mm256_setzero_ps();
+	__m256 acc3 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+		acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+		acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+	}
+	for (; i + 8 <= size; i += 8)
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+	float sum = horizontalSum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+	for (; i < size; ++i)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+float descriptorL2SqrU8AVX2(const unsigned char * a, const unsigned char * b, size_t size)
+{
+	// 16 bytes widened to 16 x 16 bits, pairs of squared differences summed into 32-bit lanes.
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i d0 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i))));
+		__m256i d1 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16))));
+		acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(d0, d0));
+		acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(d1, d1));
+	}
+	__m256i acc = _mm256_add_epi32(acc0, acc1);
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	int total = _mm_cvtsi128_si32(sum);
+	for (; i < size; ++i) {
+		int d = int(a[i]) - int(b[i]);
+		total += d * d;
+	}
+	return float(total);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*!
+ * \file
+ * \brief Nearest neighbour index over SIFT descriptors of many clouds.
+ */
+
+#include "DescriptorIndex.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <pcl/pcl_macros.h>
+
+DescriptorIndex::DescriptorIndex() {
+}
+
+DescriptorIndex::DescriptorIndex(const Params & params) : params(params) {
+}
+
+void DescriptorIndex::setParams(const Params & params) {
+	if (params.encoding != this->params.encoding)
+		clear();
+	this->params = params;
+}
+
+void DescriptorIndex::clear() {
+	index.reset();
+	index_u8.reset();
+	data.clear();
+	data_u8.clear();
+	labels.clear();
+	clouds.clear();
+	cloud_positions.clear();
+}
+
+void DescriptorIndex::addCloud(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int cloud_id) {
+	if (!cloud)
+		return;
+	// The FLANN indices keep pointers to the rows - they have to be rebuilt after the matrix changes.
+	index.reset();
+	index_u8.reset();
+	for (size_t c = 0; c < clouds.size(); ++c) {
+		clouds[c].index.reset();
+		clouds[c].index_u8.reset();
+	}
+	CloudRows rows;
+	rows.first_row = labels.size();
+
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	if (params.encoding == UINT8)
+		data_u8.reserve(data_u8.size() + cloud->size() * dim);
+	else
+		data.reserve(data.size() + cloud->size() * dim);
+	labels.reserve(labels.size() + cloud->size());
+	for (size_t i = 0; i < cloud->size(); ++i) {
+		const PointXYZSIFT & p = cloud->points[i];
+		// Skip NaNs.
+		if (!pcl_isfinite(p.descriptor[0]))
+			continue;
+		if (params.encoding == UINT8) {
+			data_u8.resize(data_u8.size() + dim);
+			DescriptorDistance::quantizeU8(p.descriptor, &data_u8[data_u8.size() - dim], dim);
+		} else {
+			data.insert(data.end(), p.descriptor, p.descriptor + dim);
+		}
+		DescriptorLabel label;
+		label.cloud_id = cloud_id;
+		label.point_index = static_cast<int>(i);
+		labels.push_back(label);
+	}
+	rows.rows = labels.size() - rows.first_row;
+	if (cloud_id >= 0) {
+		if (static_cast<size_t>(cloud_id) >= cloud_positions.size())
+			cloud_positions.resize(cloud_id + 1, -1);
+		cloud_positions[cloud_id] = clouds.size();
+	}
+	clouds.push_back(rows);
+}
+
+void DescriptorIndex::build() {
+	index.reset();
+	index_u8.reset();
+	if (labels.empty())
+		return;
+	flann::IndexParams index_params = params.exact() ? flann::IndexParams(flann::KDTreeSingleIndexParams(15))
+			: flann::IndexParams(flann::KDTreeIndexParams(std::max(params.trees, 1)));
+	if (params.encoding == UINT8) {
+		flann::Matrix<unsigned char> dataset(&data_u8[0], labels.size(), DescriptorDistance::SIFT_SIZE);
+		index_u8.reset(new FLANNIndexU8(dataset, index_params));
+		index_u8->buildIndex();
+	} else {
+		flann::Matrix<float> dataset(&data[0], labels.size(), DescriptorDistance::SIFT_SIZE);
+		index.reset(new FLANNIndex(dataset, index_params));
+		index->buildIndex();
+	}
+}
+
+void DescriptorIndex::buildCloudIndices() {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	flann::IndexParams index_params = flann::KDTreeSingleIndexParams(15);
+	for (size_t c = 0; c < clouds.size(); ++c) {
+		CloudRows & cloud = clouds[c];
+		cloud.index.reset();
+		cloud.index_u8.reset();
+		if (cloud.rows == 0)
+			continue;
+		if (params.encoding == UINT8) {
+			flann::Matrix<unsigned char> dataset(&data_u8[cloud.first_row * dim], cloud.rows, dim);
+			cloud.index_u8.reset(new FLANNIndexU8(dataset, index_params));
+			cloud.index_u8->buildIndex();
+		} else {
+			flann::Matrix<float> dataset(&data[cloud.first_row * dim], cloud.rows, dim);
+			cloud.index.reset(new FLANNIndex(dataset, index_params));
+			cloud.index->buildIndex();
+		}
+	}
+}
+
+int DescriptorIndex::knnSearchCloud(int cloud_id, const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const {
+	rows.clear();
+	sqr_distances.clear();
+	if (cloud_id < 0 || static_cast<size_t>(cloud_id) >= cloud_positions.size() || cloud_positions[cloud_id] < 0 || k <= 0)
+		return 0;
+	const CloudRows & cloud = clouds[cloud_positions[cloud_id]];
+	if (!cloud.index && !cloud.index_u8)
+		return 0;
+	k = std::min<int>(k, cloud.rows);
+	rows.resize(k);
+	sqr_distances.resize(k);
+
+	flann::Matrix<int> indices_mat(&rows[0], 1, k);
+	flann::Matrix<float> dists_mat(&sqr_distances[0], 1, k);
+	flann::SearchParams search_params(flann::FLANN_CHECKS_UNLIMITED, 0.0f);
+	if (cloud.index_u8) {
+		unsigned char quantized[DescriptorDistance::SIFT_SIZE];
+		DescriptorDistance::quantizeU8(descriptor, quantized, DescriptorDistance::SIFT_SIZE);
+		flann::Matrix<unsigned char> query(quantized, 1, DescriptorDistance::SIFT_SIZE);
+		cloud.index_u8->knnSearch(query, indices_mat, dists_mat, k, search_params);
+	} else {
+		flann::Matrix<float> query(const_cast<float*>(descriptor), 1, DescriptorDistance::SIFT_SIZE);
+		cloud.index->knnSearch(query, indices_mat, dists_mat, k, search_params);
+	}
+	// Rows of the cloud index are relative to its first row.
+	for (int n = 0; n < k; ++n)
+		rows[n] += cloud.first_row;
+	return k;
+}
+
+void DescriptorIndex::copyDescriptor(int row, float * out) const {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	if (params.encoding == UINT8)
+		std::copy(&data_u8[row * dim], &data_u8[row * dim] + dim, out);
+	else
+		std::memcpy(out, &data[row * dim], dim * sizeof(float));
+}
+
+float DescriptorIndex::distance(const float * descriptor, int row) const {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	if (params.encoding == UINT8) {
+		unsigned char query[DescriptorDistance::SIFT_SIZE];
+		DescriptorDistance::quantizeU8(descriptor, query, dim);
+		return DescriptorDistance::l2SqrU8(query, &data_u8[row * dim], dim);
+	}
+	return DescriptorDistance::l2Sqr(descriptor, &data[row * dim], dim);
+}
+
+int DescriptorIndex::knnSearch(const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const {
+	rows.clear();
+	sqr_distances.clear();
+	if ((!index && !index_u8) || k <= 0)
+		return 0;
+	k = std::min<int>(k, labels.size());
+	rows.resize(k);
+	sqr_distances.resize(k);
+
+	flann::Matrix<int> indices_mat(&rows[0], 1, k);
+	flann::Matrix<float> dists_mat(&sqr_distances[0], 1, k);
+	flann::SearchParams search_params(params.exact() ? flann::FLANN_CHECKS_UNLIMITED : params.checks, 0.0f);
+	if (index_u8) {
+		unsigned char quantized[DescriptorDistance::SIFT_SIZE];
+		DescriptorDistance::quantizeU8(descriptor, quantized, DescriptorDistance::SIFT_SIZE);
+		flann::Matrix<unsigned char> query(quantized, 1, DescriptorDistance::SIFT_SIZE);
+		index_u8->knnSearch(query, indices_mat, dists_mat, k, search_params);
+	} else {
+		flann::Matrix<float> query(const_cast<float*>(descriptor), 1, DescriptorDistance::SIFT_SIZE);
+		index->knnSearch(query, indices_mat, dists_mat, k, search_params);
+	}
+	return k;
+}
+
+DescriptorIndex::SearchReport DescriptorIndex::evaluate(const float * queries, size_t nr_queries, int k) const {
+	SearchReport report;
+	report.queries = 0;
+	report.recall = 0;
+	report.search_ms = 0;
+	report.exact_ms = 0;
+	if ((!index && !index_u8) || k <= 0 || nr_queries == 0)
+		return report;
+	k = std::min<int>(k, labels.size());
+
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	std::vector<std::vector<int> > approx(nr_queries);
+	std::vector<float> sqr_distances;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+	for (size_t q = 0; q < nr_queries; ++q)
+		knnSearch(queries + q * dim, k, approx[q], sqr_distances);
+	boost::posix_time::ptime mid = boost::posix_time::microsec_clock::local_time();
+
+	// Ground truth - linear scan with partial sort of the distances.
+	size_t found = 0;
+	std::vector<std::pair<float, int> > dists(labels.size());
+	std::vector<int> exact;
+	for (size_t q = 0; q < nr_queries; ++q) {
+		for (size_t r = 0; r < labels.size(); ++r)
+			dists[r] = std::make_pair(distance(queries + q * dim, r), static_cast<int>(r));
+		std::partial_sort(dists.begin(), dists.begin() + k, dists.end());
+		exact.resize(k);
+		for (int n = 0; n < k; ++n)
+			exact[n] = dists[n].second;
+		std::sort(exact.begin(), exact.end());
+		for (size_t n = 0; n < approx[q].size(); ++n)
+			found += std::binary_search(exact.begin(), exact.end(), approx[q][n]);
+	}
+	boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
+
+	report.queries = nr_queries;
+	report.recall = static_cast<float>(found) / (nr_queries * k);
+	report.search_ms = (mid - start).total_microseconds() / 1000.0 / nr_queries;
+	report.exact_ms = (end - mid).total_microseconds() / 1000.0 / nr_queries;
+	return report;
+}
@@ -0,0 +1,179 @@
+/*!
+ * \file
+ * \brief Nearest neighbour index over SIFT descriptors of many clouds.
+ */
+
+#ifndef DESCRIPTORINDEX_HPP_
+#define DESCRIPTORINDEX_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <flann/flann.hpp>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+
+/*!
+ * \struct DescriptorLabel
+ * \brief Origin of a descriptor stored in the DescriptorIndex.
+ */
+struct DescriptorLabel {
+	/// Index of the cloud (e.g. model) the descriptor comes from.
+	int cloud_id;
+
+	/// Index of the point in that cloud.
+	int point_index;
+};
+
+/*!
+ * \class DescriptorIndex
+ * \brief Kd-tree over descriptors of a set of XYZSIFT clouds.
+ *
+ * Descriptors of all added clouds are copied into one contiguous, SIMD aligned
+ * matrix, each row carries the label of its source cloud and point, so a single
+ * k-NN query returns neighbours from all clouds at once.
+ *
+ * By default the search is exact (single kd-tree). In 128 dimensions exact search
+ * visits most of the leaves, so a forest of randomized kd-trees searched with
+ * a limited number of checks can be used instead, trading recall for speed.
+ *
+ * Descriptors can be stored as 8-bit values - SIFT descriptors are integers
+ * from [0, 255], so this is lossless for them, the copy held by the index takes
+ * 4 times less memory than floats and more rows fit into the cache during the
+ * search. The added clouds keep their float descriptors (PointXYZSIFT), so the
+ * memory of the whole model shrinks only by the part taken by the index.
+ *
+ * Rows of every added cloud are contiguous, so exact kd-trees over the rows of
+ * single clouds can be built on top of the same matrix (without copying the
+ * descriptors) to find neighbours within one cloud, e.g. the second nearest
+ * descriptor of a model which appeared only once among the neighbours of a query.
+ */
+class DescriptorIndex {
+public:
+	typedef boost::shared_ptr<DescriptorIndex> Ptr;
+
+	/// Storage of the descriptors.
+	enum Encoding {
+		FLOAT32,
+		UINT8
+	};
+
+	/// Search structure parameters.
+	struct Params {
+		/// Descriptor storage, has to be set before clouds are added.
+		Encoding encoding;
+
+		/// Number of randomized kd-trees of the approximate search.
+		int trees;
+
+		/// Number of leaves visited per query, negative - exact search with a single kd-tree.
+		int checks;
+
+		Params() : encoding(FLOAT32), trees(4), checks(-1) {}
+
+		bool exact() const { return checks < 0; }
+	};
+
+	/// Quality of the search measured against the exact (linear) search.
+	struct SearchReport {
+		/// Number of evaluated queries.
+		size_t queries;
+
+		/// Fraction of the true k nearest neighbours returned by the index.
+		float recall;
+
+		/// Mean time of a query to the index [ms].
+		double search_ms;
+
+		/// Mean time of an exact linear query [ms].
+		double exact_ms;
+	};
+
+	DescriptorIndex();
+
+	explicit DescriptorIndex(const Params & params);
+
+	/// Sets search parameters, takes effect at the next build(). Changing the encoding removes all descriptors.
+	void setParams(const Params & params);
+
+	const Params & getParams() const { return params; }
+
+	/// Returns true if the search is exact - then the k-th distance bounds from below distances of all descriptors not returned.
+	bool exact() const { return params.exact(); }
+
+	/// Removes all descriptors and the index.
+	void clear();
+
+	/// Adds finite descriptors of the cloud, labelled with the given cloud id. Call build() afterwards.
+	void addCloud(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int cloud_id);
+
+	/// Builds the search structure over all added descriptors.
+	void build();
+
+	/// Builds exact kd-trees over the rows of every added cloud (sharing the descriptor matrix). Cloud ids have to be distinct and non-negative.
+	void buildCloudIndices();
+
+	/// Finds (at most) k nearest descriptors of the given cloud with the exact search - rows of the whole index, sorted by increasing squared distance.
+	int knnSearchCloud(int cloud_id, const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const;
+
+	/// Finds (at most) k nearest descriptors - rows are sorted by increasing squared distance.
+	int knnSearch(const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const;
+
+	/// Measures recall and latency of k-NN queries (rows of the queries matrix) against the exact search.
+	SearchReport evaluate(const float * queries, size_t nr_queries, int k) const;
+
+	/// Returns the label of the given row.
+	const DescriptorLabel & label(int row) const { return labels[row]; }
+
+	/// Copies the descriptor stored in the given row.
+	void copyDescriptor(int row, float * out) const;
+
+	/// Squared distance between the query and the descriptor stored in the given row.
+	float distance(const float * descriptor, int row) const;
+
+	/// Number of indexed descriptors.
+	size_t size() const { return labels.size(); }
+
+	/// Memory taken by the stored descriptors [bytes].
+	size_t descriptorBytes() const { return data.size() * sizeof(float) + data_u8.size(); }
+
+	bool empty() const { return labels.empty(); }
+
+protected:
+	typedef flann::Index<SIFTDescriptorL2> FLANNIndex;
+	typedef flann::Index<SIFTDescriptorL2U8> FLANNIndexU8;
+
+	/// Row-major descriptor matrix (FLOAT32 encoding).
+	std::vector<float, Eigen::aligned_allocator<float> > data;
+
+	/// Row-major descriptor matrix (UINT8 encoding).
+	std::vector<unsigned char, Eigen::aligned_allocator<unsigned char> > data_u8;
+
+	/// Label of every row.
+	std::vector<DescriptorLabel> labels;
+
+	boost::shared_ptr<FLANNIndex> index;
+	boost::shared_ptr<FLANNIndexU8> index_u8;
+
+	/// Rows of an added cloud and the exact index over them.
+	struct CloudRows {
+		size_t first_row;
+		size_t rows;
+		boost::shared_ptr<FLANNIndex> index;
+		boost::shared_ptr<FLANNIndexU8> index_u8;
+	};
+
+	/// Added clouds, in the order of their rows.
+	std::vector<CloudRows> clouds;
+
+	/// Position in clouds of every cloud id (-1 - not added).
+	std::vector<int> cloud_positions;
+
+	Params params;
+};
+
+#endif /* DESCRIPTORINDEX_HPP_ */
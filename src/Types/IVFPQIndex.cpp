@@ -0,0 +1,277 @@
+/*!
+ * \file
+ * \brief Inverted file index with product-quantized SIFT descriptors.
+ */
+
+#include "IVFPQIndex.hpp"
+#include "KMeans.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <utility>
+
+#include <pcl/pcl_macros.h>
+
+namespace {
+
+/// Identifies codebook files (second version - with the fingerprint of the training clouds).
+const char CODEBOOK_MAGIC[8] = { 'S', 'O', 'M', 'I', 'V', 'F', 'Q', '2' };
+
+/// Mixes bytes into a 64-bit FNV-1a hash.
+void hashBytes(boost::uint64_t & hash, const void * bytes, size_t size) {
+	const unsigned char * b = static_cast<const unsigned char *>(bytes);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= b[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+} //: namespace
+
+
+IVFPQIndex::IVFPQIndex() : nr_lists(0), nr_subquantizers(1), training_fingerprint(0) {
+}
+
+IVFPQIndex::IVFPQIndex(const Params & params) : params(params), nr_lists(0), nr_subquantizers(1), training_fingerprint(0) {
+}
+
+boost::uint64_t IVFPQIndex::fingerprint(const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> & clouds) {
+	boost::uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < clouds.size(); ++i) {
+		boost::uint64_t size = clouds[i] ? clouds[i]->size() : 0;
+		hashBytes(hash, &size, sizeof(size));
+		for (size_t j = 0; j < size; ++j)
+			hashBytes(hash, clouds[i]->points[j].descriptor, DescriptorDistance::SIFT_SIZE * sizeof(float));
+	}
+	return hash;
+}
+
+bool IVFPQIndex::train(const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> & training_clouds) {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	if (params.lists <= 0 || params.subquantizers <= 0 || dim % params.subquantizers != 0)
+		return false;
+
+	// Gather finite descriptors, evenly subsampled to the training budget.
+	size_t total = 0;
+	for (size_t i = 0; i < training_clouds.size(); ++i)
+		if (training_clouds[i])
+			total += training_clouds[i]->size();
+	size_t step = std::max<size_t>(1, total / std::max(params.max_training_samples, 1));
+	std::vector<float> samples;
+	size_t counter = 0;
+	for (size_t i = 0; i < training_clouds.size(); ++i) {
+		if (!training_clouds[i])
+			continue;
+		for (size_t j = 0; j < training_clouds[i]->size(); ++j, ++counter) {
+			const PointXYZSIFT & p = training_clouds[i]->points[j];
+			if (counter % step != 0 || !pcl_isfinite(p.descriptor[0]))
+				continue;
+			samples.insert(samples.end(), p.descriptor, p.descriptor + dim);
+		}
+	}
+	size_t n = samples.size() / dim;
+	if (n == 0)
+		return false;
+
+	nr_lists = params.lists;
+	nr_subquantizers = params.subquantizers;
+	KMeans::cluster(&samples[0], n, dim, nr_lists, params.iterations, coarse);
+
+	// Subquantizers are trained on residuals from the coarse centroids.
+	for (size_t i = 0; i < n; ++i) {
+		const float * centroid = &coarse[KMeans::nearest(&samples[i * dim], &coarse[0], nr_lists, dim) * dim];
+		for (size_t d = 0; d < dim; ++d)
+			samples[i * dim + d] -= centroid[d];
+	}
+	const size_t sub_dim = subDimensions();
+	codebooks.resize(nr_subquantizers * PQ_CENTROIDS * sub_dim);
+	std::vector<float> sub_samples(n * sub_dim);
+	std::vector<float> sub_centroids;
+	for (int s = 0; s < nr_subquantizers; ++s) {
+		for (size_t i = 0; i < n; ++i)
+			std::copy(&samples[i * dim + s * sub_dim], &samples[i * dim + (s + 1) * sub_dim], &sub_samples[i * sub_dim]);
+		KMeans::cluster(&sub_samples[0], n, sub_dim, PQ_CENTROIDS, params.iterations, sub_centroids);
+		std::copy(sub_centroids.begin(), sub_centroids.end(), &codebooks[s * PQ_CENTROIDS * sub_dim]);
+	}
+
+	training_fingerprint = fingerprint(training_clouds);
+	clear();
+	return true;
+}
+
+bool IVFPQIndex::save(const std::string & filename) const {
+	if (!trained())
+		return false;
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+	int header[3] = { static_cast<int>(DescriptorDistance::SIFT_SIZE), nr_lists, nr_subquantizers };
+	file.write(CODEBOOK_MAGIC, sizeof(CODEBOOK_MAGIC));
+	file.write(reinterpret_cast<const char *>(header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(&training_fingerprint), sizeof(training_fingerprint));
+	file.write(reinterpret_cast<const char *>(&coarse[0]), coarse.size() * sizeof(float));
+	file.write(reinterpret_cast<const char *>(&codebooks[0]), codebooks.size() * sizeof(float));
+	return file.good();
+}
+
+bool IVFPQIndex::load(const std::string & filename, boost::uint64_t fingerprint) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+	char magic[sizeof(CODEBOOK_MAGIC)];
+	int header[3];
+	boost::uint64_t file_fingerprint;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char *>(header), sizeof(header));
+	file.read(reinterpret_cast<char *>(&file_fingerprint), sizeof(file_fingerprint));
+	if (!file || std::memcmp(magic, CODEBOOK_MAGIC, sizeof(magic)) != 0 || header[0] != static_cast<int>(DescriptorDistance::SIFT_SIZE)
+			|| header[1] <= 0 || header[2] <= 0 || header[0] % header[2] != 0 || file_fingerprint != fingerprint)
+		return false;
+
+	std::vector<float> file_coarse(header[1] * DescriptorDistance::SIFT_SIZE);
+	std::vector<float> file_codebooks(PQ_CENTROIDS * DescriptorDistance::SIFT_SIZE);
+	file.read(reinterpret_cast<char *>(&file_coarse[0]), file_coarse.size() * sizeof(float));
+	file.read(reinterpret_cast<char *>(&file_codebooks[0]), file_codebooks.size() * sizeof(float));
+	if (!file)
+		return false;
+
+	nr_lists = header[1];
+	nr_subquantizers = header[2];
+	training_fingerprint = file_fingerprint;
+	coarse.swap(file_coarse);
+	codebooks.swap(file_codebooks);
+	clear();
+	return true;
+}
+
+void IVFPQIndex::clear() {
+	list_rows.assign(nr_lists, std::vector<int>());
+	list_codes.assign(nr_lists, std::vector<unsigned char>());
+	labels.clear();
+	clouds.clear();
+}
+
+int IVFPQIndex::nearestList(const float * descriptor) const {
+	return KMeans::nearest(descriptor, &coarse[0], nr_lists, DescriptorDistance::SIFT_SIZE);
+}
+
+void IVFPQIndex::encode(const float * descriptor, int list, unsigned char * code) const {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	const size_t sub_dim = subDimensions();
+	float residual[DescriptorDistance::SIFT_SIZE];
+	for (size_t d = 0; d < dim; ++d)
+		residual[d] = descriptor[d] - coarse[list * dim + d];
+	for (int s = 0; s < nr_subquantizers; ++s)
+		code[s] = KMeans::nearest(residual + s * sub_dim, &codebooks[s * PQ_CENTROIDS * sub_dim], PQ_CENTROIDS, sub_dim);
+}
+
+void IVFPQIndex::addCloud(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int cloud_id) {
+	if (!cloud || !trained() || cloud_id < 0)
+		return;
+
+	if (clouds.size() <= static_cast<size_t>(cloud_id))
+		clouds.resize(cloud_id + 1);
+	clouds[cloud_id] = cloud;
+	std::vector<unsigned char> code(nr_subquantizers);
+	for (size_t i = 0; i < cloud->size(); ++i) {
+		const PointXYZSIFT & p = cloud->points[i];
+		// Skip NaNs.
+		if (!pcl_isfinite(p.descriptor[0]))
+			continue;
+		int list = nearestList(p.descriptor);
+		encode(p.descriptor, list, &code[0]);
+		list_rows[list].push_back(labels.size());
+		list_codes[list].insert(list_codes[list].end(), code.begin(), code.end());
+
+		DescriptorLabel label;
+		label.cloud_id = cloud_id;
+		label.point_index = static_cast<int>(i);
+		labels.push_back(label);
+	}
+}
+
+int IVFPQIndex::knnSearch(const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const {
+	return search(descriptor, k, -1, rows, sqr_distances);
+}
+
+int IVFPQIndex::knnSearchCloud(int cloud_id, const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const {
+	if (cloud_id < 0) {
+		rows.clear();
+		sqr_distances.clear();
+		return 0;
+	}
+	return search(descriptor, k, cloud_id, rows, sqr_distances);
+}
+
+int IVFPQIndex::search(const float * descriptor, int k, int cloud_id, std::vector<int> & rows, std::vector<float> & sqr_distances) const {
+	rows.clear();
+	sqr_distances.clear();
+	if (labels.empty() || k <= 0)
+		return 0;
+
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	const size_t sub_dim = subDimensions();
+	const int m = nr_subquantizers;
+
+	// Lists of the nearest coarse centroids.
+	std::vector<std::pair<float, int> > list_dists(nr_lists);
+	for (int l = 0; l < nr_lists; ++l)
+		list_dists[l] = std::make_pair(DescriptorDistance::l2Sqr(descriptor, &coarse[l * dim], dim), l);
+	int probes = std::min(std::max(params.probes, 1), nr_lists);
+	std::partial_sort(list_dists.begin(), list_dists.begin() + probes, list_dists.end());
+
+	// Shortlist of the candidates with the smallest approximate distances (max-heap).
+	size_t shortlist = std::max(params.rerank, k);
+	std::priority_queue<std::pair<float, int> > candidates;
+	std::vector<float> table(m * PQ_CENTROIDS);
+	float residual[DescriptorDistance::SIFT_SIZE];
+	for (int p = 0; p < probes; ++p) {
+		int list = list_dists[p].second;
+		if (list_rows[list].empty())
+			continue;
+		// Distances from the residual to all subquantizer centroids.
+		for (size_t d = 0; d < dim; ++d)
+			residual[d] = descriptor[d] - coarse[list * dim + d];
+		for (int s = 0; s < m; ++s)
+			for (int c = 0; c < PQ_CENTROIDS; ++c)
+				table[s * PQ_CENTROIDS + c] = DescriptorDistance::l2Sqr(residual + s * sub_dim, &codebooks[(s * PQ_CENTROIDS + c) * sub_dim], sub_dim);
+
+		const std::vector<int> & lrows = list_rows[list];
+		const unsigned char * codes = &list_codes[list][0];
+		for (size_t e = 0; e < lrows.size(); ++e, codes += m) {
+			if (cloud_id >= 0 && labels[lrows[e]].cloud_id != cloud_id)
+				continue;
+			float dist = 0;
+			for (int s = 0; s < m; ++s)
+				dist += table[s * PQ_CENTROIDS + codes[s]];
+			if (candidates.size() < shortlist)
+				candidates.push(std::make_pair(dist, lrows[e]));
+			else if (dist < candidates.top().first) {
+				candidates.pop();
+				candidates.push(std::make_pair(dist, lrows[e]));
+			}
+		}
+	}
+
+	// Exact re-ranking on the descriptors of the indexed clouds.
+	std::vector<std::pair<float, int> > exact;
+	exact.reserve(candidates.size());
+	while (!candidates.empty()) {
+		int row = candidates.top().second;
+		const DescriptorLabel & label = labels[row];
+		const float * row_descriptor = clouds[label.cloud_id]->points[label.point_index].descriptor;
+		exact.push_back(std::make_pair(DescriptorDistance::l2Sqr(descriptor, row_descriptor, dim), row));
+		candidates.pop();
+	}
+	k = std::min<int>(k, exact.size());
+	std::partial_sort(exact.begin(), exact.begin() + k, exact.end());
+	rows.resize(k);
+	sqr_distances.resize(k);
+	for (int n = 0; n < k; ++n) {
+		sqr_distances[n] = exact[n].first;
+		rows[n] = exact[n].second;
+	}
+	return k;
+}
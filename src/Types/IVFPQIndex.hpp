@@ -0,0 +1,160 @@
+/*!
+ * \file
+ * \brief Inverted file index with product-quantized SIFT descriptors.
+ */
+
+#ifndef IVFPQINDEX_HPP_
+#define IVFPQINDEX_HPP_
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <pcl/point_cloud.h>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+#include <Types/DescriptorIndex.hpp>
+
+/*!
+ * \class IVFPQIndex
+ * \brief Approximate nearest neighbour index for large model libraries (IVF-PQ).
+ *
+ * Descriptors are assigned to the nearest centroid of a coarse quantizer (inverted lists),
+ * the residuals are encoded with a product quantizer - one byte for each group of
+ * dimensions, so a descriptor takes subquantizers bytes instead of 512.
+ * A query visits the lists of the nearest centroids, scores their codes with lookup tables
+ * and re-ranks the best candidates with exact distances to the descriptors of the indexed
+ * clouds - the index shares the clouds instead of keeping copies of the descriptors.
+ *
+ * Codebooks are trained once (e.g. on all models of a library) and can be saved to and
+ * loaded from a file. The file records the fingerprint of the training clouds, so codebooks
+ * of another library are not loaded.
+ */
+class IVFPQIndex {
+public:
+	typedef boost::shared_ptr<IVFPQIndex> Ptr;
+
+	/// Index parameters.
+	struct Params {
+		/// Number of inverted lists (coarse centroids).
+		int lists;
+
+		/// Number of subquantizers (bytes per descriptor), has to divide 128.
+		int subquantizers;
+
+		/// Number of lists visited per query.
+		int probes;
+
+		/// Number of candidates re-ranked with exact distances.
+		int rerank;
+
+		/// Number of k-means iterations of training.
+		int iterations;
+
+		/// Maximal number of descriptors used for training.
+		int max_training_samples;
+
+		Params() : lists(256), subquantizers(16), probes(8), rerank(64), iterations(10), max_training_samples(50000) {}
+	};
+
+	IVFPQIndex();
+
+	explicit IVFPQIndex(const Params & params);
+
+	/// Sets parameters - probes and rerank take effect immediately, the rest at the next train().
+	void setParams(const Params & params) { this->params = params; }
+
+	const Params & getParams() const { return params; }
+
+	/// Returns the fingerprint of the clouds (their sizes and descriptors), identifying a model library.
+	static boost::uint64_t fingerprint(const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> & clouds);
+
+	/// Trains codebooks on (a sample of) finite descriptors of the clouds, removes all indexed descriptors.
+	bool train(const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> & clouds);
+
+	/// Returns true if codebooks were trained or loaded.
+	bool trained() const { return !coarse.empty(); }
+
+	/// Fingerprint of the clouds the codebooks were trained on.
+	boost::uint64_t trainingFingerprint() const { return training_fingerprint; }
+
+	/// Saves codebooks (with the training fingerprint) to a binary file.
+	bool save(const std::string & filename) const;
+
+	/// Loads codebooks trained on clouds with the given fingerprint from a binary file (number of lists and
+	/// subquantizers are taken from the file), removes all indexed descriptors. Fails if the fingerprint differs.
+	bool load(const std::string & filename, boost::uint64_t fingerprint);
+
+	/// Removes all indexed descriptors, codebooks are kept.
+	void clear();
+
+	/// Encodes finite descriptors of the cloud, labelled with the given (non-negative) cloud id.
+	/// The cloud is kept for re-ranking and must not change while indexed.
+	void addCloud(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int cloud_id);
+
+	/// Finds (at most) k approximate nearest descriptors - rows are sorted by increasing (exact) squared distance.
+	int knnSearch(const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const;
+
+	/// Finds (at most) k approximate nearest descriptors of the given cloud, searched in the same lists as by knnSearch().
+	int knnSearchCloud(int cloud_id, const float * descriptor, int k, std::vector<int> & rows, std::vector<float> & sqr_distances) const;
+
+	/// Returns the label of the given row.
+	const DescriptorLabel & label(int row) const { return labels[row]; }
+
+	/// Number of indexed descriptors.
+	size_t size() const { return labels.size(); }
+
+	bool empty() const { return labels.empty(); }
+
+	/// Memory taken by the codes [bytes].
+	size_t codeBytes() const { return labels.size() * nr_subquantizers; }
+
+	/// The search is approximate - descriptors outside of the visited lists and the shortlist are not found.
+	bool exact() const { return false; }
+
+protected:
+	/// Number of centroids of every subquantizer (codes are bytes).
+	static const int PQ_CENTROIDS = 256;
+
+	/// Number of dimensions encoded by every subquantizer.
+	size_t subDimensions() const { return DescriptorDistance::SIFT_SIZE / nr_subquantizers; }
+
+	/// Returns the nearest coarse centroid.
+	int nearestList(const float * descriptor) const;
+
+	/// Searches descriptors of the given cloud (negative - of all clouds).
+	int search(const float * descriptor, int k, int cloud_id, std::vector<int> & rows, std::vector<float> & sqr_distances) const;
+
+	/// Encodes the residual of the descriptor from the centroid of the list.
+	void encode(const float * descriptor, int list, unsigned char * code) const;
+
+	Params params;
+
+	/// Number of lists and subquantizers of the current codebooks.
+	int nr_lists;
+	int nr_subquantizers;
+
+	/// Fingerprint of the training clouds.
+	boost::uint64_t training_fingerprint;
+
+	/// Coarse centroids (lists x 128).
+	std::vector<float> coarse;
+
+	/// Subquantizer centroids (subquantizers x 256 x subdimensions).
+	std::vector<float> codebooks;
+
+	/// Rows and codes (rows x subquantizers) stored in every list.
+	std::vector<std::vector<int> > list_rows;
+	std::vector<std::vector<unsigned char> > list_codes;
+
+	/// Label of every row.
+	std::vector<DescriptorLabel> labels;
+
+	/// Indexed clouds (by cloud id) providing descriptors for re-ranking.
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+};
+
+#endif /* IVFPQINDEX_HPP_ */
@@ -0,0 +1,140 @@
+/*!
+ * \file
+ * \brief Descriptor index following a growing (merged) XYZSIFT cloud.
+ */
+
+#include "IncrementalDescriptorIndex.hpp"
+
+#include <algorithm>
+
+#include <pcl/pcl_macros.h>
+
+IncrementalDescriptorIndex::IncrementalDescriptorIndex() : removed_ids(0), tracked_generation(0) {
+}
+
+IncrementalDescriptorIndex::IncrementalDescriptorIndex(const DescriptorIndex::Params & params) : params(params), removed_ids(0), tracked_generation(0) {
+}
+
+void IncrementalDescriptorIndex::reset(const pcl::PointCloud<PointXYZSIFT> & cloud, unsigned long generation) {
+	index.reset();
+	blocks.clear();
+	position_ids.clear();
+	id_positions.clear();
+	id_rows.clear();
+	removed_ids = 0;
+	append(cloud, generation);
+}
+
+void IncrementalDescriptorIndex::append(const pcl::PointCloud<PointXYZSIFT> & cloud, unsigned long generation) {
+	tracked_generation = generation;
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	boost::shared_ptr<std::vector<float> > block(new std::vector<float>());
+	block->reserve(cloud.size() * dim);
+	size_t first_id = id_positions.size();
+	for (size_t i = 0; i < cloud.size(); ++i) {
+		const PointXYZSIFT & p = cloud.points[i];
+		// NaNs keep their positions, but are not indexed.
+		if (!pcl_isfinite(p.descriptor[0])) {
+			position_ids.push_back(-1);
+			continue;
+		}
+		position_ids.push_back(id_positions.size());
+		id_positions.push_back(position_ids.size() - 1);
+		block->insert(block->end(), p.descriptor, p.descriptor + dim);
+	}
+	size_t rows = id_positions.size() - first_id;
+	if (rows == 0)
+		return;
+
+	blocks.push_back(block);
+	for (size_t r = 0; r < rows; ++r)
+		id_rows.push_back(&(*block)[r * dim]);
+
+	flann::Matrix<float> points(&(*block)[0], rows, dim);
+	if (!index) {
+		flann::IndexParams index_params = flann::KDTreeIndexParams(params.exact() ? 1 : std::max(params.trees, 1));
+		index.reset(new FLANNIndex(points, index_params));
+		index->buildIndex();
+	} else {
+		// Points are inserted into the existing trees, FLANN rebuilds them only when the size doubles.
+		index->addPoints(points, 2.0f);
+	}
+}
+
+void IncrementalDescriptorIndex::remove(const std::vector<bool> & removed, unsigned long generation) {
+	tracked_generation = generation;
+	size_t kept = 0;
+	for (size_t pos = 0; pos < position_ids.size(); ++pos) {
+		int id = position_ids[pos];
+		if (pos < removed.size() && removed[pos]) {
+			if (id >= 0) {
+				index->removePoint(id);
+				id_positions[id] = -1;
+				++removed_ids;
+			}
+			continue;
+		}
+		position_ids[kept] = id;
+		if (id >= 0)
+			id_positions[id] = kept;
+		++kept;
+	}
+	position_ids.resize(kept);
+
+	if (removed_ids > id_positions.size() - removed_ids)
+		rebuild();
+}
+
+void IncrementalDescriptorIndex::rebuild() {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	boost::shared_ptr<std::vector<float> > block(new std::vector<float>());
+	block->reserve((id_positions.size() - removed_ids) * dim);
+	std::vector<int> new_id_positions;
+	for (size_t pos = 0; pos < position_ids.size(); ++pos) {
+		int id = position_ids[pos];
+		if (id < 0)
+			continue;
+		block->insert(block->end(), id_rows[id], id_rows[id] + dim);
+		position_ids[pos] = new_id_positions.size();
+		new_id_positions.push_back(pos);
+	}
+
+	index.reset();
+	blocks.clear();
+	id_rows.clear();
+	id_positions.swap(new_id_positions);
+	removed_ids = 0;
+	if (id_positions.empty())
+		return;
+
+	blocks.push_back(block);
+	for (size_t r = 0; r < id_positions.size(); ++r)
+		id_rows.push_back(&(*block)[r * dim]);
+	flann::Matrix<float> points(&(*block)[0], id_positions.size(), dim);
+	flann::IndexParams index_params = flann::KDTreeIndexParams(params.exact() ? 1 : std::max(params.trees, 1));
+	index.reset(new FLANNIndex(points, index_params));
+	index->buildIndex();
+}
+
+int IncrementalDescriptorIndex::knnSearch(const float * descriptor, int k, std::vector<int> & positions, std::vector<float> & sqr_distances) const {
+	positions.clear();
+	sqr_distances.clear();
+	if (!index || k <= 0)
+		return 0;
+	k = std::min<int>(k, id_positions.size() - removed_ids);
+	if (k <= 0)
+		return 0;
+
+	std::vector<int> ids(k);
+	sqr_distances.resize(k);
+	flann::Matrix<float> query(const_cast<float*>(descriptor), 1, DescriptorDistance::SIFT_SIZE);
+	flann::Matrix<int> indices_mat(&ids[0], 1, k);
+	flann::Matrix<float> dists_mat(&sqr_distances[0], 1, k);
+	// A single randomized tree searched without limit of checks gives exact results.
+	index->knnSearch(query, indices_mat, dists_mat, k, flann::SearchParams(params.exact() ? flann::FLANN_CHECKS_UNLIMITED : params.checks, 0.0f));
+
+	positions.resize(k);
+	for (int n = 0; n < k; ++n)
+		positions[n] = id_positions[ids[n]];
+	return k;
+}
@@ -0,0 +1,97 @@
+/*!
+ * \file
+ * \brief Descriptor index following a growing (merged) XYZSIFT cloud.
+ */
+
+#ifndef INCREMENTALDESCRIPTORINDEX_HPP_
+#define INCREMENTALDESCRIPTORINDEX_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <pcl/point_cloud.h>
+#include <flann/flann.hpp>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+#include <Types/DescriptorIndex.hpp>
+
+/*!
+ * \class IncrementalDescriptorIndex
+ * \brief Kd-tree over descriptors of a cloud that is appended to and compacted in place.
+ *
+ * The index mirrors the operations done on the tracked cloud (e.g. cloud_sift_merged):
+ * appended descriptors are inserted into the existing trees and removed ones are only
+ * marked, so adding a view costs time proportional to the view, not to the whole cloud.
+ * Search results are positions in the tracked cloud. The trees are rebuilt from scratch
+ * only when more than half of the indexed descriptors were removed.
+ *
+ * The owner of the tracked cloud numbers its changes of features (generations) and passes
+ * the generation reached by every mirrored operation, so a cloud changed behind the index's
+ * back is detected even if its size did not change.
+ */
+class IncrementalDescriptorIndex {
+public:
+	typedef boost::shared_ptr<IncrementalDescriptorIndex> Ptr;
+
+	IncrementalDescriptorIndex();
+
+	explicit IncrementalDescriptorIndex(const DescriptorIndex::Params & params);
+
+	/// Sets search parameters (encoding is ignored - descriptors are kept as floats), trees take them at the next rebuild.
+	void setParams(const DescriptorIndex::Params & params) { this->params = params; }
+
+	/// Rebuilds the index for the given generation of the tracked cloud (when the tracked cloud was replaced).
+	void reset(const pcl::PointCloud<PointXYZSIFT> & cloud, unsigned long generation);
+
+	/// Indexes points appended at the end of the tracked cloud, which reached the given generation.
+	void append(const pcl::PointCloud<PointXYZSIFT> & cloud, unsigned long generation);
+
+	/// Removes points of the tracked cloud marked in the mask (of size()), remaining points keep their order.
+	void remove(const std::vector<bool> & removed, unsigned long generation);
+
+	/// Finds (at most) k nearest descriptors, returns their positions in the tracked cloud.
+	int knnSearch(const float * descriptor, int k, std::vector<int> & positions, std::vector<float> & sqr_distances) const;
+
+	/// Number of points of the tracked cloud.
+	size_t size() const { return position_ids.size(); }
+
+	/// Generation of the tracked cloud mirrored by the index.
+	unsigned long generation() const { return tracked_generation; }
+
+	/// Returns true if the index mirrors the given generation of the cloud.
+	bool tracks(const pcl::PointCloud<PointXYZSIFT> & cloud, unsigned long generation) const {
+		return tracked_generation == generation && position_ids.size() == cloud.size();
+	}
+
+protected:
+	typedef flann::Index<SIFTDescriptorL2> FLANNIndex;
+
+	/// Rebuilds the trees over the descriptors of the remaining points only.
+	void rebuild();
+
+	DescriptorIndex::Params params;
+
+	/// Descriptor blocks - FLANN keeps pointers to their rows, so blocks are never moved nor freed before the trees.
+	std::vector<boost::shared_ptr<std::vector<float> > > blocks;
+
+	/// FLANN id of every point of the tracked cloud (-1 - not indexed, e.g. NaN descriptor).
+	std::vector<int> position_ids;
+
+	/// Position of every FLANN id (-1 - removed).
+	std::vector<int> id_positions;
+
+	/// Descriptor of every FLANN id.
+	std::vector<const float *> id_rows;
+
+	/// Number of removed ids still present in the trees.
+	size_t removed_ids;
+
+	/// Generation of the tracked cloud.
+	unsigned long tracked_generation;
+
+	boost::shared_ptr<FLANNIndex> index;
+};
+
+#endif /* INCREMENTALDESCRIPTORINDEX_HPP_ */
@@ -0,0 +1,105 @@
+/*!
+ * \file
+ * \brief Vectorized counting of point pairs consistent with a rigid transformation - scalar/SSE kernels and CPU dispatch.
+ */
+
+#include "InlierCounter.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef SIFTOBJECTMODEL_WITH_AVX2
+// Kernel compiled with -mavx2 -mfma in InlierCounterAVX2.cpp.
+int countInliersAVX2(const InlierCounter::Coordinates & src, const InlierCounter::Coordinates & trg, size_t size, const float * m, float sqr_threshold);
+#endif
+
+namespace {
+
+typedef int (*CountKernel)(const InlierCounter::Coordinates &, const InlierCounter::Coordinates &, size_t, const float *, float);
+
+int countScalar(const InlierCounter::Coordinates & src, const InlierCounter::Coordinates & trg, size_t size, const float * m, float sqr_threshold)
+{
+	int count = 0;
+	for (size_t i = 0; i < size; ++i) {
+		float dx = m[0] * src.x[i] + m[1] * src.y[i] + m[2] * src.z[i] + m[3] - trg.x[i];
+		float dy = m[4] * src.x[i] + m[5] * src.y[i] + m[6] * src.z[i] + m[7] - trg.y[i];
+		float dz = m[8] * src.x[i] + m[9] * src.y[i] + m[10] * src.z[i] + m[11] - trg.z[i];
+		count += (dx * dx + dy * dy + dz * dz < sqr_threshold);
+	}
+	return count;
+}
+
+#if defined(__SSE2__)
+int countSSE(const InlierCounter::Coordinates & src, const InlierCounter::Coordinates & trg, size_t size, const float * m, float sqr_threshold)
+{
+	const __m128 r00 = _mm_set1_ps(m[0]), r01 = _mm_set1_ps(m[1]), r02 = _mm_set1_ps(m[2]), t0 = _mm_set1_ps(m[3]);
+	const __m128 r10 = _mm_set1_ps(m[4]), r11 = _mm_set1_ps(m[5]), r12 = _mm_set1_ps(m[6]), t1 = _mm_set1_ps(m[7]);
+	const __m128 r20 = _mm_set1_ps(m[8]), r21 = _mm_set1_ps(m[9]), r22 = _mm_set1_ps(m[10]), t2 = _mm_set1_ps(m[11]);
+	const __m128 threshold = _mm_set1_ps(sqr_threshold);
+	// Comparison masks are -1 in the passing lanes, so subtracting them counts inliers per lane.
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= size; i += 4) {
+		__m128 x = _mm_loadu_ps(src.x + i), y = _mm_loadu_ps(src.y + i), z = _mm_loadu_ps(src.z + i);
+		__m128 dx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, x), _mm_mul_ps(r01, y)), _mm_add_ps(_mm_mul_ps(r02, z), t0)), _mm_loadu_ps(trg.x + i));
+		__m128 dy = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, x), _mm_mul_ps(r11, y)), _mm_add_ps(_mm_mul_ps(r12, z), t1)), _mm_loadu_ps(trg.y + i));
+		__m128 dz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, x), _mm_mul_ps(r21, y)), _mm_add_ps(_mm_mul_ps(r22, z), t2)), _mm_loadu_ps(trg.z + i));
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		acc = _mm_sub_epi32(acc, _mm_castps_si128(_mm_cmplt_ps(d, threshold)));
+	}
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	InlierCounter::Coordinates src_tail = { src.x + i, src.y + i, src.z + i };
+	InlierCounter::Coordinates trg_tail = { trg.x + i, trg.y + i, trg.z + i };
+	return _mm_cvtsi128_si32(acc) + countScalar(src_tail, trg_tail, size - i, m, sqr_threshold);
+}
+#endif
+
+bool cpuHasAVX2()
+{
+#if defined(SIFTOBJECTMODEL_WITH_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif
+}
+
+struct KernelSet {
+	CountKernel count;
+	const char * name;
+
+	KernelSet() : count(&countScalar), name("scalar") {
+#if defined(__SSE2__)
+		count = &countSSE;
+		name = "sse";
+#endif
+#ifdef SIFTOBJECTMODEL_WITH_AVX2
+		if (cpuHasAVX2()) {
+			count = &countInliersAVX2;
+			name = "avx2";
+		}
+#endif
+	}
+};
+
+/// Returns kernels selected on first use (safe to call from other static initializers).
+const KernelSet & kernels()
+{
+	static const KernelSet set;
+	return set;
+}
+
+} //: namespace
+
+
+int InlierCounter::count(const Coordinates & src, const Coordinates & trg, size_t size, const float * transformation, float sqr_threshold)
+{
+	return kernels().count(src, trg, size, transformation, sqr_threshold);
+}
+
+const char * InlierCounter::backendName()
+{
+	return kernels().name;
+}
@@ -0,0 +1,36 @@
+/*!
+ * \file
+ * \brief Vectorized counting of point pairs consistent with a rigid transformation.
+ */
+
+#ifndef INLIERCOUNTER_HPP_
+#define INLIERCOUNTER_HPP_
+
+#include <cstddef>
+
+/*!
+ * \class InlierCounter
+ * \brief Transform-and-distance kernels over corresponding points stored as coordinate arrays.
+ *
+ * Points are kept as structure of arrays (x, y and z in separate arrays), so a
+ * register holds one coordinate of consecutive points and the transformation is
+ * applied to 4 (SSE) or 8 (AVX2+FMA) pairs at once. As in DescriptorDistance the
+ * implementation is selected once at startup basing on the CPU features.
+ */
+class InlierCounter {
+public:
+	/// Coordinate arrays of a set of points.
+	struct Coordinates {
+		const float * x;
+		const float * y;
+		const float * z;
+	};
+
+	/// Counts pairs for which |R src + t - trg|^2 < sqr_threshold, the transformation is given as rows of [R t] (12 floats).
+	static int count(const Coordinates & src, const Coordinates & trg, size_t size, const float * transformation, float sqr_threshold);
+
+	/// Returns the name of the kernel chosen for this CPU ("avx2", "sse" or "scalar").
+	static const char * backendName();
+};
+
+#endif /* INLIERCOUNTER_HPP_ */
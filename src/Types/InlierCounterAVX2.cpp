@@ -0,0 +1,40 @@
+/*!
+ * \file
+ * \brief AVX2/FMA kernel counting point pairs consistent with a rigid transformation.
+ *
+ * This file is compiled with -mavx2 -mfma, its functions are only called
+ * when InlierCounter detected AVX2 support at runtime.
+ */
+
+#include "InlierCounter.hpp"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+int countInliersAVX2(const InlierCounter::Coordinates & src, const InlierCounter::Coordinates & trg, size_t size, const float * m, float sqr_threshold)
+{
+	const __m256 r00 = _mm256_set1_ps(m[0]), r01 = _mm256_set1_ps(m[1]), r02 = _mm256_set1_ps(m[2]), t0 = _mm256_set1_ps(m[3]);
+	const __m256 r10 = _mm256_set1_ps(m[4]), r11 = _mm256_set1_ps(m[5]), r12 = _mm256_set1_ps(m[6]), t1 = _mm256_set1_ps(m[7]);
+	const __m256 r20 = _mm256_set1_ps(m[8]), r21 = _mm256_set1_ps(m[9]), r22 = _mm256_set1_ps(m[10]), t2 = _mm256_set1_ps(m[11]);
+	const __m256 threshold = _mm256_set1_ps(sqr_threshold);
+	int count = 0;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m256 x = _mm256_loadu_ps(src.x + i), y = _mm256_loadu_ps(src.y + i), z = _mm256_loadu_ps(src.z + i);
+		// Translation minus target first, then the rotation accumulated with FMAs.
+		__m256 dx = _mm256_fmadd_ps(r02, z, _mm256_fmadd_ps(r01, y, _mm256_fmadd_ps(r00, x, _mm256_sub_ps(t0, _mm256_loadu_ps(trg.x + i)))));
+		__m256 dy = _mm256_fmadd_ps(r12, z, _mm256_fmadd_ps(r11, y, _mm256_fmadd_ps(r10, x, _mm256_sub_ps(t1, _mm256_loadu_ps(trg.y + i)))));
+		__m256 dz = _mm256_fmadd_ps(r22, z, _mm256_fmadd_ps(r21, y, _mm256_fmadd_ps(r20, x, _mm256_sub_ps(t2, _mm256_loadu_ps(trg.z + i)))));
+		__m256 d = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+		count += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(d, threshold, _CMP_LT_OQ)));
+	}
+	for (; i < size; ++i) {
+		float dx = m[0] * src.x[i] + m[1] * src.y[i] + m[2] * src.z[i] + m[3] - trg.x[i];
+		float dy = m[4] * src.x[i] + m[5] * src.y[i] + m[6] * src.z[i] + m[7] - trg.y[i];
+		float dz = m[8] * src.x[i] + m[9] * src.y[i] + m[10] * src.z[i] + m[11] - trg.z[i];
+		count += (dx * dx + dy * dy + dz * dz < sqr_threshold);
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*!
+ * \file
+ * \brief K-means clustering of descriptors.
+ */
+
+#include "KMeans.hpp"
+
+#include <algorithm>
+
+#include <Types/DescriptorDistance.hpp>
+
+int KMeans::nearest(const float * point, const float * centroids, size_t k, size_t dim)
+{
+	int best = 0;
+	float best_dist = DescriptorDistance::l2Sqr(point, centroids, dim);
+	for (size_t c = 1; c < k; ++c) {
+		float dist = DescriptorDistance::l2Sqr(point, centroids + c * dim, dim);
+		if (dist < best_dist) {
+			best_dist = dist;
+			best = c;
+		}
+	}
+	return best;
+}
+
+void KMeans::cluster(const float * data, size_t n, size_t dim, size_t k, int iterations, std::vector<float> & centroids)
+{
+	centroids.resize(k * dim);
+	for (size_t c = 0; c < k; ++c)
+		std::copy(data + (c * n / k) * dim, data + (c * n / k + 1) * dim, &centroids[c * dim]);
+
+	std::vector<int> assignment(n);
+	std::vector<double> sums(k * dim);
+	std::vector<size_t> counts(k);
+	for (int it = 0; it < iterations; ++it) {
+		for (size_t i = 0; i < n; ++i)
+			assignment[i] = nearest(data + i * dim, &centroids[0], k, dim);
+
+		std::fill(sums.begin(), sums.end(), 0.0);
+		std::fill(counts.begin(), counts.end(), 0);
+		for (size_t i = 0; i < n; ++i) {
+			double * sum = &sums[assignment[i] * dim];
+			for (size_t d = 0; d < dim; ++d)
+				sum[d] += data[i * dim + d];
+			++counts[assignment[i]];
+		}
+		// Empty clusters keep their previous centroids.
+		for (size_t c = 0; c < k; ++c) {
+			if (counts[c] == 0)
+				continue;
+			for (size_t d = 0; d < dim; ++d)
+				centroids[c * dim + d] = sums[c * dim + d] / counts[c];
+		}
+	}
+}
@@ -0,0 +1,25 @@
+/*!
+ * \file
+ * \brief K-means clustering of descriptors.
+ */
+
+#ifndef KMEANS_HPP_
+#define KMEANS_HPP_
+
+#include <cstddef>
+#include <vector>
+
+/*!
+ * \class KMeans
+ * \brief Lloyd's k-means over row-major float vectors, used to train descriptor quantizers.
+ */
+class KMeans {
+public:
+	/// Returns the nearest of k centroids of the given dimension.
+	static int nearest(const float * point, const float * centroids, size_t k, size_t dim);
+
+	/// Clusters n points into k centroids - initialized with evenly spread samples, so the result is deterministic.
+	static void cluster(const float * data, size_t n, size_t dim, size_t k, int iterations, std::vector<float> & centroids);
+};
+
+#endif /* KMEANS_HPP_ */
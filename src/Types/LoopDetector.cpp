@@ -0,0 +1,110 @@
+/*!
+ * \file
+ * \brief Distance based detection of loop closures between views.
+ */
+
+#include "LoopDetector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <pcl/common/centroid.h>
+
+LoopDetector::LoopDetector(double distance) : distance(distance), min_dist(-1), loop_first(0), loop_last(0) {
+}
+
+void LoopDetector::setDistance(double distance) {
+	this->distance = distance;
+	grid.clear();
+	for (size_t i = 0; i < centroids.size(); ++i)
+		grid[cellKey(centroids[i])].push_back(i);
+}
+
+void LoopDetector::clear() {
+	centroids.clear();
+	grid.clear();
+	min_dist = -1;
+}
+
+boost::uint64_t LoopDetector::key(int ix, int iy, int iz) {
+	const boost::uint64_t mask = (1 << 21) - 1;
+	return ((static_cast<boost::uint64_t>(ix) & mask) << 42) | ((static_cast<boost::uint64_t>(iy) & mask) << 21) | (static_cast<boost::uint64_t>(iz) & mask);
+}
+
+boost::uint64_t LoopDetector::cellKey(const Eigen::Vector3f & point, int dx, int dy, int dz) const {
+	return key(static_cast<int>(std::floor(point[0] / distance)) + dx, static_cast<int>(std::floor(point[1] / distance)) + dy,
+			static_cast<int>(std::floor(point[2] / distance)) + dz);
+}
+
+int LoopDetector::addView(const pcl::PointCloud<pcl::PointXYZRGB> & cloud) {
+	Eigen::Vector4f centroid;
+	pcl::compute3DCentroid(cloud, centroid);
+	int view = centroids.size();
+	centroids.push_back(centroid.head<3>());
+	grid[cellKey(centroids.back())].push_back(view);
+	return view;
+}
+
+void LoopDetector::updateView(int view, const pcl::PointCloud<pcl::PointXYZRGB> & cloud) {
+	Eigen::Vector4f centroid;
+	pcl::compute3DCentroid(cloud, centroid);
+	boost::uint64_t old_key = cellKey(centroids[view]);
+	centroids[view] = centroid.head<3>();
+	boost::uint64_t new_key = cellKey(centroids[view]);
+	if (new_key == old_key)
+		return;
+	std::vector<int> & old_cell = grid[old_key];
+	old_cell.erase(std::find(old_cell.begin(), old_cell.end(), view));
+	if (old_cell.empty())
+		grid.erase(old_key);
+	grid[new_key].push_back(view);
+}
+
+bool LoopDetector::detect(int end, int & first, int & last) {
+	const Eigen::Vector3f & c = centroids[end];
+
+	// Views just before the end lie close to it - the loop can start only before the trajectory left its neighbourhood.
+	int left = end - 1;
+	while (left >= 0 && (centroids[left] - c).norm() <= distance)
+		--left;
+
+	// Returns into the neighbourhood, the most recent first.
+	std::vector<int> candidates;
+	if (left > 0) {
+		for (int dx = -1; dx <= 1; ++dx)
+			for (int dy = -1; dy <= 1; ++dy)
+				for (int dz = -1; dz <= 1; ++dz) {
+					boost::unordered_map<boost::uint64_t, std::vector<int> >::const_iterator cell = grid.find(cellKey(c, dx, dy, dz));
+					if (cell == grid.end())
+						continue;
+					for (size_t i = 0; i < cell->second.size(); ++i)
+						if (cell->second[i] < left && (centroids[cell->second[i]] - c).norm() < distance)
+							candidates.push_back(cell->second[i]);
+				}
+		std::sort(candidates.begin(), candidates.end());
+	}
+
+	for (std::vector<int>::reverse_iterator it = candidates.rbegin(); it != candidates.rend(); ++it) {
+		double norm = (centroids[*it] - c).norm();
+		if (min_dist < 0 || norm < min_dist) {
+			min_dist = norm;
+			loop_first = *it;
+			loop_last = end;
+			break;
+		}
+	}
+
+	// The loop is reported when the trajectory does not return any more.
+	if (candidates.empty())
+		return finish(first, last);
+	return false;
+}
+
+bool LoopDetector::finish(int & first, int & last) {
+	if (min_dist < 0)
+		return false;
+	first = loop_first;
+	last = loop_last;
+	min_dist = -1;
+	return true;
+}
@@ -0,0 +1,83 @@
+/*!
+ * \file
+ * \brief Distance based detection of loop closures between views.
+ */
+
+#ifndef LOOPDETECTOR_HPP_
+#define LOOPDETECTOR_HPP_
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+/*!
+ * \class LoopDetector
+ * \brief Detects loops of the trajectory of views by distances of their centroids.
+ *
+ * A loop ends at a view if, going back from it, the trajectory first leaves the
+ * sphere of the given radius around its centroid and later returns into it. The
+ * closest such return is kept pending while the following views keep returning
+ * and is reported at the first view which does not return any more - once the
+ * trajectory leaves the loop region, as the ELCH example of PCL does. A loop
+ * still pending when no more views arrive is reported by finish().
+ *
+ * Centroids are computed when views are added, and kept in a hash grid with
+ * cells of the loop distance, so candidates of a loop closure are found among
+ * the views of 27 neighbouring cells instead of among all views. Views moved
+ * afterwards (e.g. by a loop closure) have to be updated.
+ */
+class LoopDetector {
+public:
+	explicit LoopDetector(double distance = 0.05);
+
+	/// Sets the loop distance - the grid is rebuilt.
+	void setDistance(double distance);
+
+	double getDistance() const { return distance; }
+
+	/// Removes all views and forgets the pending loop.
+	void clear();
+
+	/// Adds the view (given in the model frame), returns its number.
+	int addView(const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+
+	/// Recomputes the centroid (and grid cell) of the view from its moved cloud.
+	void updateView(int view, const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+
+	/// Looks for a loop ending at the given (newest) view, returns true and the first and last views of the pending loop when the trajectory left it.
+	bool detect(int end, int & first, int & last);
+
+	/// Reports the pending loop at the end of the trajectory, returns false if there is none.
+	bool finish(int & first, int & last);
+
+	/// Number of added views.
+	size_t size() const { return centroids.size(); }
+
+protected:
+	/// Packs integer cell coordinates (21 bits each) into a hash key.
+	static boost::uint64_t key(int ix, int iy, int iz);
+
+	/// Returns the key of the cell containing the point, moved by the given number of cells.
+	boost::uint64_t cellKey(const Eigen::Vector3f & point, int dx = 0, int dy = 0, int dz = 0) const;
+
+	double distance;
+
+	/// Centroid of every view.
+	std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > centroids;
+
+	/// Views of every occupied grid cell.
+	boost::unordered_map<boost::uint64_t, std::vector<int> > grid;
+
+	/// Distance of the best closure of the pending loop (negative - no pending loop) and its views.
+	double min_dist;
+	int loop_first, loop_last;
+};
+
+#endif /* LOOPDETECTOR_HPP_ */
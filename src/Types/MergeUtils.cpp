@@ -13,10 +13,14 @@
 #include "Common/Logger.hpp"
 
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include <string>
 #include <cmath>
 
+#include <Eigen/Cholesky>
+#include <Eigen/Geometry>
+
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/features2d/features2d.hpp>
@@ -25,6 +29,9 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_representation.h>
+#include "SIFTFeatureRepresentation.hpp"
+#include "DescriptorIndex.hpp"
+#include "RigidSampleConsensus.hpp"
 
 #include "pcl/impl/instantiate.hpp"
 #include "pcl/search/kdtree.h"
@@ -40,7 +47,10 @@
 #include <pcl/registration/icp_nl.h>
 
 #include <pcl/filters/voxel_grid.h>
+#include <pcl/filters/crop_box.h>
+#include <pcl/common/common.h>
 #include <pcl/features/normal_3d.h>
+#include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/sample_consensus/sac_model_plane.h>
 #include <pcl/sample_consensus/sac_model.h>
 #include <pcl/sample_consensus/model_types.h>
@@ -76,31 +86,6 @@ public:
   }
 };
 
-/*
- * \brief Class used for transformation from SIFT descriptor to array of floats.
- */
-class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT> //could possibly be pcl::PointRepresentation<...> ??
-{
-	/// Templatiated number of SIFT descriptor dimensions.
-	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
-
-	public:
-	SIFTFeatureRepresentation ()
-	{
-		// Define the number of dimensions.
-		nr_dimensions_ = 128 ;
-		trivial_ = false ;
-	}
-
-	/// Overrides the copyToFloatArray method to define our feature vector
-	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
-	{
-		//This representation is only for determining correspondences (not for use in Kd-tree for example - so use only the SIFT part of the point.
-		for (register int i = 0; i < 128 ; i++)
-			out[i] = p.descriptor[i];//p.descriptor.at<float>(0, i) ;
-	}
-};
-
 MergeUtils::MergeUtils() {
 	// TODO Auto-generated constructor stub
 
@@ -110,9 +95,44 @@ MergeUtils::~MergeUtils() {
 	// TODO Auto-generated destructor stub
 }
 
-void MergeUtils::computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, const pcl::CorrespondencesPtr& correspondences)
+DescriptorIndex::Params MergeUtils::searchParams(Properties properties)
+{
+	DescriptorIndex::Params params;
+	params.trees = properties.correspondences_trees;
+	params.checks = properties.correspondences_checks;
+	return params;
+}
+
+bool MergeUtils::useBruteForce(const pcl::PointCloud<PointXYZSIFT> &cloud_src, const pcl::PointCloud<PointXYZSIFT> &cloud_trg, Properties properties)
+{
+	return properties.correspondences_brute_force > 0 && static_cast<int>(cloud_src.size()) <= properties.correspondences_brute_force
+			&& static_cast<int>(cloud_trg.size()) <= properties.correspondences_brute_force;
+}
+
+DescriptorIndex::Ptr MergeUtils::buildIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud, Properties properties)
+{
+	DescriptorIndex::Ptr index(new DescriptorIndex(searchParams(properties)));
+	index->addCloud(cloud, 0);
+	index->build();
+	return index;
+}
+
+void MergeUtils::computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, const pcl::CorrespondencesPtr& correspondences, Properties properties)
 {
 	//CLOG(LTRACE) << "Computing Correspondences" << std::endl;
+	if (useBruteForce(*cloud_src, *cloud_trg, properties)) {
+		// Small clouds - all distances computed in cache-sized tiles are cheaper than building trees.
+		BruteForceMatcher::Params params;
+		params.ratio = properties.correspondences_ratio;
+		BruteForceMatcher(params).match(*cloud_src, *cloud_trg, *correspondences);
+		return;
+	}
+	if (properties.correspondences_checks >= 0) {
+		// Approximate search - reciprocal check done on two randomized kd-forests.
+		computeCorrespondences(*buildIndex(cloud_src, properties), *buildIndex(cloud_trg, properties), correspondences);
+		return;
+	}
+
 	pcl::registration::CorrespondenceEstimation<PointXYZSIFT, PointXYZSIFT> correst;
 	SIFTFeatureRepresentation::Ptr point_representation(new SIFTFeatureRepresentation());
 	correst.setPointRepresentation(point_representation);
@@ -123,24 +143,229 @@ void MergeUtils::computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::Con
 	//CLOG(LINFO) << "Number of reciprocal correspondences: " << correspondences->size() << " out of " << cloud_src->size() << " features";
 }
 
+void MergeUtils::computeCorrespondences(const DescriptorIndex &src_index, const DescriptorIndex &trg_index, const pcl::CorrespondencesPtr& correspondences)
+{
+	correspondences->clear();
+	correspondences->reserve(src_index.size());
+	std::vector<int> rows, back_rows;
+	std::vector<float> sqr_dists, back_sqr_dists;
+	float src_descriptor[DescriptorDistance::SIFT_SIZE], trg_descriptor[DescriptorDistance::SIFT_SIZE];
+	for (size_t r = 0; r < src_index.size(); ++r) {
+		src_index.copyDescriptor(r, src_descriptor);
+		if (trg_index.knnSearch(src_descriptor, 1, rows, sqr_dists) < 1)
+			continue;
+		trg_index.copyDescriptor(rows[0], trg_descriptor);
+		if (src_index.knnSearch(trg_descriptor, 1, back_rows, back_sqr_dists) < 1 || back_rows[0] != static_cast<int>(r))
+			continue;
+		correspondences->push_back(pcl::Correspondence(src_index.label(r).point_index, trg_index.label(rows[0]).point_index, sqr_dists[0]));
+	}
+}
+
+void MergeUtils::computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, unsigned long trg_generation, IncrementalDescriptorIndex &trg_index, const pcl::CorrespondencesPtr& correspondences, Properties properties)
+{
+	correspondences->clear();
+	if (useBruteForce(*cloud_src, *cloud_trg, properties)) {
+		// Merged cloud still small - matched exhaustively, the index keeps following it.
+		BruteForceMatcher::Params params;
+		params.ratio = properties.correspondences_ratio;
+		BruteForceMatcher(params).match(*cloud_src, *cloud_trg, *correspondences);
+		return;
+	}
+	if (!trg_index.tracks(*cloud_trg, trg_generation))
+		trg_index.reset(*cloud_trg, trg_generation);
+
+	// Only the (small) view is indexed from scratch.
+	DescriptorIndex src_index(searchParams(properties));
+	src_index.addCloud(cloud_src, 0);
+	src_index.build();
+
+	correspondences->reserve(src_index.size());
+	std::vector<int> positions, back_rows;
+	std::vector<float> sqr_dists, back_sqr_dists;
+	for (size_t i = 0; i < cloud_src->size(); ++i) {
+		const float * descriptor = cloud_src->points[i].descriptor;
+		if (!pcl_isfinite(descriptor[0]))
+			continue;
+		if (trg_index.knnSearch(descriptor, 1, positions, sqr_dists) < 1)
+			continue;
+		if (src_index.knnSearch(cloud_trg->points[positions[0]].descriptor, 1, back_rows, back_sqr_dists) < 1
+				|| src_index.label(back_rows[0]).point_index != static_cast<int>(i))
+			continue;
+		correspondences->push_back(pcl::Correspondence(i, positions[0], sqr_dists[0]));
+	}
+}
+
 Eigen::Matrix4f MergeUtils::computeTransformationSAC(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg,
 		const pcl::CorrespondencesConstPtr& correspondences, pcl::Correspondences& inliers, Properties properties)
 {
 	//CLOG(LTRACE) << "Computing SAC" << std::endl;
 
-	pcl::registration::CorrespondenceRejectorSampleConsensus<PointXYZSIFT> sac ;
-	sac.setInputSource(cloud_src) ;
-	sac.setInputTarget(cloud_trg) ;
-	sac.setInlierThreshold(properties.RanSAC_inliers_threshold) ; //property RanSAC
-	sac.setMaximumIterations(properties.RanSAC_max_iterations) ; //property RanSAC
-	sac.setInputCorrespondences(correspondences) ;
-	sac.getCorrespondences(inliers) ;
+	RigidSampleConsensus::Params params;
+	params.inlier_threshold = properties.RanSAC_inliers_threshold; //property RanSAC
+	params.max_iterations = properties.RanSAC_max_iterations; //property RanSAC
+	params.confidence = properties.RanSAC_confidence;
+	params.guided = properties.RanSAC_guided;
+	params.threads = properties.RanSAC_threads;
+	RigidSampleConsensus sac(params);
+	sac.setCorrespondences(*cloud_src, *cloud_trg, *correspondences);
+
+	Eigen::Matrix4f transformation;
+	std::vector<int> positions;
+	// As the PCL rejector - without a model all correspondences are kept.
+	if (!sac.compute(transformation, positions)) {
+		inliers = *correspondences;
+		return Eigen::Matrix4f::Identity();
+	}
+	inliers.clear();
+	inliers.reserve(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+		inliers.push_back((*correspondences)[positions[i]]);
 
-	//CLOG(LINFO) << "SAC inliers " << inliers.size();
+	//CLOG(LINFO) << "SAC inliers " << inliers.size() << " hypotheses " << sac.getIterations();
 
-	return sac.getBestTransformation() ;
+	return transformation;
 }
 
+namespace {
+
+/// Pairs of views shared by threads of MergeUtils::registerPairs().
+struct PairQueue {
+	pcl::PointCloud<PointXYZSIFT>::ConstPtr cloud_src;
+	const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> * targets;
+	std::vector<pcl::CorrespondencesPtr> * inliers;
+	MergeUtils::Properties properties;
+
+	/// Descriptor indices of the source and of the targets, null - built for every pair.
+	DescriptorIndex::Ptr src_index;
+	const std::vector<DescriptorIndex::Ptr> * target_indices;
+
+	/// Next pair to be taken.
+	size_t next;
+	boost::mutex next_mutex;
+};
+
+/// Registers pairs taken from the queue until all are done - results are written to disjoint slots, so only the counter is locked.
+void registerPairsWorker(PairQueue * queue)
+{
+	for (;;) {
+		size_t t;
+		{
+			boost::mutex::scoped_lock lock(queue->next_mutex);
+			if (queue->next >= queue->targets->size())
+				return;
+			t = queue->next++;
+		}
+		const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud_trg = (*queue->targets)[t];
+		pcl::CorrespondencesPtr correspondences(new pcl::Correspondences());
+		if (queue->src_index && queue->target_indices && (*queue->target_indices)[t]
+				&& !MergeUtils::useBruteForce(*queue->cloud_src, *cloud_trg, queue->properties))
+			MergeUtils::computeCorrespondences(*queue->src_index, *(*queue->target_indices)[t], correspondences);
+		else
+			MergeUtils::computeCorrespondences(queue->cloud_src, cloud_trg, correspondences, queue->properties);
+		MergeUtils::computeTransformationSAC(queue->cloud_src, cloud_trg, correspondences, *(*queue->inliers)[t], queue->properties);
+	}
+}
+
+} //: namespace
+
+void MergeUtils::registerPairs(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> &targets,
+		std::vector<pcl::CorrespondencesPtr> &inliers, Properties properties, int threads)
+{
+	registerPairs(cloud_src, DescriptorIndex::Ptr(), targets, std::vector<DescriptorIndex::Ptr>(), inliers, properties, threads);
+}
+
+void MergeUtils::registerPairs(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const DescriptorIndex::Ptr &src_index,
+		const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> &targets, const std::vector<DescriptorIndex::Ptr> &target_indices,
+		std::vector<pcl::CorrespondencesPtr> &inliers, Properties properties, int threads)
+{
+	inliers.resize(targets.size());
+	for (size_t t = 0; t < targets.size(); ++t)
+		inliers[t].reset(new pcl::Correspondences());
+
+	PairQueue queue;
+	queue.cloud_src = cloud_src;
+	queue.targets = &targets;
+	queue.inliers = &inliers;
+	queue.properties = properties;
+	queue.src_index = src_index;
+	queue.target_indices = target_indices.size() == targets.size() ? &target_indices : NULL;
+	queue.next = 0;
+
+	if (threads <= 0)
+		threads = std::max(1u, boost::thread::hardware_concurrency());
+	threads = std::min<int>(threads, targets.size());
+	if (threads > 1) {
+		// Pairs already keep the cores busy - hypotheses of every pair are scored by its own thread.
+		queue.properties.RanSAC_threads = 1;
+		boost::thread_group pool;
+		for (int i = 0; i < threads; ++i)
+			pool.create_thread(boost::bind(&registerPairsWorker, &queue));
+		pool.join_all();
+	} else {
+		registerPairsWorker(&queue);
+	}
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr MergeUtils::cropToBoundingBox(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg, float margin)
+{
+	if (cloud_src->empty())
+		return cloud_trg;
+	pcl::PointXYZRGB min_pt, max_pt;
+	pcl::getMinMax3D(*cloud_src, min_pt, max_pt);
+
+	pcl::CropBox<pcl::PointXYZRGB> crop;
+	crop.setMin(Eigen::Vector4f(min_pt.x - margin, min_pt.y - margin, min_pt.z - margin, 1.0f));
+	crop.setMax(Eigen::Vector4f(max_pt.x + margin, max_pt.y + margin, max_pt.z + margin, 1.0f));
+	crop.setInputCloud(cloud_trg);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cropped (new pcl::PointCloud<pcl::PointXYZRGB>());
+	crop.filter(*cropped);
+	return cropped;
+}
+
+namespace {
+
+/// Voxel grid downsampling of the cloud.
+template <typename PointT>
+typename pcl::PointCloud<PointT>::Ptr downsample(const typename pcl::PointCloud<PointT>::Ptr &cloud, float leaf_size)
+{
+	typename pcl::PointCloud<PointT>::Ptr result(new pcl::PointCloud<PointT>());
+	pcl::VoxelGrid<PointT> grid;
+	grid.setLeafSize(leaf_size, leaf_size, leaf_size);
+	grid.setInputCloud(cloud);
+	grid.filter(*result);
+	return result;
+}
+
+/// Aligns voxel-downsampled clouds from the coarsest level of the pyramid, returns the transformation to start the full resolution with.
+/// Levels keep the criteria set in the registration, only the correspondence distance and the number of iterations are scheduled.
+template <typename PointT>
+Eigen::Matrix4f alignPyramid(pcl::Registration<PointT, PointT> &registration, const typename pcl::PointCloud<PointT>::Ptr &cloud_src,
+		const typename pcl::PointCloud<PointT>::Ptr &cloud_trg, MergeUtils::Properties properties)
+{
+	Eigen::Matrix4f guess = Eigen::Matrix4f::Identity();
+	typename pcl::PointCloud<PointT>::Ptr aligned(new pcl::PointCloud<PointT>());
+	for (int level = properties.ICP_pyramid_levels; level > 0; --level) {
+		const float scale = static_cast<float>(1 << (level - 1));
+		typename pcl::PointCloud<PointT>::Ptr src = downsample<PointT>(cloud_src, properties.ICP_pyramid_leaf * scale);
+		typename pcl::PointCloud<PointT>::Ptr trg = downsample<PointT>(cloud_trg, properties.ICP_pyramid_leaf * scale);
+		// Too few voxels to constrain the transformation - go to a finer level.
+		if (src->size() < 3 || trg->size() < 3)
+			continue;
+		registration.setMaxCorrespondenceDistance(properties.ICP_max_correspondence_distance * 2 * scale);
+		registration.setMaximumIterations(properties.ICP_pyramid_coarse_iterations);
+		registration.setInputSource(src);
+		registration.setInputTarget(trg);
+		registration.align(*aligned, guess);
+		if (registration.hasConverged())
+			guess = registration.getFinalTransformation();
+	}
+	registration.setMaxCorrespondenceDistance(properties.ICP_max_correspondence_distance);
+	registration.setMaximumIterations(properties.ICP_pyramid_levels > 0 ? properties.ICP_pyramid_fine_iterations : properties.ICP_max_iterations);
+	return guess;
+}
+
+} //: namespace
+
 Eigen::Matrix4f MergeUtils::computeTransformationICP(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg, Properties properties)
 {
         // Use ICP to get "better" transformation.
@@ -155,10 +380,11 @@ Eigen::Matrix4f MergeUtils::computeTransformationICP(const pcl::PointCloud<pcl::
         // Set the euclidean distance difference epsilon (criterion 3)
         icp.setEuclideanFitnessEpsilon (1); // property ?
 
+        Eigen::Matrix4f guess = alignPyramid<pcl::PointXYZRGB>(icp, cloud_src, cloud_trg, properties);
         icp.setInputSource(cloud_src);
         icp.setInputTarget(cloud_trg);
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr Final (new pcl::PointCloud<pcl::PointXYZRGB>());
-        icp.align(*Final);
+        icp.align(*Final, guess);
       //  CLOG(LINFO) << "ICP has converged:" << icp.hasConverged() << " score: " << icp.getFitnessScore();
 
         // Get the transformation from target to source.
@@ -180,12 +406,15 @@ Eigen::Matrix4f MergeUtils::computeTransformationICPColor(const pcl::PointCloud<
         icp.setEuclideanFitnessEpsilon (1); // property ?
 
         pcl::registration::CorrespondenceEstimationColor<pcl::PointXYZRGB, pcl::PointXYZRGB, float>::Ptr ceptr(new pcl::registration::CorrespondenceEstimationColor<pcl::PointXYZRGB, pcl::PointXYZRGB, float>);
+        ceptr->setColorWeight(properties.ICP_color_weight);
+        ceptr->setNumberOfThreads(properties.ICP_threads);
         icp.setCorrespondenceEstimation(ceptr);
 
+        Eigen::Matrix4f guess = alignPyramid<pcl::PointXYZRGB>(icp, cloud_src, cloud_trg, properties);
         icp.setInputSource(cloud_src);
         icp.setInputTarget(cloud_trg);
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr Final (new pcl::PointCloud<pcl::PointXYZRGB>());
-        icp.align(*Final);
+        icp.align(*Final, guess);
 
 
 
@@ -198,52 +427,116 @@ Eigen::Matrix4f MergeUtils::computeTransformationICPColor(const pcl::PointCloud<
 
 
 
-Eigen::Matrix4f MergeUtils::computeTransformationICPNormals(const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_trg, Properties properties)
-{
-    // Use ICP to get "better" transformation.
-    pcl::IterativeClosestPointWithNormals<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> icp;
-
-    // Set the max correspondence distance to 5cm (e.g., correspondences with higher distances will be ignored)
-    icp.setMaxCorrespondenceDistance (properties.ICP_max_correspondence_distance); //property
-    // Set the maximum number of iterations (criterion 1)
-    icp.setMaximumIterations (properties.ICP_max_iterations); // property
-    // Set the transformation epsilon (criterion 2)
-    icp.setTransformationEpsilon (properties.ICP_transformation_epsilon); //property
-    // Set the euclidean distance difference epsilon (criterion 3)
-    icp.setEuclideanFitnessEpsilon (0.001); // property ?
-
-    icp.setInputSource(cloud_src);
-    icp.setInputTarget(cloud_trg);
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr Final (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr points_with_normals_src (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-
-    // Run the same optimization in a loop and visualize the results
-    Eigen::Matrix4f Ti = Eigen::Matrix4f::Identity (), prev, targetToSource;
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr reg_result (new pcl::PointCloud<pcl::PointXYZRGBNormal>());
-    reg_result = cloud_src;
-
-    for (int i = 0; i < 100; ++i)
-    {
-      // Estimate
-        icp.setInputSource(reg_result);
-        icp.align (*Final);
-        if(icp.converged_==false)
-        {
-        	PCL_INFO("Not enough correspondences so nothing happened\n");
-        	return Eigen::Matrix4f::Identity();
-        }
-  		//accumulate transformation between each Iteration
-      Ti = icp.getFinalTransformation () * Ti;
-
-  		//if the difference between this transformation and the previous one
-  		//is smaller than the threshold, refine the process by reducing
-  		//the maximal correspondence distance
-      if (fabs ((icp.getLastIncrementalTransformation () - prev).sum ()) < icp.getTransformationEpsilon ())
-        icp.setMaxCorrespondenceDistance (icp.getMaxCorrespondenceDistance () - 0.001);
-      prev = icp.getLastIncrementalTransformation ();
-      reg_result= Final;
-    }
-
-    // Get the transformation from target to source.
-    return icp.getFinalTransformation();//.inverse();
+namespace {
+
+typedef pcl::PointXYZRGBNormal PointNormalRGB;
+
+/// Point-to-plane ICP (linearized least squares, Low 2004) refining the transformation of the source onto the target with normals.
+/// The correspondence distance starts at max_distance and is halved whenever the increments fall below epsilon, down to min_distance,
+/// where such increments stop the run. Returns true on convergence, the report holds diagnostics of the run.
+bool alignPointToPlane(const pcl::PointCloud<PointNormalRGB> &cloud_src, const pcl::PointCloud<PointNormalRGB> &cloud_trg,
+		const pcl::KdTreeFLANN<PointNormalRGB> &tree, Eigen::Matrix4f &transformation, float max_distance, float min_distance,
+		int max_iterations, double epsilon, MergeUtils::ICPReport &report)
+{
+	float distance = max_distance;
+	std::vector<int> nn_indices(1);
+	std::vector<float> nn_dists(1);
+	PointNormalRGB query;
+	report.converged = false;
+	for (int iteration = 0; iteration < max_iterations; ++iteration) {
+		const Eigen::Matrix3f rotation = transformation.topLeftCorner<3, 3>();
+		const Eigen::Vector3f translation = transformation.topRightCorner<3, 1>();
+		const float sqr_distance = distance * distance;
+
+		// Normal equations of the residuals n . (R p + t - q), linearized in (rotation angles, translation).
+		Eigen::Matrix<double, 6, 6> ata = Eigen::Matrix<double, 6, 6>::Zero();
+		Eigen::Matrix<double, 6, 1> atb = Eigen::Matrix<double, 6, 1>::Zero();
+		int count = 0;
+		double sqr_sum = 0;
+		for (size_t i = 0; i < cloud_src.size(); ++i) {
+			if (!pcl_isfinite(cloud_src.points[i].x) || !pcl_isfinite(cloud_src.points[i].y) || !pcl_isfinite(cloud_src.points[i].z))
+				continue;
+			const Eigen::Vector3f p = rotation * cloud_src.points[i].getVector3fMap() + translation;
+			query.getVector3fMap() = p;
+			if (tree.nearestKSearch(query, 1, nn_indices, nn_dists) < 1 || nn_dists[0] > sqr_distance)
+				continue;
+			const PointNormalRGB &q = cloud_trg.points[nn_indices[0]];
+			Eigen::Vector3f normal = q.getNormalVector3fMap();
+			const float norm = normal.norm();
+			if (!pcl_isfinite(norm) || norm < 1e-6f)
+				continue;
+			normal /= norm;
+			Eigen::Matrix<double, 6, 1> row;
+			row.head<3>() = p.cross(normal).cast<double>();
+			row.tail<3>() = normal.cast<double>();
+			ata += row * row.transpose();
+			atb += row * static_cast<double>(normal.dot(q.getVector3fMap() - p));
+			sqr_sum += nn_dists[0];
+			++count;
+		}
+		report.iterations = iteration + 1;
+		report.correspondences = count;
+		report.fitness = count > 0 ? sqr_sum / count : 0;
+		// Six parameters need at least six constraints.
+		if (count < 6)
+			return false;
+
+		const Eigen::Matrix<double, 6, 1> x = ata.ldlt().solve(atb);
+		const Eigen::Affine3f increment = Eigen::Translation3f(x.tail<3>().cast<float>())
+				* Eigen::AngleAxisf(static_cast<float>(x[2]), Eigen::Vector3f::UnitZ())
+				* Eigen::AngleAxisf(static_cast<float>(x[1]), Eigen::Vector3f::UnitY())
+				* Eigen::AngleAxisf(static_cast<float>(x[0]), Eigen::Vector3f::UnitX());
+		transformation = increment.matrix() * transformation;
+
+		if (x.tail<3>().squaredNorm() < epsilon && 1 - std::cos(x.head<3>().norm()) < epsilon) {
+			if (distance <= min_distance) {
+				report.converged = true;
+				return true;
+			}
+			distance = std::max(min_distance, distance * 0.5f);
+		}
+	}
+	return false;
+}
+
+} //: namespace
+
+Eigen::Matrix4f MergeUtils::computeTransformationICPNormals(const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_trg, Properties properties, ICPReport *report)
+{
+	ICPReport result;
+	const float min_distance = std::min(properties.ICP_min_correspondence_distance, properties.ICP_max_correspondence_distance);
+	pcl::KdTreeFLANN<pcl::PointXYZRGBNormal> tree;
+
+	// Coarse levels, each converged at its own correspondence distance.
+	Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+	for (int level = properties.ICP_pyramid_levels; level > 0; --level) {
+		const float scale = static_cast<float>(1 << (level - 1));
+		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr src = downsample<pcl::PointXYZRGBNormal>(cloud_src, properties.ICP_pyramid_leaf * scale);
+		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr trg = downsample<pcl::PointXYZRGBNormal>(cloud_trg, properties.ICP_pyramid_leaf * scale);
+		// Too few voxels to constrain the transformation - go to a finer level.
+		if (src->size() < 6 || trg->size() < 3)
+			continue;
+		tree.setInputCloud(trg);
+		const float level_distance = properties.ICP_max_correspondence_distance * 2 * scale;
+		Eigen::Matrix4f level_transformation = transformation;
+		ICPReport level_report;
+		if (alignPointToPlane(*src, *trg, tree, level_transformation, level_distance, level_distance, properties.ICP_pyramid_coarse_iterations,
+				properties.ICP_transformation_epsilon, level_report))
+			transformation = level_transformation;
+	}
+
+	// Full resolution, annealed from the maximal to the minimal correspondence distance.
+	if (cloud_trg->size() > 0) {
+		tree.setInputCloud(cloud_trg);
+		alignPointToPlane(*cloud_src, *cloud_trg, tree, transformation, properties.ICP_max_correspondence_distance, min_distance,
+				properties.ICP_pyramid_levels > 0 ? properties.ICP_pyramid_fine_iterations : properties.ICP_max_iterations,
+				properties.ICP_transformation_epsilon, result);
+	}
+	if (report)
+		*report = result;
+	if (result.correspondences < 6) {
+		PCL_INFO("Not enough correspondences so nothing happened\n");
+		return Eigen::Matrix4f::Identity();
+	}
+	return transformation;
 }
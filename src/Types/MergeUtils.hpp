@@ -14,6 +14,9 @@
 #include "Property.hpp"
 #include "EventHandler2.hpp"
 
+#include <algorithm>
+#include <vector>
+
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <Types/PointXYZSIFT.hpp>
@@ -27,6 +30,8 @@
 
 #include <opencv2/core/core.hpp>
 #include "CorrespondenceEstimationColor.hpp"
+#include "IncrementalDescriptorIndex.hpp"
+#include "BruteForceMatcher.hpp"
 
 class MergeUtils {
 public:
@@ -39,18 +44,141 @@ public:
 		float ICP_max_correspondence_distance;
 		float RanSAC_inliers_threshold;
 		float RanSAC_max_iterations;
+		/// Probability of drawing an all-inlier sample at which SAC stops (1 - always RanSAC_max_iterations hypotheses).
+		double RanSAC_confidence;
+		/// PROSAC: SAC samples from the correspondences with the smallest descriptor distances first (false - uniform sampling).
+		bool RanSAC_guided;
+		/// Number of threads scoring SAC hypotheses (0 - one per core).
+		int RanSAC_threads;
+		/// Descriptor search: number of randomized kd-trees and checks per query (negative - exact search).
+		int correspondences_trees;
+		int correspondences_checks;
+		/// Clouds with at most this number of features are matched exhaustively with BruteForceMatcher (0 - never).
+		int correspondences_brute_force;
+		/// Ratio test of the brute-force matching (0 - disabled).
+		float correspondences_ratio;
+		/// Coarse-to-fine ICP: number of voxel-downsampled levels aligned before the full resolution (0 - full resolution only).
+		int ICP_pyramid_levels;
+		/// Leaf size of the finest downsampled level - doubled, together with the correspondence distance, at every coarser level.
+		float ICP_pyramid_leaf;
+		/// Iterations at every downsampled level of the pyramid.
+		int ICP_pyramid_coarse_iterations;
+		/// Iterations at the full resolution after the pyramid.
+		int ICP_pyramid_fine_iterations;
+		/// Point-to-plane ICP halves the correspondence distance (from ICP_max_correspondence_distance) down to this one as it converges.
+		float ICP_min_correspondence_distance;
+		/// Colour ICP: weight of the Lab colour difference against the spatial distance (metres per Lab unit, 0 - spatial only).
+		float ICP_color_weight;
+		/// Colour ICP: number of threads searching the correspondences (1 - sequential, 0 - one per core).
+		int ICP_threads;
+
+		Properties() : RanSAC_confidence(0.99), RanSAC_guided(true), RanSAC_threads(1), correspondences_trees(4), correspondences_checks(-1), correspondences_brute_force(5000), correspondences_ratio(0),
+				ICP_pyramid_levels(0), ICP_pyramid_leaf(0.005f), ICP_pyramid_coarse_iterations(20), ICP_pyramid_fine_iterations(10), ICP_min_correspondence_distance(0.01f),
+				ICP_color_weight(0.001f), ICP_threads(1) {}
+	};
+
+	/// Diagnostics of an ICP run.
+	struct ICPReport {
+		/// Number of performed iterations (at the full resolution).
+		int iterations;
+		/// Mean squared distance of the correspondences of the last iteration.
+		double fitness;
+		/// Number of correspondences of the last iteration.
+		int correspondences;
+		/// True if the increments fell below the transformation epsilon at the minimal correspondence distance.
+		bool converged;
+
+		ICPReport() : iterations(0), fitness(0), correspondences(0), converged(false) {}
 	};
 
-    // Computes the correspondences between two XYZSIFT clouds
-    static void computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, const pcl::CorrespondencesPtr& correspondence);
+    /// Returns parameters of the descriptor search set in properties.
+    static DescriptorIndex::Params searchParams(Properties properties);
+
+    /// Predicate selecting features marked for removal (multiplicity set to -1).
+    struct RemovedFeature {
+    	bool operator()(const PointXYZSIFT & p) const { return p.multiplicity == -1; }
+    };
+
+    /// Removes (in place, in a single pass) points satisfying the predicate, remaining points keep their order. Returns the number of removed points.
+    template <typename PointT, typename Predicate>
+    static size_t removePointsIf(pcl::PointCloud<PointT> &cloud, Predicate predicate);
+
+    /// Removes (in place, in a single pass) points with the given indices (in any order, duplicates allowed), remaining points keep their order.
+    template <typename PointT>
+    static size_t removePoints(pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices);
+
+    // Computes the (reciprocal) correspondences between two XYZSIFT clouds
+    static void computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, const pcl::CorrespondencesPtr& correspondence, Properties properties = Properties());
+
+    /// Returns true if the clouds are small enough to be matched exhaustively.
+    static bool useBruteForce(const pcl::PointCloud<PointXYZSIFT> &cloud_src, const pcl::PointCloud<PointXYZSIFT> &cloud_trg, Properties properties);
 
-    /// Computes the transformation between two XYZSIFT clouds basing on the found correspondences.
+    /// Builds the descriptor index of the cloud (e.g. once per view, to be reused by all its matches).
+    static DescriptorIndex::Ptr buildIndex(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud, Properties properties);
+
+    /// Computes the reciprocal correspondences between two clouds described by their (prebuilt) descriptor indices.
+    static void computeCorrespondences(const DescriptorIndex &src_index, const DescriptorIndex &trg_index, const pcl::CorrespondencesPtr& correspondences);
+
+    /// Computes the reciprocal correspondences between a view and the given generation of the (merged) cloud followed by trg_index - the index is rebuilt only if it does not mirror this generation.
+    /// Clouds small enough for useBruteForce() are matched exhaustively.
+    static void computeCorrespondences(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg, unsigned long trg_generation, IncrementalDescriptorIndex &trg_index, const pcl::CorrespondencesPtr& correspondences, Properties properties = Properties());
+
+    /// Computes the transformation between two XYZSIFT clouds basing on the found correspondences (RigidSampleConsensus).
     static Eigen::Matrix4f computeTransformationSAC(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_trg,
 		const pcl::CorrespondencesConstPtr& correspondences, pcl::Correspondences& inliers, Properties properties);
 
+    /// Matches the source with each of the targets and verifies the correspondences with SAC - inliers[t] belong to targets[t].
+    /// Pairs are independent, so they are processed by the given number of threads (0 - one per core).
+    static void registerPairs(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> &targets,
+		std::vector<pcl::CorrespondencesPtr> &inliers, Properties properties, int threads = 1);
+
+    /// Same as above, but descriptors are searched in the given (cached) indices - one per target - unless the clouds are matched exhaustively.
+    static void registerPairs(const pcl::PointCloud<PointXYZSIFT>::ConstPtr &cloud_src, const DescriptorIndex::Ptr &src_index,
+		const std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> &targets, const std::vector<DescriptorIndex::Ptr> &target_indices,
+		std::vector<pcl::CorrespondencesPtr> &inliers, Properties properties, int threads = 1);
+
+    /// Returns points of the target lying in the bounding box of the source enlarged by margin (ICP target restricted to the overlap).
+    static pcl::PointCloud<pcl::PointXYZRGB>::Ptr cropToBoundingBox(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg, float margin);
+
     static Eigen::Matrix4f computeTransformationICP(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg, Properties properties);
+    /// ICP with correspondences found in the joint space of coordinates and Lab colour weighted by ICP_color_weight.
     static Eigen::Matrix4f computeTransformationICPColor(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_trg, Properties properties);
-    static Eigen::Matrix4f computeTransformationICPNormals(const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_trg, Properties properties);
+    /// Point-to-plane ICP of clouds with normals in a single run, identity if there are not enough correspondences. Diagnostics are written to the report (if given).
+    static Eigen::Matrix4f computeTransformationICPNormals(const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_src, const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr &cloud_trg, Properties properties, ICPReport *report = NULL);
 };
 
+template <typename PointT, typename Predicate>
+size_t MergeUtils::removePointsIf(pcl::PointCloud<PointT> &cloud, Predicate predicate)
+{
+	typename pcl::PointCloud<PointT>::VectorType::iterator end = std::remove_if(cloud.points.begin(), cloud.points.end(), predicate);
+	size_t removed = cloud.points.end() - end;
+	cloud.points.erase(end, cloud.points.end());
+	cloud.width = static_cast<uint32_t>(cloud.points.size());
+	cloud.height = 1;
+	return removed;
+}
+
+template <typename PointT>
+size_t MergeUtils::removePoints(pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices)
+{
+	std::vector<bool> removed(cloud.points.size(), false);
+	for (size_t i = 0; i < indices.size(); ++i)
+		if (indices[i] >= 0 && static_cast<size_t>(indices[i]) < removed.size())
+			removed[indices[i]] = true;
+
+	size_t kept = 0;
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		if (removed[i])
+			continue;
+		if (kept != i)
+			cloud.points[kept] = cloud.points[i];
+		++kept;
+	}
+	size_t count = cloud.points.size() - kept;
+	cloud.points.resize(kept);
+	cloud.width = static_cast<uint32_t>(kept);
+	cloud.height = 1;
+	return count;
+}
+
 #endif /* MERGEUTILS_HPP_ */
@@ -0,0 +1,152 @@
+/*!
+ * \file
+ * \brief Incremental concatenation of posed views into a merged cloud.
+ */
+
+#ifndef MERGEDCLOUDASSEMBLER_HPP_
+#define MERGEDCLOUDASSEMBLER_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/point_cloud.h>
+
+/*!
+ * \class MergedCloudAssembler
+ * \brief Merged cloud of views, each transformed by its (changing) pose.
+ *
+ * Views are stored once, in their own frames, and the merged cloud is a
+ * preallocated buffer holding the transformed views one after another. After
+ * a pose graph optimization only the views whose poses moved by more than the
+ * tolerance (or which were invalidated - e.g. moved in place) are transformed
+ * again, directly into their segments of the buffer, so reassembling costs time
+ * proportional to the changed views instead of copying all of them.
+ *
+ * As pcl::transformPointCloud() only point coordinates are transformed.
+ */
+template <typename PointT>
+class MergedCloudAssembler {
+public:
+	typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+	typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+
+	/// Tolerance is the largest change of a pose matrix element which does not require transforming the view again.
+	explicit MergedCloudAssembler(float tolerance = 1e-5f) : tolerance(tolerance), assembled_views(0), cloud(new pcl::PointCloud<PointT>()) {}
+
+	void setTolerance(float tolerance) { this->tolerance = tolerance; }
+
+	/// Removes all views (the merged cloud is emptied in place).
+	void clear();
+
+	/// Adds the view (its cloud has to be kept alive and must not change size) with the given pose, returns its number.
+	size_t addView(const CloudConstPtr & view, const Eigen::Matrix4f & pose = Eigen::Matrix4f::Identity());
+
+	/// Sets the pose of the view, returns true if it changed by more than the tolerance (the view will be transformed again).
+	bool setPose(size_t view, const Eigen::Matrix4f & pose);
+
+	/// Marks the view as changed (e.g. its points were moved in place).
+	void invalidate(size_t view) { changed[view] = true; }
+
+	/// Marks all views as changed.
+	void invalidateAll() { std::fill(changed.begin(), changed.end(), true); }
+
+	/// Updates the merged cloud to the concatenation of the first views (all by default), returns the number of transformed views.
+	size_t assemble(size_t views = static_cast<size_t>(-1));
+
+	/// Merged cloud, updated in place by assemble().
+	const CloudPtr & getCloud() const { return cloud; }
+
+	/// Number of added views.
+	size_t size() const { return views.size(); }
+
+protected:
+	float tolerance;
+
+	/// Clouds of the views in their own frames.
+	std::vector<CloudConstPtr> views;
+
+	/// Poses of the views.
+	std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > poses;
+
+	/// Poses with which the views were written to the merged cloud.
+	std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > written_poses;
+
+	/// Views which have to be transformed again.
+	std::vector<bool> changed;
+
+	/// Position of every view in the merged cloud.
+	std::vector<size_t> offsets;
+
+	/// Number of views in the merged cloud.
+	size_t assembled_views;
+
+	CloudPtr cloud;
+};
+
+template <typename PointT>
+void MergedCloudAssembler<PointT>::clear()
+{
+	views.clear();
+	poses.clear();
+	written_poses.clear();
+	changed.clear();
+	offsets.assign(1, 0);
+	assembled_views = 0;
+	cloud->clear();
+}
+
+template <typename PointT>
+size_t MergedCloudAssembler<PointT>::addView(const CloudConstPtr & view, const Eigen::Matrix4f & pose)
+{
+	if (offsets.empty())
+		offsets.push_back(0);
+	views.push_back(view);
+	poses.push_back(pose);
+	written_poses.push_back(pose);
+	changed.push_back(true);
+	offsets.push_back(offsets.back() + view->size());
+	return views.size() - 1;
+}
+
+template <typename PointT>
+bool MergedCloudAssembler<PointT>::setPose(size_t view, const Eigen::Matrix4f & pose)
+{
+	poses[view] = pose;
+	if ((pose - written_poses[view]).cwiseAbs().maxCoeff() <= tolerance)
+		return false;
+	changed[view] = true;
+	return true;
+}
+
+template <typename PointT>
+size_t MergedCloudAssembler<PointT>::assemble(size_t nr_views)
+{
+	nr_views = std::min(nr_views, views.size());
+	// Views keep their sizes, so segments of the already assembled views stay in place.
+	cloud->points.resize(nr_views > 0 ? offsets[nr_views] : 0);
+	size_t transformed = 0;
+	for (size_t v = 0; v < nr_views; ++v) {
+		if (v < assembled_views && !changed[v])
+			continue;
+		const Eigen::Matrix3f rotation = poses[v].template topLeftCorner<3, 3>();
+		const Eigen::Vector3f translation = poses[v].template topRightCorner<3, 1>();
+		const pcl::PointCloud<PointT> & view = *views[v];
+		typename pcl::PointCloud<PointT>::VectorType::iterator out = cloud->points.begin() + offsets[v];
+		for (size_t i = 0; i < view.size(); ++i, ++out) {
+			*out = view.points[i];
+			out->getVector3fMap() = rotation * view.points[i].getVector3fMap() + translation;
+		}
+		written_poses[v] = poses[v];
+		changed[v] = false;
+		++transformed;
+	}
+	assembled_views = nr_views;
+	cloud->width = cloud->points.size();
+	cloud->height = 1;
+	return transformed;
+}
+
+#endif /* MERGEDCLOUDASSEMBLER_HPP_ */
@@ -0,0 +1,43 @@
+/*!
+ * \file
+ * \brief Model-scene correspondences of SIFT descriptors, per model or for a whole model library at once.
+ */
+
+#include "ModelMatcher.hpp"
+
+bool ModelMatcher::accept(float sqr_dist, float second_sqr_dist) const {
+	if (params.max_distance > 0 && sqr_dist > params.max_distance * params.max_distance)
+		return false;
+	if (params.use_ratio_test && second_sqr_dist >= 0) {
+		// Distances are squared, so is the ratio.
+		return sqr_dist < params.ratio * params.ratio * second_sqr_dist;
+	}
+	return true;
+}
+
+int ModelMatcher::jointNeighbours(size_t index_size) const {
+	return static_cast<int>(std::min<size_t>(std::max(params.joint_knn, 2), index_size));
+}
+
+size_t ModelMatcher::matchModel(const DescriptorIndex & tree, const pcl::PointCloud<PointXYZSIFT> & scene, pcl::Correspondences & correspondences) const {
+	if (tree.empty())
+		return 0;
+
+	// Second neighbour is needed only for the ratio test.
+	int k = params.use_ratio_test ? 2 : 1;
+	size_t candidates = 0;
+	std::vector<int> neigh_indices;
+	std::vector<float> neigh_sqr_dists;
+	//  For each scene keypoint descriptor, find nearest neighbor into the model keypoints descriptor cloud and add it to the correspondences vector.
+	for (size_t j = 0; j < scene.size(); ++j) {
+		if (!pcl_isfinite(scene.points[j].descriptor[0])) //skipping NaNs
+			continue;
+		int found_neighs = tree.knnSearch(scene.points[j].descriptor, k, neigh_indices, neigh_sqr_dists);
+		if (found_neighs < 1)
+			continue;
+		++candidates;
+		if (accept(neigh_sqr_dists[0], found_neighs > 1 ? neigh_sqr_dists[1] : -1.0f))
+			correspondences.push_back(pcl::Correspondence(tree.label(neigh_indices[0]).point_index, static_cast<int>(j), neigh_sqr_dists[0]));
+	}
+	return candidates;
+}
@@ -0,0 +1,146 @@
+/*!
+ * \file
+ * \brief Model-scene correspondences of SIFT descriptors, per model or for a whole model library at once.
+ */
+
+#ifndef MODELMATCHER_HPP_
+#define MODELMATCHER_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+#include <pcl/pcl_macros.h>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorIndex.hpp>
+
+/*!
+ * \class ModelMatcher
+ * \brief Matches scene descriptors to model descriptors with the distance cutoff and Lowe's ratio test.
+ *
+ * A model is matched either with its own index (two neighbours per scene feature),
+ * or all models are matched with one query per scene feature to an index over the
+ * whole library (DescriptorIndex, IVFPQIndex) - then a model is considered only if
+ * its nearest descriptor is among the k (joint_knn) nearest of the library, so the
+ * cost of a scene feature does not grow with the number of models.
+ *
+ * The ratio test of a model needs its second nearest descriptor. If the model
+ * appears twice in the list, it is known. Otherwise (for an exact index, which did
+ * not return all descriptors) the k-th distance bounds it from below, so a match
+ * passing the test against the bound is accepted at once. The remaining models,
+ * appearing once, are queried for their second neighbour with knnSearchCloud().
+ * With an exact index the result therefore equals the per-model matching for all
+ * models reaching the k nearest descriptors.
+ *
+ * Correspondences hold model point indices as queries and scene point indices as matches.
+ */
+class ModelMatcher {
+public:
+	/// Matching parameters.
+	struct Params {
+		/// Maximal descriptor distance of a correspondence (0 - no limit).
+		float max_distance;
+
+		/// Filter correspondences with the ratio test.
+		bool use_ratio_test;
+
+		/// Ratio of the distances to the nearest and second nearest model feature.
+		float ratio;
+
+		/// Number of neighbours retrieved from the library index per scene feature (at least 2).
+		int joint_knn;
+
+		Params() : max_distance(0), use_ratio_test(true), ratio(0.75f), joint_knn(5) {}
+	};
+
+	explicit ModelMatcher(const Params & params = Params()) : params(params) {}
+
+	void setParams(const Params & params) { this->params = params; }
+
+	const Params & getParams() const { return params; }
+
+	/// Checks the match against max_distance and (if second_sqr_dist >= 0) against the ratio test.
+	bool accept(float sqr_dist, float second_sqr_dist) const;
+
+	/// Number of neighbours of a query to the library index of the given size.
+	int jointNeighbours(size_t index_size) const;
+
+	/// Matches the scene with a single model indexed by the tree, returns the number of matches before filtering.
+	size_t matchModel(const DescriptorIndex & tree, const pcl::PointCloud<PointXYZSIFT> & scene, pcl::Correspondences & correspondences) const;
+
+	/// Matches the scene with all models of the library index (labelled with model ids from [0, nr_models)).
+	/// Correspondences and numbers of matches before filtering of every model are appended to the vectors (of nr_models elements).
+	template <typename Index>
+	void matchJoint(const Index & index, const pcl::PointCloud<PointXYZSIFT> & scene, size_t nr_models,
+			std::vector<pcl::Correspondences> & correspondences, std::vector<size_t> & candidates) const;
+
+protected:
+	Params params;
+};
+
+template <typename Index>
+void ModelMatcher::matchJoint(const Index & index, const pcl::PointCloud<PointXYZSIFT> & scene, size_t nr_models,
+		std::vector<pcl::Correspondences> & correspondences, std::vector<size_t> & candidates) const
+{
+	if (index.empty())
+		return;
+
+	const int k = jointNeighbours(index.size());
+	std::vector<int> rows, model_rows;
+	std::vector<float> sqr_dists, model_sqr_dists;
+	// Per model: the last scene feature whose neighbours contained it, its first position and second distance there.
+	std::vector<size_t> stamps(nr_models, static_cast<size_t>(-1));
+	std::vector<int> first_positions(nr_models);
+	std::vector<float> second_sqr_dists(nr_models);
+	std::vector<int> found_models;
+	found_models.reserve(k);
+	for (size_t j = 0; j < scene.size(); ++j) {
+		const float * descriptor = scene.points[j].descriptor;
+		if (!pcl_isfinite(descriptor[0])) //skipping NaNs
+			continue;
+		int found_neighs = index.knnSearch(descriptor, k, rows, sqr_dists);
+		if (found_neighs < 1)
+			continue;
+
+		found_models.clear();
+		for (int n = 0; n < found_neighs; ++n) {
+			int model = index.label(rows[n]).cloud_id;
+			if (stamps[model] != j) {
+				stamps[model] = j;
+				first_positions[model] = n;
+				second_sqr_dists[model] = -1.0f;
+				found_models.push_back(model);
+			} else if (second_sqr_dists[model] < 0) {
+				second_sqr_dists[model] = sqr_dists[n];
+			}
+		}
+
+		// Descriptors not returned by an exact search are not closer than the k-th one.
+		bool bounded = index.exact() && static_cast<size_t>(found_neighs) < index.size();
+		for (size_t f = 0; f < found_models.size(); ++f) {
+			int model = found_models[f];
+			int n = first_positions[model];
+			float sqr_dist = sqr_dists[n];
+			++candidates[model];
+			if (!accept(sqr_dist, -1.0f))
+				continue;
+
+			float second_sqr_dist = second_sqr_dists[model];
+			if (params.use_ratio_test && second_sqr_dist < 0) {
+				if (bounded && accept(sqr_dist, sqr_dists[found_neighs - 1])) {
+					// Passes against a lower bound of the second distance.
+					second_sqr_dist = -1.0f;
+				} else {
+					int model_neighs = index.knnSearchCloud(model, descriptor, 2, model_rows, model_sqr_dists);
+					second_sqr_dist = model_neighs > 1 ? model_sqr_dists[1] : -1.0f;
+				}
+			}
+			if (accept(sqr_dist, second_sqr_dist))
+				correspondences[model].push_back(pcl::Correspondence(index.label(rows[n]).point_index, static_cast<int>(j), sqr_dist));
+		}
+	}
+}
+
+#endif /* MODELMATCHER_HPP_ */
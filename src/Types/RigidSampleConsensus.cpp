@@ -0,0 +1,268 @@
+/*!
+ * \file
+ * \brief Sample consensus estimation of the rigid transformation between corresponding points.
+ */
+
+#include "RigidSampleConsensus.hpp"
+
+#include "InlierCounter.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <Eigen/Geometry>
+
+namespace {
+
+/// Probability that a correspondence supports a wrong model by chance (PROSAC non-randomness).
+const double RANDOM_SUPPORT = 0.05;
+
+/// Significance of the non-randomness test.
+const double SIGNIFICANCE = 0.05;
+
+/// Sizes of the first and of the largest batch of hypotheses.
+const size_t MIN_BATCH = 16;
+const size_t MAX_BATCH = 1024;
+
+/// Minimal number of residuals scored by a thread.
+const size_t MIN_THREAD_WORK = 1 << 18;
+
+/// Number of samples needed to draw an all-inlier sample of size m with the given probability, if inliers form the given fraction.
+double neededSamples(double inlier_ratio, int m, double confidence) {
+	double p_good = std::pow(inlier_ratio, m);
+	if (p_good >= 1)
+		return 0;
+	if (p_good <= 0)
+		return std::numeric_limits<double>::max();
+	return std::log(1 - confidence) / std::log(1 - p_good);
+}
+
+/// Smallest support among the n best correspondences which a wrong model (supported by its m sample points) reaches with probability below the significance.
+int nonRandomSupport(int n, int m) {
+	const int trials = n - m;
+	if (trials > 20) {
+		// Normal approximation of the binomial distribution.
+		double mean = trials * RANDOM_SUPPORT;
+		double sigma = std::sqrt(trials * RANDOM_SUPPORT * (1 - RANDOM_SUPPORT));
+		return m + static_cast<int>(std::ceil(mean + 1.645 * sigma + 0.5));
+	}
+	// Binomial tail summed from the largest count.
+	double tail = 0;
+	int k = trials;
+	for (; k >= 0; --k) {
+		double pmf = std::pow(RANDOM_SUPPORT, k) * std::pow(1 - RANDOM_SUPPORT, trials - k);
+		for (int i = 0; i < k; ++i)
+			pmf *= static_cast<double>(trials - i) / (i + 1);
+		tail += pmf;
+		if (tail >= SIGNIFICANCE)
+			break;
+	}
+	return m + k + 1;
+}
+
+} //: namespace
+
+RigidSampleConsensus::RigidSampleConsensus(const Params & params) : params(params), iterations(0) {
+}
+
+void RigidSampleConsensus::drawSample(int iteration, int & n, double & t_n, double & t_prime, int * sample) {
+	const int m = 3;
+	const int size = src_x.size();
+	if (!params.guided) {
+		sample[0] = rng() % size;
+		do sample[1] = rng() % size; while (sample[1] == sample[0]);
+		do sample[2] = rng() % size; while (sample[2] == sample[0] || sample[2] == sample[1]);
+		return;
+	}
+	while (n < size && iteration >= t_prime) {
+		double t_next = t_n * (n + 1) / (n + 1 - m);
+		t_prime += std::ceil(t_next - t_n);
+		t_n = t_next;
+		++n;
+	}
+	// The newest correspondence is in every sample of its stage, after the last stage sampling is uniform.
+	if (t_prime < iteration) {
+		sample[0] = rng() % n;
+	} else {
+		sample[0] = n - 1;
+	}
+	do sample[1] = rng() % n; while (sample[1] == sample[0]);
+	do sample[2] = rng() % n; while (sample[2] == sample[0] || sample[2] == sample[1]);
+}
+
+bool RigidSampleConsensus::hypothesis(const int * sample, Eigen::Matrix4f & transformation) const {
+	Eigen::Matrix3f src_points, trg_points;
+	for (int i = 0; i < 3; ++i) {
+		src_points.col(i) = source(sample[i]);
+		trg_points.col(i) = target(sample[i]);
+	}
+	// Rigid transformations keep distances, so they have to agree up to the noise of both ends.
+	const float tolerance = 2 * params.inlier_threshold;
+	for (int a = 0; a < 3; ++a) {
+		int b = (a + 1) % 3;
+		float src_dist = (src_points.col(a) - src_points.col(b)).norm();
+		float trg_dist = (trg_points.col(a) - trg_points.col(b)).norm();
+		if (std::fabs(src_dist - trg_dist) > tolerance)
+			return false;
+	}
+	// Nearly collinear points do not determine the rotation.
+	Eigen::Vector3f normal = (src_points.col(1) - src_points.col(0)).cross(src_points.col(2) - src_points.col(0));
+	if (normal.norm() < params.inlier_threshold * params.inlier_threshold)
+		return false;
+
+	transformation = Eigen::umeyama(src_points, trg_points, false);
+	return true;
+}
+
+int RigidSampleConsensus::countInliers(const Eigen::Matrix4f & transformation) const {
+	float rows[12];
+	for (int r = 0; r < 3; ++r)
+		for (int c = 0; c < 4; ++c)
+			rows[r * 4 + c] = transformation(r, c);
+	InlierCounter::Coordinates src = { &src_x[0], &src_y[0], &src_z[0] };
+	InlierCounter::Coordinates trg = { &trg_x[0], &trg_y[0], &trg_z[0] };
+	return InlierCounter::count(src, trg, src_x.size(), rows, params.inlier_threshold * params.inlier_threshold);
+}
+
+void RigidSampleConsensus::findInliers(const Eigen::Matrix4f & transformation, std::vector<int> & inliers) const {
+	const Eigen::Matrix3f rotation = transformation.topLeftCorner<3, 3>();
+	const Eigen::Vector3f translation = transformation.topRightCorner<3, 1>();
+	const float sqr_threshold = params.inlier_threshold * params.inlier_threshold;
+	inliers.clear();
+	for (size_t i = 0; i < src_x.size(); ++i)
+		if ((rotation * source(i) + translation - target(i)).squaredNorm() < sqr_threshold)
+			inliers.push_back(i);
+}
+
+void RigidSampleConsensus::scoreRange(const Transformations * hypotheses, size_t begin, size_t end, std::vector<int> * counts) const {
+	for (size_t h = begin; h < end; ++h)
+		(*counts)[h] = countInliers((*hypotheses)[h]);
+}
+
+void RigidSampleConsensus::scoreBatch(const Transformations & hypotheses, std::vector<int> & counts) const {
+	counts.resize(hypotheses.size());
+	int threads = params.threads > 0 ? params.threads : std::max(1u, boost::thread::hardware_concurrency());
+	threads = std::min<size_t>(threads, hypotheses.size() * src_x.size() / MIN_THREAD_WORK);
+	if (threads <= 1) {
+		scoreRange(&hypotheses, 0, hypotheses.size(), &counts);
+		return;
+	}
+	// Threads write disjoint ranges of the counts.
+	boost::thread_group group;
+	for (int t = 0; t < threads; ++t)
+		group.create_thread(boost::bind(&RigidSampleConsensus::scoreRange, this, &hypotheses,
+				hypotheses.size() * t / threads, hypotheses.size() * (t + 1) / threads, &counts));
+	group.join_all();
+}
+
+bool RigidSampleConsensus::compute(Eigen::Matrix4f & transformation, std::vector<int> & inliers) {
+	const int m = 3;
+	const int size = src_x.size();
+	transformation = Eigen::Matrix4f::Identity();
+	inliers.clear();
+	iterations = 0;
+	if (size < m)
+		return false;
+	rng.seed(12345u);
+
+	// PROSAC growth function - average number of samples drawn from the best n correspondences (t_n) within the budget,
+	// t_prime - iteration at which the n-th correspondence joins the sampled set.
+	int n = m;
+	double t_n = params.max_iterations;
+	for (int i = 0; i < m; ++i)
+		t_n *= static_cast<double>(m - i) / (size - i);
+	double t_prime = 1;
+
+	std::vector<int> min_support;
+	if (params.guided) {
+		min_support.resize(size + 1);
+		for (int i = 0; i <= size; ++i)
+			min_support[i] = nonRandomSupport(i, m);
+	}
+
+	Eigen::Matrix4f best_transformation = Eigen::Matrix4f::Identity();
+	int best_count = 0;
+	int best_iteration = 0;
+	double needed = params.max_iterations;
+	int drawn = 0;
+	Transformations hypotheses;
+	std::vector<int> hypothesis_iterations;
+	std::vector<int> counts;
+	std::vector<int> positions;
+	size_t batch_size = MIN_BATCH;
+	bool done = false;
+	while (!done && drawn < params.max_iterations && drawn < needed) {
+		// Draw a batch - the bound on the number of iterations can only decrease while it is scored.
+		hypotheses.clear();
+		hypothesis_iterations.clear();
+		while (hypotheses.size() < batch_size && drawn < params.max_iterations && drawn < needed) {
+			++drawn;
+			int sample[m];
+			drawSample(drawn, n, t_n, t_prime, sample);
+			Eigen::Matrix4f current;
+			if (!hypothesis(sample, current))
+				continue;
+			hypotheses.push_back(current);
+			hypothesis_iterations.push_back(drawn);
+		}
+		scoreBatch(hypotheses, counts);
+		batch_size = std::min(2 * batch_size, MAX_BATCH);
+
+		// Scores are taken in the drawing order, as if hypotheses were scored one by one.
+		for (size_t h = 0; h < hypotheses.size(); ++h) {
+			if (hypothesis_iterations[h] - 1 >= needed) {
+				done = true;
+				break;
+			}
+			if (counts[h] <= best_count)
+				continue;
+			best_count = counts[h];
+			best_transformation = hypotheses[h];
+			best_iteration = hypothesis_iterations[h];
+
+			// Number of samples after which an all-inlier sample was drawn with the required probability.
+			if (params.confidence >= 1)
+				continue;
+			needed = neededSamples(static_cast<double>(best_count) / size, m, params.confidence);
+			if (!params.guided)
+				continue;
+			// PROSAC maximality - samples were drawn from the best correspondences, so it suffices that the required probability
+			// is reached within a set of the best ones on which the support of the model is not random.
+			findInliers(best_transformation, positions);
+			for (size_t i = 0; i < positions.size(); ++i) {
+				int support = i + 1, set_size = positions[i] + 1;
+				if (support < min_support[set_size])
+					continue;
+				needed = std::min(needed, neededSamples(static_cast<double>(support) / set_size, m, params.confidence));
+			}
+		}
+	}
+	// Hypotheses drawn by the one by one loop - up to the bound, but at least up to the best one.
+	iterations = static_cast<int>(std::min<double>(drawn, std::max<double>(best_iteration, std::ceil(needed))));
+	if (best_count < m)
+		return false;
+
+	// Least squares estimate from all inliers, kept if it does not lose support.
+	std::vector<int> best_inliers;
+	findInliers(best_transformation, best_inliers);
+	Eigen::Matrix3Xf src_points(3, best_inliers.size()), trg_points(3, best_inliers.size());
+	for (size_t i = 0; i < best_inliers.size(); ++i) {
+		src_points.col(i) = source(best_inliers[i]);
+		trg_points.col(i) = target(best_inliers[i]);
+	}
+	Eigen::Matrix4f refined = Eigen::umeyama(src_points, trg_points, false);
+	if (countInliers(refined) >= best_count) {
+		best_transformation = refined;
+		findInliers(best_transformation, best_inliers);
+	}
+
+	transformation = best_transformation;
+	inliers.resize(best_inliers.size());
+	for (size_t i = 0; i < best_inliers.size(); ++i)
+		inliers[i] = order[best_inliers[i]];
+	std::sort(inliers.begin(), inliers.end());
+	return true;
+}
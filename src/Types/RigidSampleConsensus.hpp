@@ -0,0 +1,155 @@
+/*!
+ * \file
+ * \brief Sample consensus estimation of the rigid transformation between corresponding points.
+ */
+
+#ifndef RIGIDSAMPLECONSENSUS_HPP_
+#define RIGIDSAMPLECONSENSUS_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+
+/*!
+ * \class RigidSampleConsensus
+ * \brief Finds the rigid transformation supported by the most correspondences.
+ *
+ * A replacement of pcl::registration::CorrespondenceRejectorSampleConsensus.
+ * Correspondences are ordered by their distance (descriptor distance, smaller
+ * is better) and hypotheses are drawn by PROSAC (Chum and Matas): from a set of
+ * the best correspondences growing with the number of iterations, so good
+ * matches are tried first and the sampling becomes uniform at the end of the
+ * budget. Samples violating the rigidity (distances between the source points
+ * differ from the ones between the target points) are rejected before the
+ * transformation is computed.
+ *
+ * The run stops when the probability of having missed an all-inlier sample,
+ * given the inlier ratio of the best hypothesis, falls below 1 - confidence.
+ * With PROSAC the ratio may be taken within any set of the best correspondences
+ * on which the support of the hypothesis is not random, so runs with good
+ * matches at the top of the ordering end after a few dozen hypotheses.
+ * The best transformation is finally re-estimated from all its inliers.
+ *
+ * Hypotheses are drawn in batches (growing from 16 to 1024) and scored by the
+ * vectorized InlierCounter over points stored as coordinate arrays - batches
+ * large enough to pay for threads are split between several of them. Scores
+ * are taken in the drawing order, so the result does not depend on the number
+ * of threads and is the same as of scoring hypotheses one by one.
+ */
+class RigidSampleConsensus {
+public:
+	/// Estimation parameters.
+	struct Params {
+		/// Maximal distance of an inlier from its transformed correspondence.
+		float inlier_threshold;
+
+		/// Maximal number of hypotheses.
+		int max_iterations;
+
+		/// Required probability of drawing an all-inlier sample (1 - no early termination).
+		double confidence;
+
+		/// PROSAC sampling from the best correspondences (false - uniform sampling).
+		bool guided;
+
+		/// Number of threads scoring hypotheses (0 - one per core).
+		int threads;
+
+		Params() : inlier_threshold(0.01f), max_iterations(2000), confidence(0.99), guided(true), threads(1) {}
+	};
+
+	explicit RigidSampleConsensus(const Params & params = Params());
+
+	void setParams(const Params & params) { this->params = params; }
+
+	/// Copies coordinates of the corresponding points, ordered by the correspondence distance.
+	template <typename PointT>
+	void setCorrespondences(const pcl::PointCloud<PointT> & cloud_src, const pcl::PointCloud<PointT> & cloud_trg, const pcl::Correspondences & correspondences);
+
+	/// Finds the transformation of the source onto the target and its inliers (positions in the correspondences, increasing).
+	/// Returns false (identity) if there are less than three correspondences or no sample gave a hypothesis.
+	bool compute(Eigen::Matrix4f & transformation, std::vector<int> & inliers);
+
+	/// Number of hypotheses drawn by the last compute().
+	int getIterations() const { return iterations; }
+
+protected:
+	/// Orders positions of correspondences by increasing distance.
+	struct DistanceLess {
+		const pcl::Correspondences * correspondences;
+		explicit DistanceLess(const pcl::Correspondences * correspondences) : correspondences(correspondences) {}
+		bool operator()(int a, int b) const { return (*correspondences)[a].distance < (*correspondences)[b].distance; }
+	};
+
+	typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > Transformations;
+
+	/// Draws the sample of the given iteration - PROSAC state (n, t_n, t_prime) is advanced as needed.
+	void drawSample(int iteration, int & n, double & t_n, double & t_prime, int * sample);
+
+	/// Computes the transformation of the sample (three positions), returns false for samples which are not rigid or degenerate.
+	bool hypothesis(const int * sample, Eigen::Matrix4f & transformation) const;
+
+	/// Counts correspondences within the threshold under the transformation (vectorized).
+	int countInliers(const Eigen::Matrix4f & transformation) const;
+
+	/// Returns positions of the correspondences within the threshold under the transformation.
+	void findInliers(const Eigen::Matrix4f & transformation, std::vector<int> & inliers) const;
+
+	/// Scores hypotheses [begin, end) of the batch.
+	void scoreRange(const Transformations * hypotheses, size_t begin, size_t end, std::vector<int> * counts) const;
+
+	/// Scores the batch, split between threads if it is large enough.
+	void scoreBatch(const Transformations & hypotheses, std::vector<int> & counts) const;
+
+	Eigen::Vector3f source(int i) const { return Eigen::Vector3f(src_x[i], src_y[i], src_z[i]); }
+	Eigen::Vector3f target(int i) const { return Eigen::Vector3f(trg_x[i], trg_y[i], trg_z[i]); }
+
+	Params params;
+
+	/// Coordinates of the corresponding source and target points, the best correspondence first.
+	std::vector<float> src_x, src_y, src_z;
+	std::vector<float> trg_x, trg_y, trg_z;
+
+	/// Position of every pair in the input correspondences.
+	std::vector<int> order;
+
+	int iterations;
+
+	boost::mt19937 rng;
+};
+
+template <typename PointT>
+void RigidSampleConsensus::setCorrespondences(const pcl::PointCloud<PointT> & cloud_src, const pcl::PointCloud<PointT> & cloud_trg, const pcl::Correspondences & correspondences)
+{
+	order.resize(correspondences.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), DistanceLess(&correspondences));
+
+	src_x.resize(order.size());
+	src_y.resize(order.size());
+	src_z.resize(order.size());
+	trg_x.resize(order.size());
+	trg_y.resize(order.size());
+	trg_z.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		const pcl::Correspondence & c = correspondences[order[i]];
+		const PointT & p = cloud_src.points[c.index_query];
+		const PointT & q = cloud_trg.points[c.index_match];
+		src_x[i] = p.x;
+		src_y[i] = p.y;
+		src_z[i] = p.z;
+		trg_x[i] = q.x;
+		trg_y[i] = q.y;
+		trg_z[i] = q.z;
+	}
+}
+
+#endif /* RIGIDSAMPLECONSENSUS_HPP_ */
@@ -0,0 +1,42 @@
+/*!
+ * \file
+ * \brief Point representation of the descriptor part of PointXYZSIFT.
+ */
+
+#ifndef SIFTFEATUREREPRESENTATION_HPP_
+#define SIFTFEATUREREPRESENTATION_HPP_
+
+#include <cstring>
+
+#include <pcl/point_representation.h>
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+
+/*!
+ * \class SIFTFeatureRepresentation
+ * \brief Class used for transformation from SIFT descriptor to array of floats.
+ *
+ * This representation is only for determining correspondences (not for use in Kd-tree for example)
+ * - so it uses only the SIFT part of the point.
+ */
+class SIFTFeatureRepresentation: public pcl::DefaultFeatureRepresentation <PointXYZSIFT>
+{
+	/// Templatiated number of SIFT descriptor dimensions.
+	using pcl::PointRepresentation<PointXYZSIFT>::nr_dimensions_;
+
+public:
+	SIFTFeatureRepresentation ()
+	{
+		// Define the number of dimensions.
+		nr_dimensions_ = DescriptorDistance::SIFT_SIZE;
+		trivial_ = false ;
+	}
+
+	/// Overrides the copyToFloatArray method to define our feature vector - descriptor is copied as one block.
+	virtual void copyToFloatArray (const PointXYZSIFT &p, float * out) const
+	{
+		std::memcpy(out, p.descriptor, DescriptorDistance::SIFT_SIZE * sizeof(float));
+	}
+};
+
+#endif /* SIFTFEATUREREPRESENTATION_HPP_ */
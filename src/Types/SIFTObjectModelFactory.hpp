@@ -27,6 +27,7 @@ public:
 		som->cloud_xyzsift = cloud_xyzsift;
 		somn->cloud_xyzrgb_normals=cloud_xyzrgb_normals;
 		som->name = model_name;
+		som->filename = model_filename;
 		som->mean_viewpoint_features_number = mean_viewpoint_features_number;
 		return som;
 	}
@@ -44,6 +45,9 @@ protected:
 	/// Name of the model.
 	std::string model_name;
 
+	/// File the model is read from (empty - not read from a file).
+	std::string model_filename;
+
 	/// Mean number of viewpoint features.
 	int mean_viewpoint_features_number;
 	
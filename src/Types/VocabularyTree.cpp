@@ -0,0 +1,218 @@
+/*!
+ * \file
+ * \brief Vocabulary tree for bag-of-visual-words similarity of views.
+ */
+
+#include "VocabularyTree.hpp"
+#include "KMeans.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include <pcl/pcl_macros.h>
+
+VocabularyTree::VocabularyTree() : nr_words(0), trained_descriptors(0), total_descriptors(0) {
+}
+
+VocabularyTree::VocabularyTree(const Params & params) : params(params), nr_words(0), trained_descriptors(0), total_descriptors(0) {
+}
+
+void VocabularyTree::clear() {
+	first_child.clear();
+	nr_children.clear();
+	node_word.clear();
+	centroids.clear();
+	nr_words = 0;
+	trained_descriptors = 0;
+	total_descriptors = 0;
+	clouds.clear();
+	view_words.clear();
+	inverted.clear();
+	view_counts.clear();
+	view_log_counts.clear();
+}
+
+int VocabularyTree::addView(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud) {
+	int view = clouds.size();
+	clouds.push_back(cloud);
+	view_words.push_back(std::vector<std::pair<int, float> >());
+	view_counts.push_back(0.0);
+	view_log_counts.push_back(0.0);
+	if (!cloud)
+		return view;
+	for (size_t i = 0; i < cloud->size(); ++i)
+		total_descriptors += pcl_isfinite(cloud->points[i].descriptor[0]);
+	if (nr_words > 0) {
+		histogram(*cloud, view_words[view]);
+		indexView(view);
+	}
+	return view;
+}
+
+void VocabularyTree::train() {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	first_child.assign(1, 0);
+	nr_children.assign(1, 0);
+	node_word.assign(1, -1);
+	centroids.assign(dim, 0.0f);
+	nr_words = 0;
+	trained_descriptors = total_descriptors;
+
+	// Gather finite descriptors, evenly subsampled to the training budget.
+	size_t step = std::max<size_t>(1, total_descriptors / std::max(params.max_training_samples, 1));
+	std::vector<float> samples;
+	size_t counter = 0;
+	for (size_t v = 0; v < clouds.size(); ++v) {
+		if (!clouds[v])
+			continue;
+		for (size_t j = 0; j < clouds[v]->size(); ++j) {
+			const PointXYZSIFT & p = clouds[v]->points[j];
+			if (!pcl_isfinite(p.descriptor[0]) || counter++ % step != 0)
+				continue;
+			samples.insert(samples.end(), p.descriptor, p.descriptor + dim);
+		}
+	}
+	std::vector<int> members(samples.size() / dim);
+	for (size_t i = 0; i < members.size(); ++i)
+		members[i] = i;
+	buildNode(0, samples, members, 0);
+
+	// Views are quantized again with the new vocabulary.
+	inverted.assign(nr_words, std::vector<std::pair<int, float> >());
+	for (size_t v = 0; v < clouds.size(); ++v) {
+		view_words[v].clear();
+		if (!clouds[v])
+			continue;
+		histogram(*clouds[v], view_words[v]);
+		for (size_t i = 0; i < view_words[v].size(); ++i)
+			inverted[view_words[v][i].first].push_back(std::make_pair(static_cast<int>(v), view_words[v][i].second));
+	}
+	refreshNorms();
+}
+
+void VocabularyTree::buildNode(int node, const std::vector<float> & samples, const std::vector<int> & members, int level) {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	const int branching = std::max(params.branching, 2);
+	if (level >= params.depth || members.size() <= static_cast<size_t>(branching)) {
+		node_word[node] = nr_words++;
+		return;
+	}
+
+	std::vector<float> data(members.size() * dim);
+	for (size_t i = 0; i < members.size(); ++i)
+		std::copy(&samples[members[i] * dim], &samples[members[i] * dim] + dim, &data[i * dim]);
+	std::vector<float> child_centroids;
+	KMeans::cluster(&data[0], members.size(), dim, branching, params.iterations, child_centroids);
+
+	std::vector<std::vector<int> > child_members(branching);
+	for (size_t i = 0; i < members.size(); ++i)
+		child_members[KMeans::nearest(&data[i * dim], &child_centroids[0], branching, dim)].push_back(members[i]);
+
+	int first = first_child.size();
+	first_child[node] = first;
+	nr_children[node] = branching;
+	first_child.resize(first + branching, 0);
+	nr_children.resize(first + branching, 0);
+	node_word.resize(first + branching, -1);
+	centroids.insert(centroids.end(), child_centroids.begin(), child_centroids.end());
+	for (int c = 0; c < branching; ++c)
+		buildNode(first + c, samples, child_members[c], level + 1);
+}
+
+int VocabularyTree::quantize(const float * descriptor) const {
+	const size_t dim = DescriptorDistance::SIFT_SIZE;
+	int node = 0;
+	while (nr_children[node] > 0)
+		node = first_child[node] + KMeans::nearest(descriptor, &centroids[first_child[node] * dim], nr_children[node], dim);
+	return node_word[node];
+}
+
+void VocabularyTree::histogram(const pcl::PointCloud<PointXYZSIFT> & cloud, std::vector<std::pair<int, float> > & words) const {
+	std::map<int, float> counts;
+	for (size_t i = 0; i < cloud.size(); ++i) {
+		// Skip NaNs.
+		if (!pcl_isfinite(cloud.points[i].descriptor[0]))
+			continue;
+		counts[quantize(cloud.points[i].descriptor)] += 1.0f;
+	}
+	words.assign(counts.begin(), counts.end());
+}
+
+void VocabularyTree::indexView(int view) {
+	const std::vector<std::pair<int, float> > & words = view_words[view];
+	for (size_t i = 0; i < words.size(); ++i) {
+		std::vector<std::pair<int, float> > & list = inverted[words[i].first];
+		// Document frequency of the word grows - only views in its list change their norm terms.
+		if (!list.empty()) {
+			double delta = std::log(list.size() + 1.0) - std::log(static_cast<double>(list.size()));
+			for (size_t e = 0; e < list.size(); ++e)
+				view_log_counts[list[e].first] += list[e].second * delta;
+		}
+		list.push_back(std::make_pair(view, words[i].second));
+		view_counts[view] += words[i].second;
+		view_log_counts[view] += words[i].second * std::log(static_cast<double>(list.size()));
+	}
+}
+
+void VocabularyTree::refreshNorms() {
+	view_counts.assign(view_words.size(), 0.0);
+	view_log_counts.assign(view_words.size(), 0.0);
+	for (size_t v = 0; v < view_words.size(); ++v)
+		for (size_t i = 0; i < view_words[v].size(); ++i) {
+			view_counts[v] += view_words[v][i].second;
+			view_log_counts[v] += view_words[v][i].second * std::log(static_cast<double>(inverted[view_words[v][i].first].size()));
+		}
+}
+
+int VocabularyTree::query(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int k, std::vector<int> & views, std::vector<float> & scores) {
+	views.clear();
+	scores.clear();
+	if (!cloud || clouds.empty() || k <= 0)
+		return 0;
+	if (nr_words == 0 || total_descriptors >= 2 * trained_descriptors)
+		train();
+	if (nr_words == 0)
+		return 0;
+
+	// Inverse document frequencies of the query words - words present in all views carry no information.
+	const double log_views = std::log(static_cast<double>(clouds.size()));
+	std::vector<std::pair<int, float> > query_words;
+	histogram(*cloud, query_words);
+	std::vector<float> idf(query_words.size(), 0.0f);
+	float query_norm = 0;
+	for (size_t i = 0; i < query_words.size(); ++i) {
+		size_t frequency = inverted[query_words[i].first].size();
+		if (frequency > 0)
+			idf[i] = log_views - std::log(static_cast<double>(frequency));
+		query_norm += query_words[i].second * idf[i];
+	}
+	if (query_norm <= 0)
+		return 0;
+
+	// Intersection of L1 normalized histograms, accumulated over the inverted lists of the query words.
+	// Norms of the views come from the terms kept up to date by indexView().
+	std::vector<float> view_scores(clouds.size(), 0.0f);
+	for (size_t i = 0; i < query_words.size(); ++i) {
+		if (idf[i] <= 0)
+			continue;
+		float q = query_words[i].second * idf[i] / query_norm;
+		const std::vector<std::pair<int, float> > & list = inverted[query_words[i].first];
+		for (size_t e = 0; e < list.size(); ++e) {
+			int v = list[e].first;
+			float view_norm = view_counts[v] * log_views - view_log_counts[v];
+			view_scores[v] += std::min(q, list[e].second * idf[i] / view_norm);
+		}
+	}
+
+	std::vector<std::pair<float, int> > ranking(clouds.size());
+	for (size_t v = 0; v < clouds.size(); ++v)
+		ranking[v] = std::make_pair(-view_scores[v], static_cast<int>(v));
+	k = std::min<int>(k, ranking.size());
+	std::partial_sort(ranking.begin(), ranking.begin() + k, ranking.end());
+	for (int n = 0; n < k; ++n) {
+		views.push_back(ranking[n].second);
+		scores.push_back(-ranking[n].first);
+	}
+	return k;
+}
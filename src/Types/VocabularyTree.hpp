@@ -0,0 +1,128 @@
+/*!
+ * \file
+ * \brief Vocabulary tree for bag-of-visual-words similarity of views.
+ */
+
+#ifndef VOCABULARYTREE_HPP_
+#define VOCABULARYTREE_HPP_
+
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <pcl/point_cloud.h>
+
+#include <Types/PointXYZSIFT.hpp>
+#include <Types/DescriptorDistance.hpp>
+
+/*!
+ * \class VocabularyTree
+ * \brief Ranks stored views (documents) by bag-of-visual-words similarity to a query view.
+ *
+ * Descriptors are quantized by a tree of hierarchical k-means (branching^depth
+ * visual words at most), every view is described by the histogram of its words
+ * weighted with tf-idf and normalized in L1, and similarity of two views is the
+ * intersection of their histograms (Nister and Stewenius). Views are scored
+ * through the inverted file, so a query costs time proportional to the number
+ * of its features, not to the number of features of all views.
+ *
+ * The vocabulary is trained on the descriptors of the added views - at the first
+ * query and again every time their number doubles, so it follows a growing model.
+ */
+class VocabularyTree {
+public:
+	typedef boost::shared_ptr<VocabularyTree> Ptr;
+
+	/// Vocabulary parameters.
+	struct Params {
+		/// Number of children of every node.
+		int branching;
+
+		/// Number of levels - the tree has at most branching^depth leaves (words).
+		int depth;
+
+		/// Number of k-means iterations at every node.
+		int iterations;
+
+		/// Maximal number of descriptors used for training.
+		int max_training_samples;
+
+		Params() : branching(8), depth(4), iterations(5), max_training_samples(50000) {}
+	};
+
+	VocabularyTree();
+
+	explicit VocabularyTree(const Params & params);
+
+	/// Sets parameters, they take effect at the next training.
+	void setParams(const Params & params) { this->params = params; }
+
+	/// Removes all views and the vocabulary.
+	void clear();
+
+	/// Adds the view (its cloud has to be kept alive), returns its document id - consecutive from 0.
+	int addView(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud);
+
+	/// Finds (at most) k views most similar to the cloud, sorted by decreasing score.
+	int query(const pcl::PointCloud<PointXYZSIFT>::ConstPtr & cloud, int k, std::vector<int> & views, std::vector<float> & scores);
+
+	/// Number of added views.
+	size_t size() const { return view_words.size(); }
+
+	/// Number of words of the current vocabulary.
+	size_t words() const { return nr_words; }
+
+protected:
+	/// Trains the vocabulary on descriptors of all views and quantizes them again.
+	void train();
+
+	/// Builds the subtree of the node over the given samples.
+	void buildNode(int node, const std::vector<float> & samples, const std::vector<int> & members, int level);
+
+	/// Returns the word (leaf) of the descriptor.
+	int quantize(const float * descriptor) const;
+
+	/// Computes the sparse histogram (sorted words with counts) of finite descriptors of the cloud.
+	void histogram(const pcl::PointCloud<PointXYZSIFT> & cloud, std::vector<std::pair<int, float> > & words) const;
+
+	/// Adds the histogram of the view to the inverted file and updates the norm terms of views sharing its words.
+	void indexView(int view);
+
+	/// Computes the norm terms of all views from scratch.
+	void refreshNorms();
+
+	Params params;
+
+	/// Children of every node (first child and count, count 0 - leaf) and word of every leaf.
+	std::vector<int> first_child;
+	std::vector<int> nr_children;
+	std::vector<int> node_word;
+
+	/// Centroid of every node (nodes x 128), the root has none.
+	std::vector<float> centroids;
+
+	size_t nr_words;
+
+	/// Number of descriptors the vocabulary was trained on.
+	size_t trained_descriptors;
+
+	/// Number of finite descriptors of all views.
+	size_t total_descriptors;
+
+	/// Clouds of the views.
+	std::vector<pcl::PointCloud<PointXYZSIFT>::ConstPtr> clouds;
+
+	/// Word histogram (raw counts) of every view.
+	std::vector<std::vector<std::pair<int, float> > > view_words;
+
+	/// Views (and counts) of every word.
+	std::vector<std::vector<std::pair<int, float> > > inverted;
+
+	/// Terms of the tf-idf norm of every view, which is view_counts * log(views) - view_log_counts:
+	/// the number of its words and the sum of their counts weighted by the log of their document frequencies.
+	std::vector<double> view_counts;
+	std::vector<double> view_log_counts;
+};
+
+#endif /* VOCABULARYTREE_HPP_ */
@@ -0,0 +1,84 @@
+/*!
+ * \file
+ * \brief Bounded-memory accumulation of XYZRGB views in a voxel hash.
+ */
+
+#include "VoxelHashCloud.hpp"
+
+#include <cmath>
+
+#include <pcl/pcl_macros.h>
+
+VoxelHashCloud::VoxelHashCloud(float leaf_size) : leaf_size(leaf_size), view_counter(0), cloud(new pcl::PointCloud<pcl::PointXYZRGB>()) {
+}
+
+void VoxelHashCloud::setLeafSize(float leaf_size) {
+	this->leaf_size = leaf_size;
+	clear();
+}
+
+void VoxelHashCloud::clear() {
+	view_counter = 0;
+	voxels.clear();
+	voxel_map.clear();
+	cloud->clear();
+}
+
+boost::uint64_t VoxelHashCloud::key(int ix, int iy, int iz) {
+	const boost::uint64_t mask = (1 << 21) - 1;
+	return ((static_cast<boost::uint64_t>(ix) & mask) << 42) | ((static_cast<boost::uint64_t>(iy) & mask) << 21) | (static_cast<boost::uint64_t>(iz) & mask);
+}
+
+void VoxelHashCloud::addView(const pcl::PointCloud<pcl::PointXYZRGB> & view) {
+	++view_counter;
+	const float inv_leaf = 1.0f / leaf_size;
+	std::vector<int> touched;
+	touched.reserve(view.size());
+	for (size_t i = 0; i < view.size(); ++i) {
+		const pcl::PointXYZRGB & p = view.points[i];
+		// Skip NaNs.
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			continue;
+		boost::uint64_t k = key(static_cast<int>(std::floor(p.x * inv_leaf)), static_cast<int>(std::floor(p.y * inv_leaf)), static_cast<int>(std::floor(p.z * inv_leaf)));
+		std::pair<boost::unordered_map<boost::uint64_t, int>::iterator, bool> it = voxel_map.insert(std::make_pair(k, static_cast<int>(voxels.size())));
+		if (it.second) {
+			Voxel v;
+			v.x = v.y = v.z = 0;
+			v.r = v.g = v.b = 0;
+			v.points = 0;
+			v.views = 0;
+			v.last_view = 0;
+			voxels.push_back(v);
+		}
+		Voxel & v = voxels[it.first->second];
+		v.x += p.x;
+		v.y += p.y;
+		v.z += p.z;
+		v.r += p.r;
+		v.g += p.g;
+		v.b += p.b;
+		++v.points;
+		if (v.last_view != view_counter) {
+			v.last_view = view_counter;
+			++v.views;
+			touched.push_back(it.first->second);
+		}
+	}
+
+	// Refresh means of the touched voxels only, new voxels are appended at the end of the cloud.
+	cloud->points.resize(voxels.size());
+	for (size_t t = 0; t < touched.size(); ++t) {
+		const Voxel & v = voxels[touched[t]];
+		pcl::PointXYZRGB & p = cloud->points[touched[t]];
+		const double inv = 1.0 / v.points;
+		p.x = v.x * inv;
+		p.y = v.y * inv;
+		p.z = v.z * inv;
+		p.r = static_cast<uint8_t>(v.r * inv + 0.5);
+		p.g = static_cast<uint8_t>(v.g * inv + 0.5);
+		p.b = static_cast<uint8_t>(v.b * inv + 0.5);
+	}
+	cloud->width = cloud->points.size();
+	cloud->height = 1;
+	cloud->is_dense = true;
+}
@@ -0,0 +1,84 @@
+/*!
+ * \file
+ * \brief Bounded-memory accumulation of XYZRGB views in a voxel hash.
+ */
+
+#ifndef VOXELHASHCLOUD_HPP_
+#define VOXELHASHCLOUD_HPP_
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+/*!
+ * \class VoxelHashCloud
+ * \brief Merged point cloud with (at most) one point per occupied voxel.
+ *
+ * Points of every added view are hashed into voxels of the given leaf size, each
+ * voxel accumulates the sums of positions and colours of its points, so the
+ * stored point is their running mean. The cloud therefore grows with the observed
+ * surface, not with the number of views, and adding a view costs time proportional
+ * to the view - only the voxels it touched are updated in the output cloud.
+ *
+ * Every voxel counts the points averaged in it and the views that observed it.
+ */
+class VoxelHashCloud {
+public:
+	explicit VoxelHashCloud(float leaf_size = 0.002f);
+
+	/// Changes the voxel size - removes all accumulated points.
+	void setLeafSize(float leaf_size);
+
+	float getLeafSize() const { return leaf_size; }
+
+	/// Removes all voxels (the output cloud is emptied in place).
+	void clear();
+
+	/// Accumulates finite points of the view.
+	void addView(const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+
+	/// Cloud of voxel means, i-th point describes the i-th voxel. Updated in place by addView().
+	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getCloud() const { return cloud; }
+
+	/// Number of points averaged in the given voxel.
+	int pointCount(size_t voxel) const { return voxels[voxel].points; }
+
+	/// Number of views which observed the given voxel.
+	int viewCount(size_t voxel) const { return voxels[voxel].views; }
+
+	/// Number of occupied voxels.
+	size_t size() const { return voxels.size(); }
+
+protected:
+	/// Accumulated voxel statistics.
+	struct Voxel {
+		double x, y, z;
+		double r, g, b;
+		int points;
+		int views;
+
+		/// Number of the last view which touched the voxel.
+		int last_view;
+	};
+
+	/// Packs integer voxel coordinates (21 bits each) into a hash key.
+	static boost::uint64_t key(int ix, int iy, int iz);
+
+	float leaf_size;
+
+	/// Number of added views.
+	int view_counter;
+
+	std::vector<Voxel> voxels;
+
+	/// Voxel key -> index in voxels (and in the output cloud).
+	boost::unordered_map<boost::uint64_t, int> voxel_map;
+
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+};
+
+#endif /* VOXELHASHCLOUD_HPP_ */